@@ -0,0 +1,93 @@
+#include "buffer_pool.h"
+#include <cstdlib>
+
+BufferPool::BufferPool()
+{
+    for (int i = 0; i < CLASS_NUMBER; i++)
+    {
+        m_free[i] = nullptr;
+        m_free_number[i] = 0;
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    for (int i = 0; i < CLASS_NUMBER; i++)
+    {
+        while (m_free[i])
+        {
+            FreeNode *node = m_free[i];
+            m_free[i] = node->next;
+            free(node);
+        }
+    }
+}
+
+int BufferPool::size_class(int size)
+{
+    int index = 0;
+    int class_size = MIN_BUFFER_SIZE;
+    while (class_size < size)
+    {
+        class_size <<= 1;
+        index++;
+    }
+    return index;
+}
+
+char *BufferPool::acquire(int size)
+{
+    if (size > MAX_BUFFER_SIZE)
+    {
+        return nullptr;
+    }
+
+    int index = size_class(size);
+    m_lockers[index].lock();
+    FreeNode *node = m_free[index];
+    if (node)
+    {
+        m_free[index] = node->next;
+        m_free_number[index]--;
+    }
+    m_lockers[index].unlock();
+
+    if (node)
+    {
+        return (char *)node;
+    }
+
+    // 没有空闲的缓存，按缓存行对齐向系统申请
+    void *buf = nullptr;
+    if (posix_memalign(&buf, 64, MIN_BUFFER_SIZE << index) != 0)
+    {
+        return nullptr;
+    }
+    return (char *)buf;
+}
+
+void BufferPool::release(char *buf, int size)
+{
+    if (!buf)
+    {
+        return;
+    }
+
+    int index = size_class(size);
+    FreeNode *node = (FreeNode *)buf;
+    m_lockers[index].lock();
+    if (m_free_number[index] < MAX_FREE_NUMBER)
+    {
+        node->next = m_free[index];
+        m_free[index] = node;
+        m_free_number[index]++;
+        node = nullptr;
+    }
+    m_lockers[index].unlock();
+
+    // 空闲的缓存太多了，还给系统
+    if (node)
+    {
+        free(node);
+    }
+}
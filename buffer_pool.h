@@ -0,0 +1,53 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include "locker.h"
+
+/*
+    按大小分级的缓存池，所有连接共享
+    每一级的缓存大小是上一级的两倍，从 MIN_BUFFER_SIZE 到 MAX_BUFFER_SIZE。
+    申请时取不小于所需大小的那一级，释放的缓存挂在对应级别的空闲链表上，
+    下次申请直接复用，不用每次都向系统申请内存。
+    连接只在有数据收发的时候才持有缓存，空闲的长连接不占用缓存。
+*/
+class BufferPool
+{
+public:
+    static const int MIN_BUFFER_SIZE = 1024;    // 最小一级缓存的大小
+    static const int CLASS_NUMBER = 8;          // 级别的数量，最大一级为 128KB
+    static const int MAX_BUFFER_SIZE = MIN_BUFFER_SIZE << (CLASS_NUMBER - 1);
+    static const int MAX_FREE_NUMBER = 4096;    // 每一级最多缓存多少块空闲的缓存
+
+    // C++11之后静态局部变量不用担心线程安全问题
+    static BufferPool *get_instance()
+    {
+        static BufferPool instance;
+        return &instance;
+    }
+
+    // 申请一块至少 size 字节的缓存，超过 MAX_BUFFER_SIZE 返回 nullptr
+    char *acquire(int size);
+
+    // 归还缓存，size 和申请时传入的一致
+    void release(char *buf, int size);
+
+private:
+    BufferPool();
+    ~BufferPool();
+
+    // size 所在的级别
+    static int size_class(int size);
+
+private:
+    // 空闲的缓存本身用来存放链表的指针
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    FreeNode *m_free[CLASS_NUMBER];     // 每一级的空闲链表
+    int m_free_number[CLASS_NUMBER];    // 每一级空闲缓存的数量
+    Locker m_lockers[CLASS_NUMBER];     // 每一级一把锁，不同大小的申请互不影响
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include "cache_policy.h"
+#include <cstring>
+#include <strings.h>
+#include <time.h>
+#include "http_date.h"
+
+#define CACHE_CONTROL(value) "Cache-Control: " value "\r\n", sizeof("Cache-Control: " value "\r\n") - 1
+
+// 缓存策略表，图片的文件名变了才会换内容，可以一直缓存；
+// 页面要让浏览器每次都验证，验证由 ETag 完成，没变化时回复304
+static const CachePolicy cache_policies[] = {
+    {"/images/", nullptr, CACHE_CONTROL("max-age=31536000, immutable"), 31536000},
+    {nullptr, ".css", CACHE_CONTROL("max-age=86400"), 86400},
+    {nullptr, ".js", CACHE_CONTROL("max-age=86400"), 86400},
+    {nullptr, ".html", CACHE_CONTROL("no-cache"), 0},
+    {nullptr, ".htm", CACHE_CONTROL("no-cache"), 0},
+};
+
+static const int POLICY_NUMBER = sizeof(cache_policies) / sizeof(cache_policies[0]);
+
+const CachePolicy *find_cache_policy(const char *url)
+{
+    for (int i = 0; i < POLICY_NUMBER; i++)
+    {
+        const char *prefix = cache_policies[i].prefix;
+        if (prefix && strncmp(url, prefix, strlen(prefix)) == 0)
+        {
+            return &cache_policies[i];
+        }
+    }
+
+    const char *ext = strrchr(url, '.');
+    if (!ext || strchr(ext, '/'))
+    {
+        return nullptr;
+    }
+    for (int i = 0; i < POLICY_NUMBER; i++)
+    {
+        if (!cache_policies[i].prefix && strcasecmp(ext, cache_policies[i].ext) == 0)
+        {
+            return &cache_policies[i];
+        }
+    }
+    return nullptr;
+}
+
+const char *expires_header(const CachePolicy *policy, int &len)
+{
+    // "Expires: " + 日期 + "\r\n"
+    static const int EXPIRES_LEN = 9 + HTTP_DATE_LEN + 2;
+    static thread_local char headers[POLICY_NUMBER][EXPIRES_LEN];
+    static thread_local time_t last[POLICY_NUMBER];
+
+    if (policy->max_age <= 0)
+    {
+        return nullptr;
+    }
+
+    int i = policy - cache_policies;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec != last[i])
+    {
+        last[i] = ts.tv_sec;
+        memcpy(headers[i], "Expires: ", 9);
+        format_http_date(ts.tv_sec + policy->max_age, headers[i] + 9);
+        headers[i][9 + HTTP_DATE_LEN] = '\r';
+        headers[i][9 + HTTP_DATE_LEN + 1] = '\n';
+    }
+
+    len = EXPIRES_LEN;
+    return headers[i];
+}
+
+bool match_etag(HeaderView list, const char *etag, int etag_len, const char *suffix, bool weak)
+{
+    const char *p = list.data;
+    const char *end = p + list.len;
+    int suffix_len = strlen(suffix);
+    while (p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+        {
+            p++;
+        }
+        if (p == end)
+        {
+            break;
+        }
+        if (*p == '*')
+        {
+            return true;
+        }
+
+        bool is_weak = false;
+        if (end - p >= 2 && p[0] == 'W' && p[1] == '/')
+        {
+            is_weak = true;
+            p += 2;
+        }
+        if (p == end || *p != '"')
+        {
+            return false;
+        }
+        const char *tag = ++p;
+        while (p < end && *p != '"')
+        {
+            p++;
+        }
+        if (p == end)
+        {
+            return false;
+        }
+        int len = p - tag;
+        p++;
+
+        if ((weak || !is_weak) && len == etag_len + suffix_len && memcmp(tag, etag, etag_len) == 0 &&
+            memcmp(tag + etag_len, suffix, suffix_len) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,31 @@
+#ifndef CACHE_POLICY_H
+#define CACHE_POLICY_H
+
+#include "http_header.h"
+
+/*
+    静态资源的缓存策略，按请求路径的前缀或者文件的后缀匹配。
+    Cache-Control 响应头在编译时就拼好了，请求时只需要查表和拷贝；
+    Expires 随时间变化，每个线程为每个策略缓存一份，跨过一秒才重新格式化。
+*/
+struct CachePolicy
+{
+    const char *prefix;        // 请求路径的前缀，例如 "/images/"，为nullptr时按后缀匹配
+    const char *ext;           // 文件的后缀，例如 ".css"
+    const char *cache_control; // 生成好的 "Cache-Control: ...\r\n"
+    int cache_control_len;
+    int max_age;               // 单位秒，大于0时还要发送 Expires
+};
+
+// 请求路径(相对网站根目录)的缓存策略，前缀优先于后缀，表中靠前的优先，没有返回nullptr
+const CachePolicy *find_cache_policy(const char *url);
+
+// 策略对应的 "Expires: ...\r\n"，即当前时间加上 max_age，返回的内存属于调用的线程，
+// 策略没有 max_age 时返回nullptr
+const char *expires_header(const CachePolicy *policy, int &len);
+
+// If-None-Match 或者 If-Range 中的实体标签列表是否包含etag，etag不含引号，suffix接在etag之后一起比较，
+// weak为true时忽略 W/ 前缀(弱比较)，为false时带 W/ 的标签不匹配任何文件(强比较)，列表格式错误时返回false
+bool match_etag(HeaderView list, const char *etag, int etag_len, const char *suffix, bool weak);
+
+#endif
@@ -0,0 +1,111 @@
+#include "config.h"
+#include <cstring>
+
+Config::Config()
+{
+    m_port = -1;
+    m_reactor_number = 1; // 默认只有一个reactor，和以前的单epoll循环一致
+    m_thread_number = 8;
+    m_io_backend = 0;
+    m_backlog = 1024;
+    m_idle_timeout = 60;
+    m_request_timeout = 10000;
+    m_max_header_size = 8192;
+    m_send_rate = 0;
+    m_inline = false;
+}
+
+void Config::usage(const char *name)
+{
+    printf("userage: %s port [-r reactor_number] [-t thread_number] [-i epoll|uring] [-b backlog] [-T idle_timeout] [-R request_timeout_ms] [-H max_header_size] [-S send_rate_kb] [-L]\n", name);
+}
+
+bool Config::parse_arg(int argc, char *argv[])
+{
+    int opt;
+    const char *str = "r:t:i:b:T:R:H:S:L";
+    // getopt会把非选项参数(端口)移动到最后
+    while ((opt = getopt(argc, argv, str)) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+            {
+                m_reactor_number = atoi(optarg);
+                break;
+            }
+            case 't':
+            {
+                m_thread_number = atoi(optarg);
+                break;
+            }
+            case 'b':
+            {
+                m_backlog = atoi(optarg);
+                break;
+            }
+            case 'T':
+            {
+                m_idle_timeout = atoi(optarg);
+                break;
+            }
+            case 'R':
+            {
+                m_request_timeout = atoi(optarg);
+                break;
+            }
+            case 'H':
+            {
+                m_max_header_size = atoi(optarg);
+                break;
+            }
+            case 'S':
+            {
+                m_send_rate = atoi(optarg);
+                break;
+            }
+            case 'L':
+            {
+                m_inline = true;
+                break;
+            }
+            case 'i':
+            {
+                if (strcmp(optarg, "epoll") == 0)
+                {
+                    m_io_backend = 0;
+                }
+                else if (strcmp(optarg, "uring") == 0)
+                {
+                    m_io_backend = 1;
+                }
+                else
+                {
+                    return false;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    // 剩下的参数就是端口
+    if (optind >= argc)
+    {
+        return false;
+    }
+    m_port = atoi(argv[optind]);
+
+    if (m_port <= 0 || m_reactor_number <= 0 || m_thread_number <= 0 || m_backlog <= 0 ||
+        m_idle_timeout <= 0 || m_request_timeout <= 0 || m_send_rate < 0 || m_send_rate > 2097151)
+    {
+        return false;
+    }
+    // 读缓存区最大是请求头上限的两倍，要能从缓存池中申请到
+    if (m_max_header_size < 1024 || m_max_header_size > 32768)
+    {
+        return false;
+    }
+    return true;
+}
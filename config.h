@@ -0,0 +1,34 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <unistd.h>
+#include <cstdlib>
+#include <cstdio>
+
+// 服务器的运行参数，通过命令行解析得到
+class Config
+{
+public:
+    Config();
+    ~Config() {}
+
+    // 解析命令行参数，参数错误时返回false
+    bool parse_arg(int argc, char *argv[]);
+
+    // 打印使用方法
+    static void usage(const char *name);
+
+public:
+    int m_port;           // 监听端口
+    int m_reactor_number; // reactor的数量，每个reactor有自己的epoll和监听socket
+    int m_thread_number;  // 工作线程的数量
+    int m_io_backend;     // I/O后端，0为epoll，1为io_uring
+    int m_backlog;        // 监听socket全连接队列的长度
+    int m_idle_timeout;   // 连接空闲多少秒之后关闭
+    int m_request_timeout; // 收到请求的第一个字节之后，多少毫秒内必须收完整个请求
+    int m_max_header_size; // 请求行和请求头的最大字节数
+    int m_send_rate;      // 每个连接发送的速率上限，单位KB/s，0表示不限制
+    bool m_inline;        // 便宜的请求是否在reactor中直接处理，只对epoll后端有效
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "eventcount.h"
+#include <climits>
+#include "futex.h"
+
+int EventCount::prepare_wait()
+{
+    int key = m_epoch.load(std::memory_order_acquire);
+    m_waiters.fetch_add(1, std::memory_order_relaxed);
+    // 登记先于之后对条件的检查，和 notify 中的屏障配对
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return key;
+}
+
+void EventCount::cancel_wait()
+{
+    m_waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void EventCount::commit_wait(int key)
+{
+    // 序号已经变了说明登记之后有过通知，futex_wait 立即返回
+    futex_wait(&m_epoch, key);
+    m_waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void EventCount::notify_one()
+{
+    // 条件的修改先于对等待者的检查
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiters.load(std::memory_order_relaxed) > 0)
+    {
+        m_epoch.fetch_add(1, std::memory_order_release);
+        futex_wake(&m_epoch, 1);
+    }
+}
+
+void EventCount::notify(int count)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int waiters = m_waiters.load(std::memory_order_relaxed);
+    if (waiters > 0)
+    {
+        m_epoch.fetch_add(1, std::memory_order_release);
+        futex_wake(&m_epoch, count < waiters ? count : waiters);
+    }
+}
+
+void EventCount::notify_all()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiters.load(std::memory_order_relaxed) > 0)
+    {
+        m_epoch.fetch_add(1, std::memory_order_release);
+        futex_wake(&m_epoch, INT_MAX);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef EVENTCOUNT_H
+#define EVENTCOUNT_H
+
+#include <atomic>
+
+/*
+    基于futex的事件计数，用来在无锁队列上睡眠等待
+    等待的一方先 prepare_wait 登记，再检查一次条件，条件满足就 cancel_wait，
+    否则 commit_wait 睡眠；通知的一方先让条件成立(比如放入任务)，再 notify。
+    登记和检查之间、放入和通知之间都有全屏障，通知的一方要么看到登记，
+    要么等待的一方在检查时看到条件成立，所以不会漏掉唤醒。
+    没有线程登记时 notify 只是一次读，不会发起系统调用。
+*/
+class EventCount
+{
+private:
+    std::atomic<int> m_epoch;   // 每次唤醒加一，等待的线程在它上面睡眠
+    std::atomic<int> m_waiters; // 已经登记的等待者数量
+
+public:
+    EventCount() : m_epoch(0), m_waiters(0) {}
+
+    // 登记为等待者，返回当前的序号，之后要再检查一次条件
+    int prepare_wait();
+
+    // 条件已经满足，取消登记
+    void cancel_wait();
+
+    // 条件还不满足，从 prepare_wait 之后没有通知过就睡眠，醒来之后取消登记
+    void commit_wait(int key);
+
+    // 有等待者时唤醒一个
+    void notify_one();
+
+    // 有等待者时最多唤醒count个，只发起一次系统调用
+    void notify(int count);
+
+    // 有等待者时全部唤醒
+    void notify_all();
+};
+
+#endif
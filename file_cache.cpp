@@ -0,0 +1,327 @@
+#include "file_cache.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <cstring>
+#include <cstdio>
+#include <zlib.h>
+
+// FNV-1a 哈希
+static unsigned hash_path(const char *path)
+{
+    unsigned hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// 文件是否和缓存时一样
+static bool same_file(const struct stat &a, const struct stat &b)
+{
+    return a.st_ino == b.st_ino && a.st_dev == b.st_dev && a.st_size == b.st_size &&
+           a.st_mode == b.st_mode && a.st_mtim.tv_sec == b.st_mtim.tv_sec &&
+           a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+FileCache::Shard::Shard()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_lru.lru_prev = &m_lru;
+    m_lru.lru_next = &m_lru;
+    m_count = 0;
+}
+
+FileCache::~FileCache()
+{
+    for (int i = 0; i < SHARD_NUMBER; i++)
+    {
+        Shard &shard = m_shards[i];
+        while (shard.m_lru.lru_next != &shard.m_lru)
+        {
+            FileEntry *entry = shard.m_lru.lru_next;
+            unlink(shard, entry);
+            release(entry);
+        }
+    }
+}
+
+unsigned long long FileCache::coarse_now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+FileEntry *FileCache::load(const char *path, unsigned hash, int &err)
+{
+    if (strlen(path) >= (size_t)FileEntry::PATH_LEN)
+    {
+        err = ENAMETOOLONG;
+        return nullptr;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        err = errno;
+        return nullptr;
+    }
+
+    FileEntry *entry = new FileEntry;
+    if (fstat(fd, &entry->st) == -1)
+    {
+        err = errno;
+        close(fd);
+        delete entry;
+        return nullptr;
+    }
+    strcpy(entry->path, path);
+    entry->hash = hash;
+    entry->fd = fd;
+    entry->ref = 1;
+    entry->checked_ms = coarse_now_ms();
+    entry->gz_missing_ms = 0;
+    unsigned long long mtime_ns = (unsigned long long)entry->st.st_mtim.tv_sec * 1000000000ULL + entry->st.st_mtim.tv_nsec;
+    entry->etag_len = snprintf(entry->etag, sizeof(entry->etag), "%llx-%llx-%llx", (unsigned long long)entry->st.st_ino,
+                               (unsigned long long)entry->st.st_size, mtime_ns);
+    format_http_date(entry->st.st_mtime, entry->last_modified);
+    for (int i = 0; i < 4; i++)
+    {
+        entry->response[i] = nullptr;
+        entry->response_len[i] = 0;
+    }
+    entry->gzip = nullptr;
+    entry->gzip_len = 0;
+    entry->hash_next = nullptr;
+    entry->lru_prev = nullptr;
+    entry->lru_next = nullptr;
+    return entry;
+}
+
+FileEntry *FileCache::find(Shard &shard, const char *path, unsigned hash)
+{
+    FileEntry *entry = shard.m_buckets[hash % BUCKET_NUMBER];
+    while (entry && (entry->hash != hash || strcmp(entry->path, path) != 0))
+    {
+        entry = entry->hash_next;
+    }
+    return entry;
+}
+
+void FileCache::unlink(Shard &shard, FileEntry *entry)
+{
+    FileEntry **pp = &shard.m_buckets[entry->hash % BUCKET_NUMBER];
+    while (*pp != entry)
+    {
+        pp = &(*pp)->hash_next;
+    }
+    *pp = entry->hash_next;
+
+    entry->lru_prev->lru_next = entry->lru_next;
+    entry->lru_next->lru_prev = entry->lru_prev;
+    entry->lru_prev = nullptr;
+    entry->lru_next = nullptr;
+    shard.m_count--;
+}
+
+void FileCache::touch(Shard &shard, FileEntry *entry)
+{
+    if (shard.m_lru.lru_next == entry)
+    {
+        return;
+    }
+    entry->lru_prev->lru_next = entry->lru_next;
+    entry->lru_next->lru_prev = entry->lru_prev;
+
+    entry->lru_next = shard.m_lru.lru_next;
+    entry->lru_prev = &shard.m_lru;
+    shard.m_lru.lru_next->lru_prev = entry;
+    shard.m_lru.lru_next = entry;
+}
+
+void FileCache::release(FileEntry *entry)
+{
+    if (entry && --entry->ref == 0)
+    {
+        close(entry->fd);
+        for (int i = 0; i < 4; i++)
+        {
+            delete[] entry->response[i].load();
+        }
+        delete[] entry->gzip.load();
+        delete entry;
+    }
+}
+
+bool FileCache::gzip_missing(FileEntry *entry)
+{
+    unsigned long long missing = entry->gz_missing_ms.load(std::memory_order_relaxed);
+    return missing && coarse_now_ms() - missing < (unsigned long long)REVALIDATE_MS;
+}
+
+const char *FileCache::get_gzip(FileEntry *entry, int &len)
+{
+    char *gzip = entry->gzip.load(std::memory_order_acquire);
+    if (gzip)
+    {
+        len = entry->gzip_len.load(std::memory_order_relaxed);
+        return gzip;
+    }
+    if (entry->gzip_len.load(std::memory_order_relaxed) < 0)
+    {
+        return nullptr;
+    }
+
+    int size = entry->st.st_size;
+    char *data = new char[size];
+    if (pread(entry->fd, data, size, 0) != size)
+    {
+        delete[] data;
+        return nullptr;
+    }
+
+    // windowBits 加16生成gzip格式而不是zlib格式
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        delete[] data;
+        return nullptr;
+    }
+    uLong bound = deflateBound(&stream, size);
+    gzip = new char[bound];
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = size;
+    stream.next_out = (Bytef *)gzip;
+    stream.avail_out = bound;
+    int ret = deflate(&stream, Z_FINISH);
+    int gzip_size = bound - stream.avail_out;
+    deflateEnd(&stream);
+    delete[] data;
+
+    if (ret != Z_STREAM_END || gzip_size >= size)
+    {
+        // 压缩之后没有变小，不值得发送压缩的版本
+        delete[] gzip;
+        entry->gzip_len.store(-1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    // 多个线程可能同时压缩同一个文件，只保留先放进去的那个
+    char *expected = nullptr;
+    entry->gzip_len.store(gzip_size, std::memory_order_relaxed);
+    if (!entry->gzip.compare_exchange_strong(expected, gzip, std::memory_order_release))
+    {
+        delete[] gzip;
+        gzip = expected;
+    }
+    len = gzip_size;
+    return gzip;
+}
+
+FileEntry *FileCache::acquire(const char *path, int &err, bool cached_only)
+{
+    unsigned hash = hash_path(path);
+    Shard &shard = m_shards[hash % SHARD_NUMBER];
+    unsigned long long now = coarse_now_ms();
+
+    // 先在缓存中查找
+    shard.m_mutex.lock();
+    FileEntry *entry = find(shard, path, hash);
+    if (entry)
+    {
+        entry->ref++;
+        touch(shard, entry);
+    }
+    shard.m_mutex.unlock();
+
+    if (entry)
+    {
+        if (now - entry->checked_ms < (unsigned long long)REVALIDATE_MS)
+        {
+            return entry;
+        }
+        if (cached_only)
+        {
+            release(entry);
+            err = EWOULDBLOCK;
+            return nullptr;
+        }
+
+        // 太久没有检查了，确认文件有没有变化，stat不持有锁
+        struct stat st;
+        if (stat(path, &st) == 0 && same_file(st, entry->st))
+        {
+            entry->checked_ms = now;
+            return entry;
+        }
+
+        // 文件变了，从缓存中移除，正在使用旧文件的连接不受影响
+        bool cached = false;
+        shard.m_mutex.lock();
+        if (find(shard, path, hash) == entry)
+        {
+            unlink(shard, entry);
+            cached = true;
+        }
+        shard.m_mutex.unlock();
+        if (cached)
+        {
+            release(entry);
+        }
+        release(entry);
+    }
+
+    // 没有缓存，打开文件
+    if (cached_only)
+    {
+        err = EWOULDBLOCK;
+        return nullptr;
+    }
+    entry = load(path, hash, err);
+    if (!entry)
+    {
+        return nullptr;
+    }
+
+    FileEntry *evicted = nullptr;
+    shard.m_mutex.lock();
+    FileEntry *exist = find(shard, path, hash);
+    if (exist)
+    {
+        // 别的线程同时打开了同一个文件，使用先放进缓存的那个
+        exist->ref++;
+        touch(shard, exist);
+    }
+    else
+    {
+        entry->ref++; // 缓存持有的引用
+        entry->hash_next = shard.m_buckets[hash % BUCKET_NUMBER];
+        shard.m_buckets[hash % BUCKET_NUMBER] = entry;
+        entry->lru_next = shard.m_lru.lru_next;
+        entry->lru_prev = &shard.m_lru;
+        shard.m_lru.lru_next->lru_prev = entry;
+        shard.m_lru.lru_next = entry;
+        shard.m_count++;
+
+        // 超过容量，淘汰最久没有使用的
+        if (shard.m_count > SHARD_CAPACITY)
+        {
+            evicted = shard.m_lru.lru_prev;
+            unlink(shard, evicted);
+        }
+    }
+    shard.m_mutex.unlock();
+
+    if (exist)
+    {
+        release(entry);
+        return exist;
+    }
+    release(evicted);
+    return entry;
+}
@@ -0,0 +1,112 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <atomic>
+#include "locker.h"
+#include "http_date.h"
+
+// 缓存中的一个文件，打开的文件描述符和stat的结果，通过引用计数共享
+struct FileEntry
+{
+    static const int PATH_LEN = 200;          // 文件路径的最大长度
+    static const int SMALL_FILE_SIZE = 16384; // 不超过这个大小的文件缓存完整的响应
+
+    char path[PATH_LEN];           // 文件的真实路径
+    unsigned hash;                 // 路径的哈希值
+    int fd;                        // 只读打开的文件描述符，sendfile时使用，不会改变文件的读写位置
+    struct stat st;                // 打开时的文件状态
+    std::atomic<int> ref;          // 引用计数，缓存本身也持有一个
+    std::atomic<unsigned long long> checked_ms; // 上一次确认文件没有变化的时间
+    std::atomic<unsigned long long> gz_missing_ms; // 上一次确认没有对应的.gz文件的时间，0表示没有确认过
+
+    // 条件请求用的验证器，打开时由stat的结果生成，文件变化时和缓存项一起失效
+    char etag[56];                     // ETag的值，不含引号，inode-大小-修改时间(纳秒)的十六进制
+    int etag_len;
+    char last_modified[HTTP_DATE_LEN]; // Last-Modified的值
+
+    // 小文件预先生成的完整响应(响应头和文件内容连续存放)，下标为 是否gzip压缩*2 + 是否保持连接。
+    // 生成之后不再修改，文件变化时整个缓存项失效，和缓存项一起释放
+    std::atomic<char *> response[4];
+    std::atomic<int> response_len[4];
+
+    // 没有.gz文件的小文件在内存中压缩的结果，gzip_len 为0表示还没有压缩，-1表示压缩之后没有变小
+    std::atomic<char *> gzip;
+    std::atomic<int> gzip_len;
+
+    FileEntry *hash_next; // 哈希桶中的下一个
+    FileEntry *lru_prev;  // LRU链表中的前一个，越靠前越是最近使用的
+    FileEntry *lru_next;
+};
+
+/*
+    打开的文件和它的stat结果的缓存，按路径索引
+    分成 SHARD_NUMBER 个分片，每个分片一把锁，有自己的哈希表和LRU链表，
+    超过容量时淘汰分片中最久没有使用的文件。
+    取出的文件在 REVALIDATE_MS 之内直接使用，不需要任何文件系统的系统调用，
+    超过这个时间再stat一次，文件被修改或者删除了就重新打开。
+    被淘汰或者失效的文件，要等所有正在发送它的连接都释放之后才会关闭。
+*/
+class FileCache
+{
+public:
+    static const int SHARD_NUMBER = 16;      // 分片的数量
+    static const int BUCKET_NUMBER = 64;     // 每个分片哈希桶的数量
+    static const int SHARD_CAPACITY = 64;    // 每个分片最多缓存的文件数
+    static const int REVALIDATE_MS = 1000;   // 多久重新检查一次文件有没有变化
+
+    // C++11之后静态局部变量不用担心线程安全问题
+    static FileCache *get_instance()
+    {
+        static FileCache instance;
+        return &instance;
+    }
+
+    // 取得路径对应的文件，引用计数加一，失败返回nullptr，err为失败时的errno。
+    // cached_only为true时不做任何文件系统的系统调用，不在缓存中或者需要重新检查时err为EWOULDBLOCK
+    FileEntry *acquire(const char *path, int &err, bool cached_only = false);
+
+    // 用完文件之后释放，引用计数为0时关闭文件
+    static void release(FileEntry *entry);
+
+    // 小文件gzip压缩之后的内容，第一次调用时用zlib压缩，压缩之后没有变小返回nullptr
+    static const char *get_gzip(FileEntry *entry, int &len);
+
+    // REVALIDATE_MS 之内确认过文件没有对应的.gz文件
+    static bool gzip_missing(FileEntry *entry);
+    static void set_gzip_missing(FileEntry *entry) { entry->gz_missing_ms = coarse_now_ms(); }
+
+private:
+    FileCache() {}
+    ~FileCache();
+
+    struct Shard
+    {
+        Shard();
+
+        Locker m_mutex;
+        FileEntry *m_buckets[BUCKET_NUMBER];
+        FileEntry m_lru; // LRU链表的头结点
+        int m_count;
+    };
+
+    // 打开文件，生成新的缓存项，引用计数为1
+    static FileEntry *load(const char *path, unsigned hash, int &err);
+
+    // 在分片中查找，需要持有分片的锁
+    static FileEntry *find(Shard &shard, const char *path, unsigned hash);
+
+    // 从分片中移除，需要持有分片的锁，返回缓存持有的引用，由调用者在锁外释放
+    static void unlink(Shard &shard, FileEntry *entry);
+
+    // 放到LRU链表的最前面
+    static void touch(Shard &shard, FileEntry *entry);
+
+    // 不产生系统调用的粗粒度单调时钟，单位毫秒
+    static unsigned long long coarse_now_ms();
+
+private:
+    Shard m_shards[SHARD_NUMBER];
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <atomic>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// futex 直接作用在 std::atomic<int> 上，它和 int 的布局相同，只在本进程内使用
+
+// 值还等于expected时睡眠，直到被唤醒，值已经变了立即返回
+inline void futex_wait(std::atomic<int> *addr, int expected)
+{
+    syscall(SYS_futex, (int *)addr, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+// 唤醒最多count个在addr上睡眠的线程
+inline void futex_wake(std::atomic<int> *addr, int count)
+{
+    syscall(SYS_futex, (int *)addr, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+#endif
@@ -0,0 +1,558 @@
+#include "hpack.h"
+#include <cstring>
+
+// RFC 7541 附录A的静态表
+static const struct
+{
+    const char *name;
+    int name_len;
+    const char *value;
+    int value_len;
+} static_table[HpackTable::STATIC_NUMBER] = {
+    {":authority", 10, "", 0},
+    {":method", 7, "GET", 3},
+    {":method", 7, "POST", 4},
+    {":path", 5, "/", 1},
+    {":path", 5, "/index.html", 11},
+    {":scheme", 7, "http", 4},
+    {":scheme", 7, "https", 5},
+    {":status", 7, "200", 3},
+    {":status", 7, "204", 3},
+    {":status", 7, "206", 3},
+    {":status", 7, "304", 3},
+    {":status", 7, "400", 3},
+    {":status", 7, "404", 3},
+    {":status", 7, "500", 3},
+    {"accept-charset", 14, "", 0},
+    {"accept-encoding", 15, "gzip, deflate", 13},
+    {"accept-language", 15, "", 0},
+    {"accept-ranges", 13, "", 0},
+    {"accept", 6, "", 0},
+    {"access-control-allow-origin", 27, "", 0},
+    {"age", 3, "", 0},
+    {"allow", 5, "", 0},
+    {"authorization", 13, "", 0},
+    {"cache-control", 13, "", 0},
+    {"content-disposition", 19, "", 0},
+    {"content-encoding", 16, "", 0},
+    {"content-language", 16, "", 0},
+    {"content-length", 14, "", 0},
+    {"content-location", 16, "", 0},
+    {"content-range", 13, "", 0},
+    {"content-type", 12, "", 0},
+    {"cookie", 6, "", 0},
+    {"date", 4, "", 0},
+    {"etag", 4, "", 0},
+    {"expect", 6, "", 0},
+    {"expires", 7, "", 0},
+    {"from", 4, "", 0},
+    {"host", 4, "", 0},
+    {"if-match", 8, "", 0},
+    {"if-modified-since", 17, "", 0},
+    {"if-none-match", 13, "", 0},
+    {"if-range", 8, "", 0},
+    {"if-unmodified-since", 19, "", 0},
+    {"last-modified", 13, "", 0},
+    {"link", 4, "", 0},
+    {"location", 8, "", 0},
+    {"max-forwards", 12, "", 0},
+    {"proxy-authenticate", 18, "", 0},
+    {"proxy-authorization", 19, "", 0},
+    {"range", 5, "", 0},
+    {"referer", 7, "", 0},
+    {"refresh", 7, "", 0},
+    {"retry-after", 11, "", 0},
+    {"server", 6, "", 0},
+    {"set-cookie", 10, "", 0},
+    {"strict-transport-security", 25, "", 0},
+    {"transfer-encoding", 17, "", 0},
+    {"user-agent", 10, "", 0},
+    {"vary", 4, "", 0},
+    {"via", 3, "", 0},
+    {"www-authenticate", 16, "", 0},
+};
+
+// RFC 7541 附录B的Huffman编码，按符号排列，EOS(256)单独处理
+static const uint32_t huffman_codes[256] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+static const uint8_t huffman_code_len[256] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
+static const uint32_t huffman_eos_code = 0x3fffffff;
+static const int huffman_eos_len = 30;
+
+/*
+    Huffman解码用的二叉树，每个内部节点有两个孩子，
+    大于0是内部节点的下标，小于0是叶子，-(符号+1)，0表示没有这个编码
+*/
+struct HuffmanTree
+{
+    static const int MAX_NODES = 512;
+    int16_t nodes[MAX_NODES][2];
+    int count;
+
+    HuffmanTree()
+    {
+        memset(nodes, 0, sizeof(nodes));
+        count = 1;
+        for (int sym = 0; sym < 256; sym++)
+        {
+            insert(huffman_codes[sym], huffman_code_len[sym], sym);
+        }
+        insert(huffman_eos_code, huffman_eos_len, 256);
+    }
+
+    void insert(uint32_t code, int len, int sym)
+    {
+        int node = 0;
+        for (int i = len - 1; i > 0; i--)
+        {
+            int bit = (code >> i) & 1;
+            if (nodes[node][bit] == 0)
+            {
+                nodes[node][bit] = count++;
+            }
+            node = nodes[node][bit];
+        }
+        nodes[node][code & 1] = -(sym + 1);
+    }
+};
+
+// 静态初始化时建好
+static const HuffmanTree huffman_tree;
+
+// Huffman解码，结果放到out中，超过cap或者编码错误返回-1
+static int huffman_decode(const uint8_t *data, int len, char *out, int cap)
+{
+    int n = 0;
+    int node = 0;
+    int depth = 0;    // 当前符号已经读了几位
+    bool ones = true; // 当前符号读到的位是不是全为1
+    for (int i = 0; i < len; i++)
+    {
+        for (int shift = 7; shift >= 0; shift--)
+        {
+            int bit = (data[i] >> shift) & 1;
+            int next = huffman_tree.nodes[node][bit];
+            if (next < 0)
+            {
+                int sym = -next - 1;
+                // 字符串中不能出现EOS
+                if (sym == 256 || n == cap)
+                {
+                    return -1;
+                }
+                out[n++] = (char)sym;
+                node = 0;
+                depth = 0;
+                ones = true;
+            }
+            else if (next == 0)
+            {
+                return -1;
+            }
+            else
+            {
+                node = next;
+                depth++;
+                ones = ones && bit;
+            }
+        }
+    }
+    // 最后不满一个符号的部分是填充，必须是EOS的前缀(全1)并且少于8位
+    if (depth > 7 || !ones)
+    {
+        return -1;
+    }
+    return n;
+}
+
+// 读一个前缀为prefix_len位的整数
+static bool read_integer(const uint8_t *&p, const uint8_t *end, int prefix_len, unsigned &value)
+{
+    if (p == end)
+    {
+        return false;
+    }
+    unsigned max = (1u << prefix_len) - 1;
+    value = *p++ & max;
+    if (value < max)
+    {
+        return true;
+    }
+    // 后面每个字节7位，最高位为1表示还有，不接受超过28位的数
+    for (int shift = 0; shift <= 21; shift += 7)
+    {
+        if (p == end)
+        {
+            return false;
+        }
+        uint8_t b = *p++;
+        value += (unsigned)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+HpackTable::HpackTable() : m_head(0), m_count(0), m_size(0), m_max_size(DEFAULT_SIZE)
+{
+}
+
+HpackTable::~HpackTable()
+{
+    while (m_count > 0)
+    {
+        evict();
+    }
+}
+
+bool HpackTable::get(int index, const char *&name, int &name_len, const char *&value, int &value_len) const
+{
+    if (index <= 0)
+    {
+        return false;
+    }
+    if (index <= STATIC_NUMBER)
+    {
+        name = static_table[index - 1].name;
+        name_len = static_table[index - 1].name_len;
+        value = static_table[index - 1].value;
+        value_len = static_table[index - 1].value_len;
+        return true;
+    }
+    index -= STATIC_NUMBER + 1;
+    if (index >= m_count)
+    {
+        return false;
+    }
+    const Entry &entry = m_entries[(m_head + index) % MAX_ENTRIES];
+    name = entry.data;
+    name_len = entry.name_len;
+    value = entry.data + entry.name_len;
+    value_len = entry.value_len;
+    return true;
+}
+
+int HpackTable::find(const char *name, int name_len, const char *value, int value_len) const
+{
+    for (int i = 0; i < m_count; i++)
+    {
+        const Entry &entry = m_entries[(m_head + i) % MAX_ENTRIES];
+        if (entry.name_len == name_len && entry.value_len == value_len &&
+            memcmp(entry.data, name, name_len) == 0 && memcmp(entry.data + name_len, value, value_len) == 0)
+        {
+            return STATIC_NUMBER + 1 + i;
+        }
+    }
+    return 0;
+}
+
+void HpackTable::add(const char *name, int name_len, const char *value, int value_len)
+{
+    int size = name_len + value_len + ENTRY_OVERHEAD;
+    if (size > m_max_size)
+    {
+        // 比整个表还大，结果是清空动态表
+        while (m_count > 0)
+        {
+            evict();
+        }
+        return;
+    }
+
+    // 名字可能就在要淘汰的条目中，先拷贝再淘汰
+    char *data = new char[name_len + value_len];
+    memcpy(data, name, name_len);
+    memcpy(data + name_len, value, value_len);
+    while (m_size + size > m_max_size)
+    {
+        evict();
+    }
+
+    m_head = (m_head + MAX_ENTRIES - 1) % MAX_ENTRIES;
+    m_entries[m_head].data = data;
+    m_entries[m_head].name_len = name_len;
+    m_entries[m_head].value_len = value_len;
+    m_count++;
+    m_size += size;
+}
+
+void HpackTable::set_max_size(int size)
+{
+    m_max_size = size;
+    while (m_size > m_max_size)
+    {
+        evict();
+    }
+}
+
+void HpackTable::evict()
+{
+    Entry &entry = m_entries[(m_head + m_count - 1) % MAX_ENTRIES];
+    m_size -= entry.name_len + entry.value_len + ENTRY_OVERHEAD;
+    delete[] entry.data;
+    entry.data = nullptr;
+    m_count--;
+}
+
+bool HpackDecoder::read_string(const uint8_t *&p, const uint8_t *end, int &pos, const char *&str, int &len)
+{
+    if (p == end)
+    {
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    unsigned length;
+    if (!read_integer(p, end, 7, length) || length > (unsigned)(end - p))
+    {
+        return false;
+    }
+
+    if (!huffman)
+    {
+        // 没有编码的字符串直接指向头部块
+        str = (const char *)p;
+        len = length;
+    }
+    else
+    {
+        int n = huffman_decode(p, length, m_buf + pos, MAX_STRING - pos);
+        if (n < 0)
+        {
+            return false;
+        }
+        str = m_buf + pos;
+        len = n;
+        pos += n;
+    }
+    p += length;
+    return true;
+}
+
+bool HpackDecoder::decode(const uint8_t *data, int len, HeaderCallback callback, void *arg)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
+    while (p < end)
+    {
+        uint8_t b = *p;
+        const char *name, *value;
+        int name_len, value_len;
+        unsigned index;
+        int pos = 0;
+
+        if (b & 0x80)
+        {
+            // 1xxxxxxx 索引的头部
+            if (!read_integer(p, end, 7, index) || !m_table.get(index, name, name_len, value, value_len))
+            {
+                return false;
+            }
+            if (!callback(arg, name, name_len, value, value_len))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if ((b & 0xe0) == 0x20)
+        {
+            // 001xxxxx 动态表大小更新，不能超过我们在SETTINGS中声明的大小
+            if (!read_integer(p, end, 5, index) || index > (unsigned)HpackTable::DEFAULT_SIZE)
+            {
+                return false;
+            }
+            m_table.set_max_size(index);
+            continue;
+        }
+
+        // 01xxxxxx 加入动态表，0000xxxx 不加入，0001xxxx 永不加入，名字的下标为0时名字是字符串
+        bool add = (b & 0xc0) == 0x40;
+        if (!read_integer(p, end, add ? 6 : 4, index))
+        {
+            return false;
+        }
+        if (index == 0)
+        {
+            if (!read_string(p, end, pos, name, name_len))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            const char *unused;
+            int unused_len;
+            if (!m_table.get(index, name, name_len, unused, unused_len))
+            {
+                return false;
+            }
+        }
+        if (!read_string(p, end, pos, value, value_len))
+        {
+            return false;
+        }
+
+        if (!callback(arg, name, name_len, value, value_len))
+        {
+            return false;
+        }
+        if (add)
+        {
+            m_table.add(name, name_len, value, value_len);
+        }
+    }
+    return true;
+}
+
+void HpackEncoder::set_max_size(int size)
+{
+    if (size > HpackTable::DEFAULT_SIZE)
+    {
+        size = HpackTable::DEFAULT_SIZE;
+    }
+    if (size != m_table.max_size())
+    {
+        m_table.set_max_size(size);
+        m_size_update = true;
+    }
+}
+
+void HpackEncoder::begin(uint8_t *buf, int cap)
+{
+    m_buf = buf;
+    m_pos = 0;
+    m_cap = cap;
+    if (m_size_update)
+    {
+        put_integer(0x20, 5, m_table.max_size());
+        m_size_update = false;
+    }
+}
+
+void HpackEncoder::indexed(int index)
+{
+    put_integer(0x80, 7, index);
+}
+
+void HpackEncoder::field(int name_index, const char *value, int len, bool index)
+{
+    if (!index)
+    {
+        // 0000xxxx 不加入动态表
+        put_integer(0x00, 4, name_index);
+        put_integer(0x00, 7, len);
+        put_bytes(value, len);
+        return;
+    }
+
+    const char *name, *unused;
+    int name_len, unused_len;
+    m_table.get(name_index, name, name_len, unused, unused_len);
+    int found = m_table.find(name, name_len, value, len);
+    if (found)
+    {
+        indexed(found);
+        return;
+    }
+
+    // 01xxxxxx 加入动态表，对端解码时也会加入
+    put_integer(0x40, 6, name_index);
+    put_integer(0x00, 7, len);
+    put_bytes(value, len);
+    m_table.add(name, name_len, value, len);
+}
+
+void HpackEncoder::put_integer(uint8_t prefix_bits, int prefix_len, unsigned value)
+{
+    unsigned max = (1u << prefix_len) - 1;
+    if (value < max)
+    {
+        if (m_pos < m_cap)
+        {
+            m_buf[m_pos] = prefix_bits | value;
+        }
+        m_pos++;
+        return;
+    }
+
+    if (m_pos < m_cap)
+    {
+        m_buf[m_pos] = prefix_bits | max;
+    }
+    m_pos++;
+    value -= max;
+    while (value >= 0x80)
+    {
+        if (m_pos < m_cap)
+        {
+            m_buf[m_pos] = (value & 0x7f) | 0x80;
+        }
+        m_pos++;
+        value >>= 7;
+    }
+    if (m_pos < m_cap)
+    {
+        m_buf[m_pos] = value;
+    }
+    m_pos++;
+}
+
+void HpackEncoder::put_bytes(const char *data, int len)
+{
+    if (m_pos + len <= m_cap)
+    {
+        memcpy(m_buf + m_pos, data, len);
+    }
+    m_pos += len;
+}
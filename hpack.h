@@ -0,0 +1,107 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stdint.h>
+
+/*
+    HPACK(RFC 7541) 的索引表，下标从1开始，1到61是静态表，之后是动态表，
+    动态表中越新的条目下标越小。解码和编码各用一个，内容要和对端的保持一致
+*/
+class HpackTable
+{
+public:
+    static const int DEFAULT_SIZE = 4096;  // SETTINGS_HEADER_TABLE_SIZE 的默认值，也是这里支持的最大值
+    static const int STATIC_NUMBER = 61;   // 静态表的条目数
+    static const int ENTRY_OVERHEAD = 32;  // 每个条目除了名字和值之外计入的大小
+    static const int MAX_ENTRIES = DEFAULT_SIZE / ENTRY_OVERHEAD;
+
+    HpackTable();
+    ~HpackTable();
+
+    // 按下标取出名字和值，下标不存在返回false
+    bool get(int index, const char *&name, int &name_len, const char *&value, int &value_len) const;
+    // 动态表中名字和值都相同的条目的下标，没有返回0
+    int find(const char *name, int name_len, const char *value, int value_len) const;
+    // 加入动态表，放不下时淘汰最旧的条目，比整个表还大时清空动态表
+    void add(const char *name, int name_len, const char *value, int value_len);
+    // 修改动态表的大小上限，不能超过 DEFAULT_SIZE
+    void set_max_size(int size);
+    int max_size() const { return m_max_size; }
+
+private:
+    struct Entry
+    {
+        char *data; // 名字和值连续存放
+        int name_len;
+        int value_len;
+    };
+
+    // 淘汰最旧的条目
+    void evict();
+
+private:
+    Entry m_entries[MAX_ENTRIES]; // 环形数组，m_head 是最新的条目
+    int m_head;
+    int m_count;
+    int m_size;     // 按 RFC 7541 计算的大小
+    int m_max_size;
+};
+
+// 解码出的一个头部，返回false停止解码
+typedef bool (*HeaderCallback)(void *arg, const char *name, int name_len, const char *value, int value_len);
+
+/*
+    头部块的解码器，每个HTTP/2连接一个，头部块要按收到的顺序解码，
+    否则动态表会和对端的不一致
+*/
+class HpackDecoder
+{
+public:
+    static const int MAX_STRING = 8192; // 一个头部的名字和值加起来的最大长度
+
+    // 解码一个完整的头部块，每个头部调用一次 callback，格式错误返回false，这时连接不能再用了
+    bool decode(const uint8_t *data, int len, HeaderCallback callback, void *arg);
+
+private:
+    // 读一个字符串，Huffman编码的解码到 m_buf 中从 pos 开始的地方
+    bool read_string(const uint8_t *&p, const uint8_t *end, int &pos, const char *&str, int &len);
+
+private:
+    HpackTable m_table;
+    char m_buf[MAX_STRING];
+};
+
+/*
+    响应头的编码器，不用Huffman编码，值不变的响应头加入动态表，
+    之后的响应中同样的头部只需要一个字节
+*/
+class HpackEncoder
+{
+public:
+    HpackEncoder() : m_buf(nullptr), m_pos(0), m_cap(0), m_size_update(false) {}
+
+    // 对端的 SETTINGS_HEADER_TABLE_SIZE，和 DEFAULT_SIZE 取小的，下一个头部块开头通知对端
+    void set_max_size(int size);
+
+    // 开始在buf中编码一个头部块
+    void begin(uint8_t *buf, int cap);
+    // 名字和值都在静态表中的头部，例如 :status: 200
+    void indexed(int index);
+    // 名字在静态表中的头部，index为true时加入动态表
+    void field(int name_index, const char *value, int len, bool index);
+    // 头部块的长度，空间不够返回-1
+    int end() const { return m_pos > m_cap ? -1 : m_pos; }
+
+private:
+    void put_integer(uint8_t prefix_bits, int prefix_len, unsigned value);
+    void put_bytes(const char *data, int len);
+
+private:
+    HpackTable m_table;
+    uint8_t *m_buf;
+    int m_pos;
+    int m_cap;
+    bool m_size_update; // 动态表的大小变了，还没有通知对端
+};
+
+#endif
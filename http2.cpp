@@ -0,0 +1,1053 @@
+#include "http2.h"
+#include "http_date.h"
+
+// 客户端的连接前言
+static const char client_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// 帧的标志
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+
+// SETTINGS 中的参数
+static const uint16_t SETTINGS_HEADER_TABLE_SIZE = 1;
+static const uint16_t SETTINGS_ENABLE_PUSH = 2;
+static const uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 3;
+static const uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 4;
+static const uint16_t SETTINGS_MAX_FRAME_SIZE = 5;
+static const uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 6;
+
+static const int64_t MAX_WINDOW = 0x7fffffff;
+
+// HPACK静态表中响应用到的名字的下标
+static const int HPACK_STATUS = 8;
+static const int HPACK_ACCEPT_RANGES = 18;
+static const int HPACK_CACHE_CONTROL = 24;
+static const int HPACK_CONTENT_ENCODING = 26;
+static const int HPACK_CONTENT_LENGTH = 28;
+static const int HPACK_CONTENT_RANGE = 30;
+static const int HPACK_CONTENT_TYPE = 31;
+static const int HPACK_DATE = 33;
+static const int HPACK_ETAG = 34;
+static const int HPACK_EXPIRES = 36;
+static const int HPACK_LAST_MODIFIED = 44;
+static const int HPACK_SERVER = 54;
+static const int HPACK_VARY = 59;
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void write32(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+// HTTP2-Settings 的值是没有填充的 base64url，返回解码之后的长度，格式不对返回-1
+static int base64url_decode(const char *in, int len, uint8_t *out, int cap)
+{
+    unsigned bits = 0;
+    int bit_count = 0;
+    int n = 0;
+    for (int i = 0; i < len; i++)
+    {
+        char c = in[i];
+        int v;
+        if (c >= 'A' && c <= 'Z')
+        {
+            v = c - 'A';
+        }
+        else if (c >= 'a' && c <= 'z')
+        {
+            v = c - 'a' + 26;
+        }
+        else if (c >= '0' && c <= '9')
+        {
+            v = c - '0' + 52;
+        }
+        else if (c == '-' || c == '+')
+        {
+            v = 62;
+        }
+        else if (c == '_' || c == '/')
+        {
+            v = 63;
+        }
+        else if (c == '=')
+        {
+            break;
+        }
+        else
+        {
+            return -1;
+        }
+
+        bits = (bits << 6) | v;
+        bit_count += 6;
+        if (bit_count >= 8)
+        {
+            bit_count -= 8;
+            if (n == cap)
+            {
+                return -1;
+            }
+            out[n++] = (bits >> bit_count) & 0xff;
+        }
+    }
+    return n;
+}
+
+Http2Session::Http2Session(Http_Connect *conn)
+    : m_conn(conn), m_preface(false), m_closing(false), m_goaway(false), m_last_stream(0),
+      m_send_window(INITIAL_WINDOW), m_peer_window(INITIAL_WINDOW), m_peer_max_frame(MAX_FRAME_SIZE),
+      m_recv_unacked(0), m_next(0), m_header_stream(0), m_header_new(false), m_header_end(false), m_block_len(0),
+      m_method(nullptr), m_path(nullptr), m_authority(nullptr), m_bad_request(false), m_scratch_len(0)
+{
+    memset(m_streams, 0, sizeof(m_streams));
+}
+
+Http2Session::~Http2Session()
+{
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        if (m_streams[i].id)
+        {
+            close_stream(m_streams[i]);
+        }
+    }
+}
+
+int Http2Session::check_preface(const char *data, int len)
+{
+    int n = len < PREFACE_LEN ? len : PREFACE_LEN;
+    if (memcmp(data, client_preface, n) != 0)
+    {
+        return 0;
+    }
+    return n == PREFACE_LEN ? 1 : -1;
+}
+
+void Http2Session::start()
+{
+    // 服务端的连接前言就是一个SETTINGS帧，没有列出的参数用默认值
+    uint8_t payload[12];
+    payload[0] = 0;
+    payload[1] = SETTINGS_MAX_CONCURRENT_STREAMS;
+    write32(payload + 2, MAX_STREAMS);
+    payload[6] = 0;
+    payload[7] = SETTINGS_MAX_HEADER_LIST_SIZE;
+    write32(payload + 8, MAX_REQUEST_HEADERS);
+    add_frame(FRAME_SETTINGS, 0, 0, payload, sizeof(payload));
+}
+
+bool Http2Session::upgrade(const char *settings, int len, Http_Connect::HTTP_CODE ret)
+{
+    uint8_t payload[256];
+    int n = base64url_decode(settings, len, payload, sizeof(payload));
+    if (n < 0 || n % 6 != 0 || apply_settings(payload, n) != H2_NO_ERROR)
+    {
+        return false;
+    }
+
+    // 升级的请求是流1，请求已经收完了
+    start();
+    m_last_stream = 1;
+    return respond(1, ret, false);
+}
+
+Http_Connect::PROCESS_STATE Http2Session::process()
+{
+    Http_Connect &c = *m_conn;
+    if (!c.prepare_write())
+    {
+        return Http_Connect::PROCESS_CLOSE;
+    }
+
+    while (!m_closing && has_room())
+    {
+        const uint8_t *p = (const uint8_t *)c.m_read_buf + c.m_request_start;
+        int avail = c.m_read_idx - c.m_request_start;
+        if (!m_preface)
+        {
+            // 升级之后客户端还要发送连接前言
+            int ret = avail > 0 ? check_preface((const char *)p, avail) : -1;
+            if (ret < 0)
+            {
+                break;
+            }
+            if (ret == 0)
+            {
+                connection_error(H2_PROTOCOL_ERROR);
+                break;
+            }
+            c.m_request_start += PREFACE_LEN;
+            m_preface = true;
+            continue;
+        }
+
+        if (avail < FRAME_HEADER_LEN)
+        {
+            break;
+        }
+        uint32_t len = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+        if (len > (uint32_t)MAX_FRAME_SIZE)
+        {
+            connection_error(H2_FRAME_SIZE_ERROR);
+            break;
+        }
+        if ((uint32_t)avail < FRAME_HEADER_LEN + len)
+        {
+            break;
+        }
+        // 客户端在收到SETTINGS之前可能打开更多的流，流满了先发送已有的流，
+        // 发送完再处理新的请求，已有的流都在等待窗口时才拒绝
+        uint32_t stream = read32(p + 5) & 0x7fffffff;
+        if (p[3] == FRAME_HEADERS && stream > m_last_stream && active_streams() == MAX_STREAMS && want_write())
+        {
+            break;
+        }
+
+        c.m_request_start += FRAME_HEADER_LEN + len;
+        if (!handle_frame(p[3], p[4], stream, p + FRAME_HEADER_LEN, len))
+        {
+            break;
+        }
+    }
+    // 帧不按行解析，处理到哪里就丢掉哪里之前的数据
+    c.m_checked_idx = c.m_request_start;
+    c.m_start_line = c.m_request_start;
+
+    if (!m_closing)
+    {
+        schedule();
+    }
+
+    if (c.m_queue->head == c.m_queue->tail)
+    {
+        // 客户端要关闭连接，已经没有流了
+        if (m_goaway && active_streams() == 0)
+        {
+            return Http_Connect::PROCESS_CLOSE;
+        }
+        // 没有要发送的，空闲的连接不占用缓存区
+        if (c.m_request_start == c.m_read_idx)
+        {
+            c.init();
+        }
+        else
+        {
+            c.release_write_buf();
+        }
+        return Http_Connect::PROCESS_NEED_READ;
+    }
+    return Http_Connect::PROCESS_WRITE;
+}
+
+bool Http2Session::want_write() const
+{
+    if (m_closing || !m_preface || m_send_window <= 0)
+    {
+        return false;
+    }
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        if (m_streams[i].id && m_streams[i].remaining > 0 && m_streams[i].window > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Http2Session::has_room() const
+{
+    return m_conn->m_queue->tail <= Http_Connect::MAX_PIPELINE - 3 &&
+           Http_Connect::WRITE_BUFFER_SIZE - m_conn->m_write_idx >= FRAME_RESERVE;
+}
+
+bool Http2Session::handle_frame(uint8_t type, uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len)
+{
+    // 头部块没有收完之前只能是同一个流的 CONTINUATION
+    if (m_header_stream)
+    {
+        if (type != FRAME_CONTINUATION || stream != m_header_stream)
+        {
+            return connection_error(H2_PROTOCOL_ERROR);
+        }
+        if (m_block_len + len > (uint32_t)MAX_HEADER_BLOCK)
+        {
+            return connection_error(H2_ENHANCE_YOUR_CALM);
+        }
+        memcpy(m_block + m_block_len, payload, len);
+        m_block_len += len;
+        return (flags & FLAG_END_HEADERS) ? finish_headers() : true;
+    }
+
+    switch (type)
+    {
+        case FRAME_DATA:
+            return handle_data(flags, stream, len);
+
+        case FRAME_HEADERS:
+            return handle_headers(flags, stream, payload, len);
+
+        case FRAME_PRIORITY:
+            // 不按优先级调度，所有的流轮流发送
+            return true;
+
+        case FRAME_RST_STREAM:
+        {
+            if (len != 4)
+            {
+                return connection_error(H2_FRAME_SIZE_ERROR);
+            }
+            if (stream == 0 || stream > m_last_stream)
+            {
+                return connection_error(H2_PROTOCOL_ERROR);
+            }
+            Stream *s = find_stream(stream);
+            if (s)
+            {
+                close_stream(*s);
+            }
+            return true;
+        }
+
+        case FRAME_SETTINGS:
+            return handle_settings(flags, stream, payload, len);
+
+        case FRAME_PUSH_PROMISE:
+            // 客户端不能推送
+            return connection_error(H2_PROTOCOL_ERROR);
+
+        case FRAME_PING:
+        {
+            if (stream != 0)
+            {
+                return connection_error(H2_PROTOCOL_ERROR);
+            }
+            if (len != 8)
+            {
+                return connection_error(H2_FRAME_SIZE_ERROR);
+            }
+            if (!(flags & FLAG_ACK))
+            {
+                add_frame(FRAME_PING, FLAG_ACK, 0, payload, len);
+            }
+            return true;
+        }
+
+        case FRAME_GOAWAY:
+            // 不再有新的流，已有的流发送完就关闭
+            m_goaway = true;
+            return true;
+
+        case FRAME_WINDOW_UPDATE:
+            return handle_window_update(stream, payload, len);
+
+        case FRAME_CONTINUATION:
+            return connection_error(H2_PROTOCOL_ERROR);
+
+        default:
+            // 不认识的帧类型忽略
+            return true;
+    }
+}
+
+bool Http2Session::handle_data(uint8_t flags, uint32_t stream, uint32_t len)
+{
+    if (stream == 0 || stream > m_last_stream)
+    {
+        return connection_error(H2_PROTOCOL_ERROR);
+    }
+
+    // 请求体不处理，收到的数据(包括填充)计入连接的接收窗口，攒够一半再还给客户端，
+    // 已经关闭的流上的数据也占用了连接的窗口
+    m_recv_unacked += len;
+    if (m_recv_unacked > (uint32_t)INITIAL_WINDOW)
+    {
+        return connection_error(H2_FLOW_CONTROL_ERROR);
+    }
+    if (m_recv_unacked >= (uint32_t)INITIAL_WINDOW / 2)
+    {
+        send_window_update(0, m_recv_unacked);
+        m_recv_unacked = 0;
+    }
+
+    Stream *s = find_stream(stream);
+    if (!s || !s->recv_open)
+    {
+        // 请求已经收完，或者流已经关闭了
+        reset_stream(stream, H2_STREAM_CLOSED);
+        return true;
+    }
+    if (flags & FLAG_END_STREAM)
+    {
+        s->recv_open = false;
+        if (s->remaining == 0)
+        {
+            close_stream(*s);
+        }
+        return true;
+    }
+
+    // 流的接收窗口也一样，不还的话超过初始窗口的请求体会一直等下去
+    s->recv_unacked += len;
+    if (s->recv_unacked > (uint32_t)INITIAL_WINDOW)
+    {
+        reset_stream(stream, H2_FLOW_CONTROL_ERROR);
+        close_stream(*s);
+        return true;
+    }
+    if (s->recv_unacked >= (uint32_t)INITIAL_WINDOW / 2)
+    {
+        send_window_update(stream, s->recv_unacked);
+        s->recv_unacked = 0;
+    }
+    return true;
+}
+
+bool Http2Session::handle_headers(uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len)
+{
+    // 客户端打开的流是奇数
+    if (stream == 0 || !(stream & 1))
+    {
+        return connection_error(H2_PROTOCOL_ERROR);
+    }
+
+    // 去掉填充和优先级
+    uint32_t offset = 0;
+    uint32_t padding = 0;
+    if (flags & FLAG_PADDED)
+    {
+        if (len < 1)
+        {
+            return connection_error(H2_FRAME_SIZE_ERROR);
+        }
+        padding = payload[0];
+        offset = 1;
+    }
+    if (flags & FLAG_PRIORITY)
+    {
+        offset += 5;
+    }
+    if (offset + padding > len)
+    {
+        return connection_error(H2_PROTOCOL_ERROR);
+    }
+
+    // 比已有的流ID大的是新的请求，否则是已有的流的 trailers
+    m_header_new = stream > m_last_stream;
+    if (m_header_new)
+    {
+        m_last_stream = stream;
+    }
+    m_header_stream = stream;
+    m_header_end = (flags & FLAG_END_STREAM) != 0;
+    m_block_len = len - offset - padding;
+    if (m_block_len > MAX_HEADER_BLOCK)
+    {
+        return connection_error(H2_ENHANCE_YOUR_CALM);
+    }
+    memcpy(m_block, payload + offset, m_block_len);
+    return (flags & FLAG_END_HEADERS) ? finish_headers() : true;
+}
+
+bool Http2Session::handle_settings(uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len)
+{
+    if (stream != 0)
+    {
+        return connection_error(H2_PROTOCOL_ERROR);
+    }
+    if (flags & FLAG_ACK)
+    {
+        return len == 0 ? true : connection_error(H2_FRAME_SIZE_ERROR);
+    }
+    if (len % 6 != 0)
+    {
+        return connection_error(H2_FRAME_SIZE_ERROR);
+    }
+
+    ERROR_CODE code = apply_settings(payload, len);
+    if (code != H2_NO_ERROR)
+    {
+        return connection_error(code);
+    }
+    add_frame(FRAME_SETTINGS, FLAG_ACK, 0, nullptr, 0);
+    return true;
+}
+
+Http2Session::ERROR_CODE Http2Session::apply_settings(const uint8_t *payload, uint32_t len)
+{
+    for (uint32_t i = 0; i + 6 <= len; i += 6)
+    {
+        uint16_t id = (payload[i] << 8) | payload[i + 1];
+        uint32_t value = read32(payload + i + 2);
+        switch (id)
+        {
+            case SETTINGS_HEADER_TABLE_SIZE:
+                m_encoder.set_max_size(value > (uint32_t)HpackTable::DEFAULT_SIZE ? HpackTable::DEFAULT_SIZE : value);
+                break;
+            case SETTINGS_ENABLE_PUSH:
+                if (value > 1)
+                {
+                    return H2_PROTOCOL_ERROR;
+                }
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE:
+            {
+                if (value > MAX_WINDOW)
+                {
+                    return H2_FLOW_CONTROL_ERROR;
+                }
+                // 已有的流的窗口按差值调整，可能变成负数
+                int64_t delta = (int64_t)value - m_peer_window;
+                for (int j = 0; j < MAX_STREAMS; j++)
+                {
+                    if (m_streams[j].id)
+                    {
+                        m_streams[j].window += delta;
+                    }
+                }
+                m_peer_window = value;
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (value < (uint32_t)MAX_FRAME_SIZE || value > 16777215)
+                {
+                    return H2_PROTOCOL_ERROR;
+                }
+                m_peer_max_frame = value;
+                break;
+            default:
+                // 其他的参数不影响服务端的发送
+                break;
+        }
+    }
+    return H2_NO_ERROR;
+}
+
+bool Http2Session::handle_window_update(uint32_t stream, const uint8_t *payload, uint32_t len)
+{
+    if (len != 4)
+    {
+        return connection_error(H2_FRAME_SIZE_ERROR);
+    }
+    uint32_t increment = read32(payload) & 0x7fffffff;
+
+    if (stream == 0)
+    {
+        m_send_window += increment;
+        if (increment == 0)
+        {
+            return connection_error(H2_PROTOCOL_ERROR);
+        }
+        if (m_send_window > MAX_WINDOW)
+        {
+            return connection_error(H2_FLOW_CONTROL_ERROR);
+        }
+        return true;
+    }
+
+    if (stream > m_last_stream)
+    {
+        return connection_error(H2_PROTOCOL_ERROR);
+    }
+    // 已经关闭的流的 WINDOW_UPDATE 忽略
+    Stream *s = find_stream(stream);
+    if (!s)
+    {
+        return true;
+    }
+    s->window += increment;
+    if (increment == 0 || s->window > MAX_WINDOW)
+    {
+        reset_stream(stream, increment == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+        close_stream(*s);
+    }
+    return true;
+}
+
+bool Http2Session::on_header(void *arg, const char *name, int name_len, const char *value, int value_len)
+{
+    Http2Session *session = (Http2Session *)arg;
+    // 动态表要和客户端的保持一致，请求头太大也要继续解码，只是不再记录
+    if (session->m_scratch_len + name_len + value_len + 2 > MAX_REQUEST_HEADERS)
+    {
+        session->m_bad_request = true;
+        return true;
+    }
+
+    // 名字和值拷贝出来，以'\0'结尾，和HTTP/1.1解析之后的请求头一样
+    char *name_copy = session->m_scratch + session->m_scratch_len;
+    memcpy(name_copy, name, name_len);
+    name_copy[name_len] = '\0';
+    char *value_copy = name_copy + name_len + 1;
+    memcpy(value_copy, value, value_len);
+    value_copy[value_len] = '\0';
+    session->m_scratch_len += name_len + value_len + 2;
+
+    if (name_len > 0 && name[0] == ':')
+    {
+        if (strcmp(name_copy, ":method") == 0)
+        {
+            session->m_method = value_copy;
+        }
+        else if (strcmp(name_copy, ":path") == 0)
+        {
+            session->m_path = value_copy;
+        }
+        else if (strcmp(name_copy, ":authority") == 0)
+        {
+            session->m_authority = value_copy;
+        }
+        return true;
+    }
+
+    HEADER_NAME id;
+    if (!session->m_conn->m_headers->add(name_copy, name_len, value_copy, value_len, id))
+    {
+        session->m_bad_request = true;
+    }
+    return true;
+}
+
+bool Http2Session::finish_headers()
+{
+    Http_Connect &c = *m_conn;
+    uint32_t id = m_header_stream;
+    m_header_stream = 0;
+
+    m_method = nullptr;
+    m_path = nullptr;
+    m_authority = nullptr;
+    m_bad_request = false;
+    m_scratch_len = 0;
+    c.m_headers->reset(m_scratch);
+    if (!m_decoder.decode(m_block, m_block_len, on_header, this))
+    {
+        return connection_error(H2_COMPRESSION_ERROR);
+    }
+
+    // trailers 结束了请求体
+    if (!m_header_new)
+    {
+        Stream *s = find_stream(id);
+        if (s && m_header_end)
+        {
+            s->recv_open = false;
+            if (s->remaining == 0)
+            {
+                close_stream(*s);
+            }
+        }
+        return true;
+    }
+    // 客户端已经要关闭连接了
+    if (m_goaway)
+    {
+        return true;
+    }
+    if (active_streams() == MAX_STREAMS)
+    {
+        reset_stream(id, H2_REFUSED_STREAM);
+        return true;
+    }
+
+    // 和HTTP/1.1一样只支持GET
+    Http_Connect::HTTP_CODE ret;
+    if (m_bad_request || !m_method || !m_path || strcmp(m_method, "GET") != 0)
+    {
+        ret = Http_Connect::BAD_REQUEST;
+    }
+    else
+    {
+        ret = c.process_h2_request(m_path, m_authority);
+    }
+    bool ok = respond(id, ret, !m_header_end);
+    c.init_request();
+    return ok;
+}
+
+bool Http2Session::respond(uint32_t id, Http_Connect::HTTP_CODE ret, bool recv_open)
+{
+    Http_Connect &c = *m_conn;
+    bool has_file = ret == Http_Connect::FILE_REQUEST || ret == Http_Connect::NOT_MODIFIED;
+    int status = 200;
+    const char *body = nullptr; // 内存中的响应体，为nullptr时从文件发送
+    off_t offset = 0;
+    off_t length = 0;
+    Http_Connect::ByteRange ranges[Http_Connect::MAX_RANGES];
+    int count = -1;
+
+    if (ret == Http_Connect::FILE_REQUEST)
+    {
+        // 多个区间不生成 multipart/byteranges，发送整个文件
+        if (c.want_range())
+        {
+            count = Http_Connect::parse_ranges(c.m_headers->get(HEADER_RANGE), c.m_file_size, ranges);
+        }
+        if (count == 0)
+        {
+            status = 416;
+        }
+        else
+        {
+            length = c.m_file_size;
+            if (count == 1)
+            {
+                status = 206;
+                offset = ranges[0].first;
+                length = ranges[0].last - ranges[0].first + 1;
+            }
+            body = c.cached_body();
+        }
+    }
+    else if (ret == Http_Connect::NOT_MODIFIED)
+    {
+        status = 304;
+    }
+    else
+    {
+        int len = 0;
+        body = Http_Connect::error_form(ret, status, len);
+        length = len;
+    }
+
+    // 头部块直接编码到写缓存区中帧头之后
+    int start = c.m_write_idx;
+    uint8_t *block = (uint8_t *)c.m_write_buf + start + FRAME_HEADER_LEN;
+    m_encoder.begin(block, Http_Connect::WRITE_BUFFER_SIZE - start - FRAME_HEADER_LEN);
+
+    char number[48];
+    switch (status)
+    {
+        case 200:
+            m_encoder.indexed(HPACK_STATUS);
+            break;
+        case 206:
+            m_encoder.indexed(HPACK_STATUS + 2);
+            break;
+        case 304:
+            m_encoder.indexed(HPACK_STATUS + 3);
+            break;
+        case 400:
+            m_encoder.indexed(HPACK_STATUS + 4);
+            break;
+        case 404:
+            m_encoder.indexed(HPACK_STATUS + 5);
+            break;
+        case 500:
+            m_encoder.indexed(HPACK_STATUS + 6);
+            break;
+        default:
+            m_encoder.field(HPACK_STATUS, number, format_uint(number, status), false);
+            break;
+    }
+
+    // 值不变的响应头加入动态表，之后的响应中只需要一个字节
+    int len = 0;
+    const char *date = date_header(len);
+    m_encoder.field(HPACK_DATE, date + 6, len - 8, true);
+    m_encoder.field(HPACK_SERVER, "webserver", 9, true);
+    if (status != 304)
+    {
+        m_encoder.field(HPACK_CONTENT_LENGTH, number, format_uint(number, length), false);
+        m_encoder.field(HPACK_CONTENT_TYPE, "text/html", 9, true);
+    }
+
+    if (has_file)
+    {
+        FileEntry *file = c.m_file;
+        if (status == 200)
+        {
+            m_encoder.field(HPACK_ACCEPT_RANGES, "bytes", 5, true);
+        }
+        if (status != 416)
+        {
+            char etag[sizeof(file->etag) + 8];
+            int etag_len = 0;
+            etag[etag_len++] = '"';
+            memcpy(etag + etag_len, file->etag, file->etag_len);
+            etag_len += file->etag_len;
+            if (c.m_body)
+            {
+                memcpy(etag + etag_len, "-gz", 3);
+                etag_len += 3;
+            }
+            etag[etag_len++] = '"';
+            m_encoder.field(HPACK_ETAG, etag, etag_len, false);
+            m_encoder.field(HPACK_LAST_MODIFIED, file->last_modified, HTTP_DATE_LEN, false);
+
+            const CachePolicy *policy = c.m_cache_policy;
+            if (policy)
+            {
+                // 策略中的响应头是HTTP/1.1的格式，取出值
+                m_encoder.field(HPACK_CACHE_CONTROL, policy->cache_control + 15, policy->cache_control_len - 17, true);
+                const char *expires = expires_header(policy, len);
+                if (expires)
+                {
+                    m_encoder.field(HPACK_EXPIRES, expires + 9, len - 11, true);
+                }
+            }
+        }
+        if (status == 206 || status == 416)
+        {
+            char range[80];
+            int n = 0;
+            memcpy(range, "bytes ", 6);
+            n = 6;
+            if (status == 206)
+            {
+                n += format_uint(range + n, ranges[0].first);
+                range[n++] = '-';
+                n += format_uint(range + n, ranges[0].last);
+            }
+            else
+            {
+                range[n++] = '*';
+            }
+            range[n++] = '/';
+            n += format_uint(range + n, c.m_file_size);
+            m_encoder.field(HPACK_CONTENT_RANGE, range, n, false);
+        }
+        if (c.m_gzip && (status == 200 || status == 206))
+        {
+            m_encoder.field(HPACK_CONTENT_ENCODING, "gzip", 4, true);
+        }
+        if (c.m_vary)
+        {
+            m_encoder.field(HPACK_VARY, "Accept-Encoding", 15, true);
+        }
+    }
+
+    int block_len = m_encoder.end();
+    if (block_len < 0)
+    {
+        // 编码器的动态表已经变了，只能关闭连接
+        return connection_error(H2_INTERNAL_ERROR);
+    }
+    c.m_write_idx = start;
+    write_frame_header(FRAME_HEADERS, FLAG_END_HEADERS | (length == 0 ? FLAG_END_STREAM : 0), id, block_len);
+    c.m_write_idx += block_len;
+    push_frame(start);
+
+    if (length == 0)
+    {
+        c.close_file();
+        if (!recv_open)
+        {
+            return true;
+        }
+    }
+
+    // 响应体留给 schedule 按窗口分成DATA帧发送，流持有文件的引用；
+    // 请求体还没有收完时流也要留下来，给它的接收窗口发送 WINDOW_UPDATE
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        Stream &s = m_streams[i];
+        if (s.id == 0)
+        {
+            s.id = id;
+            s.window = m_peer_window;
+            s.file = has_file ? c.m_file : nullptr;
+            s.data = body;
+            s.offset = offset;
+            s.remaining = length;
+            s.recv_open = recv_open;
+            s.recv_unacked = 0;
+            c.m_file = nullptr;
+            return true;
+        }
+    }
+    c.close_file();
+    return connection_error(H2_INTERNAL_ERROR);
+}
+
+void Http2Session::schedule()
+{
+    Http_Connect &c = *m_conn;
+    // 升级时101之后只跟着SETTINGS和流1的HEADERS，DATA要等收到客户端的连接前言再发送。
+    // 客户端处理完101才发送连接前言，有的客户端(例如curl)用固定大小的缓存区接收101之后的数据，
+    // 和101一起到达的数据太多会失败
+    if (!m_preface)
+    {
+        return;
+    }
+
+    // 每一轮每个流最多一个帧，多个流的数据交替发送
+    bool progress = true;
+    while (progress && m_send_window > 0)
+    {
+        progress = false;
+        for (int i = 0; i < MAX_STREAMS && m_send_window > 0; i++)
+        {
+            Stream &s = m_streams[(m_next + i) % MAX_STREAMS];
+            if (!s.id || s.remaining == 0 || s.window <= 0)
+            {
+                continue;
+            }
+            if (c.m_queue->tail == Http_Connect::MAX_PIPELINE ||
+                Http_Connect::WRITE_BUFFER_SIZE - c.m_write_idx < FRAME_HEADER_LEN)
+            {
+                return;
+            }
+            send_data(s);
+            progress = true;
+        }
+        m_next = (m_next + 1) % MAX_STREAMS;
+    }
+}
+
+void Http2Session::send_data(Stream &stream)
+{
+    Http_Connect &c = *m_conn;
+    off_t len = stream.remaining;
+    int64_t limits[3] = {stream.window, m_send_window, m_peer_max_frame < (uint32_t)MAX_FRAME_SIZE ? m_peer_max_frame : MAX_FRAME_SIZE};
+    for (int i = 0; i < 3; i++)
+    {
+        if (len > limits[i])
+        {
+            len = limits[i];
+        }
+    }
+    bool last = len == stream.remaining;
+
+    // 帧头在写缓存区中，内容是文件缓存中的内存或者文件的一段，每个帧都持有文件的引用
+    int start = c.m_write_idx;
+    write_frame_header(FRAME_DATA, last ? FLAG_END_STREAM : 0, stream.id, len);
+    if (stream.file)
+    {
+        stream.file->ref++;
+    }
+    if (stream.data)
+    {
+        c.push_response(start, stream.data + stream.offset, len, stream.file, 0, 0);
+    }
+    else
+    {
+        c.push_response(start, nullptr, 0, stream.file, stream.offset, len);
+    }
+    c.m_queue->linger = true;
+
+    stream.offset += len;
+    stream.remaining -= len;
+    stream.window -= len;
+    m_send_window -= len;
+    if (last && !stream.recv_open)
+    {
+        close_stream(stream);
+    }
+}
+
+void Http2Session::write_frame_header(uint8_t type, uint8_t flags, uint32_t stream, uint32_t len)
+{
+    uint8_t *p = (uint8_t *)m_conn->m_write_buf + m_conn->m_write_idx;
+    p[0] = len >> 16;
+    p[1] = len >> 8;
+    p[2] = len;
+    p[3] = type;
+    p[4] = flags;
+    write32(p + 5, stream);
+    m_conn->m_write_idx += FRAME_HEADER_LEN;
+}
+
+void Http2Session::add_frame(uint8_t type, uint8_t flags, uint32_t stream, const void *payload, uint32_t len)
+{
+    Http_Connect &c = *m_conn;
+    int start = c.m_write_idx;
+    write_frame_header(type, flags, stream, len);
+    // 空的帧(例如SETTINGS的确认)没有负载，payload 可能为空指针
+    if (len)
+    {
+        memcpy(c.m_write_buf + c.m_write_idx, payload, len);
+        c.m_write_idx += len;
+    }
+    push_frame(start);
+}
+
+void Http2Session::push_frame(int start)
+{
+    Http_Connect &c = *m_conn;
+    Http_Connect::ResponseQueue *queue = c.m_queue;
+    // 前一个响应也只有写缓存区中的内容，并且正好在这个帧之前，合并成一个
+    if (queue->tail > queue->head)
+    {
+        Http_Connect::Response &last = queue->items[queue->tail - 1];
+        if (last.len == 0 && last.file_len == 0 && !last.file && last.head + last.head_len == c.m_write_buf + start)
+        {
+            last.head_len += c.m_write_idx - start;
+            queue->linger = !m_closing;
+            return;
+        }
+    }
+    c.push_response(start, nullptr, 0, nullptr, 0, 0);
+    queue->linger = !m_closing;
+}
+
+void Http2Session::send_window_update(uint32_t stream, uint32_t increment)
+{
+    uint8_t payload[4];
+    write32(payload, increment);
+    add_frame(FRAME_WINDOW_UPDATE, 0, stream, payload, sizeof(payload));
+}
+
+void Http2Session::reset_stream(uint32_t stream, ERROR_CODE code)
+{
+    uint8_t payload[4];
+    write32(payload, code);
+    add_frame(FRAME_RST_STREAM, 0, stream, payload, sizeof(payload));
+}
+
+bool Http2Session::connection_error(ERROR_CODE code)
+{
+    if (!m_closing)
+    {
+        uint8_t payload[8];
+        write32(payload, m_last_stream);
+        write32(payload + 4, code);
+        m_closing = true;
+        add_frame(FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+    }
+    return false;
+}
+
+Http2Session::Stream *Http2Session::find_stream(uint32_t id)
+{
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        if (m_streams[i].id == id)
+        {
+            return &m_streams[i];
+        }
+    }
+    return nullptr;
+}
+
+void Http2Session::close_stream(Stream &stream)
+{
+    FileCache::release(stream.file);
+    stream.file = nullptr;
+    stream.data = nullptr;
+    stream.remaining = 0;
+    stream.id = 0;
+}
+
+int Http2Session::active_streams() const
+{
+    int count = 0;
+    for (int i = 0; i < MAX_STREAMS; i++)
+    {
+        if (m_streams[i].id)
+        {
+            count++;
+        }
+    }
+    return count;
+}
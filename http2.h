@@ -0,0 +1,157 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stdint.h>
+#include "hpack.h"
+#include "http_connect.h"
+
+/*
+    一个明文HTTP/2(h2c)连接的状态，客户端直接发送连接前言，或者用 Upgrade: h2c 从HTTP/1.1升级。
+    帧的收发还是通过 Http_Connect 的读缓存区和响应队列：收到的帧在读缓存区中解析，
+    要发送的帧头和头部块写在写缓存区中，DATA帧的内容和HTTP/1.1一样来自文件缓存中的内存或者文件，
+    每个DATA帧是响应队列中的一个响应，文件的内容仍然由内核直接发送。
+    多个流轮流发送，每轮每个流最多一个帧，受连接和流的发送窗口限制。
+    请求的处理复用 Http_Connect 的 do_request，解码出的请求头放进它的 m_headers 中。
+*/
+class Http2Session
+{
+public:
+    static const int PREFACE_LEN = 24;          // 客户端连接前言的长度
+    static const int FRAME_HEADER_LEN = 9;      // 帧头的长度
+    static const int MAX_STREAMS = 32;          // 同时打开的流的最大数量，在SETTINGS中告诉客户端
+    static const int MAX_FRAME_SIZE = 16384;    // 接收的帧的最大长度，也是发送的DATA帧的最大长度
+    static const int INITIAL_WINDOW = 65535;    // 流量控制窗口的初始大小
+    static const int MAX_HEADER_BLOCK = 16384;  // 一个头部块(HEADERS加上CONTINUATION)的最大长度
+    static const int MAX_REQUEST_HEADERS = 8192; // 解码之后一个请求的请求头的最大字节数
+    // 读缓存区的上限，要放得下整个接收窗口的DATA帧，io_uring 后端在发送期间收到的数据要等发送完才处理
+    static const int READ_BUFFER_SIZE = 131072;
+    static const int FRAME_RESERVE = 1024;      // 写缓存区剩余的空间少于这个数就不再处理下一个帧
+
+    // 帧的类型
+    enum FRAME_TYPE
+    {
+        FRAME_DATA = 0,
+        FRAME_HEADERS,
+        FRAME_PRIORITY,
+        FRAME_RST_STREAM,
+        FRAME_SETTINGS,
+        FRAME_PUSH_PROMISE,
+        FRAME_PING,
+        FRAME_GOAWAY,
+        FRAME_WINDOW_UPDATE,
+        FRAME_CONTINUATION
+    };
+
+    // RST_STREAM 和 GOAWAY 中的错误码
+    enum ERROR_CODE
+    {
+        H2_NO_ERROR = 0,
+        H2_PROTOCOL_ERROR = 1,
+        H2_INTERNAL_ERROR = 2,
+        H2_FLOW_CONTROL_ERROR = 3,
+        H2_STREAM_CLOSED = 5,
+        H2_FRAME_SIZE_ERROR = 6,
+        H2_REFUSED_STREAM = 7,
+        H2_COMPRESSION_ERROR = 9,
+        H2_ENHANCE_YOUR_CALM = 11
+    };
+
+public:
+    explicit Http2Session(Http_Connect *conn);
+    ~Http2Session();
+
+    // 数据的开头是不是客户端的连接前言，1是，0不是，-1还要更多的数据才能判断
+    static int check_preface(const char *data, int len);
+
+    // 客户端直接发送了连接前言，发送服务端的SETTINGS
+    void start();
+    // 从HTTP/1.1升级，settings为 HTTP2-Settings 请求头的值，升级的请求成为流1，
+    // ret为它的处理结果，HTTP2-Settings 不对时返回false，这时不升级
+    bool upgrade(const char *settings, int len, Http_Connect::HTTP_CODE ret);
+    // 解析读缓存区中所有完整的帧，生成要发送的帧
+    Http_Connect::PROCESS_STATE process();
+    // 还有流可以发送数据
+    bool want_write() const;
+
+private:
+    // 正在发送响应或者接收请求体的流，请求收完并且响应发送完就关闭
+    struct Stream
+    {
+        uint32_t id;           // 0表示这个位置空闲
+        int64_t window;        // 流的发送窗口
+        FileEntry *file;       // 持有的文件缓存项的引用，没有为nullptr
+        const char *data;      // 内存中的响应内容，为nullptr时从文件发送
+        off_t offset;          // 下一个要发送的字节的偏移
+        off_t remaining;       // 还要发送的字节数
+        bool recv_open;        // 客户端还没有发送 END_STREAM，请求体还在接收
+        uint32_t recv_unacked; // 这个流收到的DATA还没有用 WINDOW_UPDATE 还给对端的字节数
+    };
+
+    // 处理一个完整的帧，出错时发送GOAWAY并返回false
+    bool handle_frame(uint8_t type, uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len);
+    bool handle_data(uint8_t flags, uint32_t stream, uint32_t len);
+    bool handle_headers(uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len);
+    bool handle_settings(uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len);
+    bool handle_window_update(uint32_t stream, const uint8_t *payload, uint32_t len);
+    // 应用对端的设置，返回错误码
+    ERROR_CODE apply_settings(const uint8_t *payload, uint32_t len);
+    // 头部块收完了，解码并处理请求
+    bool finish_headers();
+    // 解码出的一个请求头
+    static bool on_header(void *arg, const char *name, int name_len, const char *value, int value_len);
+    // 生成流的响应头，有响应体或者请求体还没有收完(recv_open)时流留下来
+    bool respond(uint32_t id, Http_Connect::HTTP_CODE ret, bool recv_open);
+    // 按轮转的顺序给每个可以发送的流生成DATA帧，直到窗口用完或者响应队列满了，
+    // 收到客户端的连接前言之前不发送
+    void schedule();
+    void send_data(Stream &stream);
+
+    // 把帧写进写缓存区，和前一个只有写缓存区内容的响应合并
+    void add_frame(uint8_t type, uint8_t flags, uint32_t stream, const void *payload, uint32_t len);
+    void write_frame_header(uint8_t type, uint8_t flags, uint32_t stream, uint32_t len);
+    void push_frame(int start);
+    void send_window_update(uint32_t stream, uint32_t increment);
+    void reset_stream(uint32_t stream, ERROR_CODE code);
+    // 连接错误，发送GOAWAY，发送完就关闭连接
+    bool connection_error(ERROR_CODE code);
+
+    Stream *find_stream(uint32_t id);
+    void close_stream(Stream &stream);
+    int active_streams() const;
+    // 还能不能再处理一个帧
+    bool has_room() const;
+
+private:
+    Http_Connect *m_conn;
+    HpackDecoder m_decoder;
+    HpackEncoder m_encoder;
+
+    bool m_preface;            // 是否已经收到客户端的连接前言
+    bool m_closing;            // 已经发送了GOAWAY，发送完就关闭连接
+    bool m_goaway;             // 客户端发送了GOAWAY，现有的流发送完就关闭连接
+    uint32_t m_last_stream;    // 客户端打开的最大的流ID
+    int64_t m_send_window;     // 连接的发送窗口
+    int64_t m_peer_window;     // 对端的 SETTINGS_INITIAL_WINDOW_SIZE，新的流的发送窗口
+    uint32_t m_peer_max_frame; // 对端的 SETTINGS_MAX_FRAME_SIZE
+    uint32_t m_recv_unacked;   // 收到的DATA还没有用 WINDOW_UPDATE 还给对端的字节数
+    int m_next;                // 下一轮从哪个流开始发送
+
+    Stream m_streams[MAX_STREAMS];
+
+    // 正在接收的头部块
+    uint32_t m_header_stream;  // 头部块所属的流，0表示没有在接收头部块
+    bool m_header_new;         // 是否是新的流的请求头，否则是 trailers
+    bool m_header_end;         // 头部块所在的HEADERS帧带有 END_STREAM，请求没有请求体或者已经收完
+    int m_block_len;
+    uint8_t m_block[MAX_HEADER_BLOCK];
+
+    // 解码出的请求，伪头部单独记录，其他的请求头放进 Http_Connect 的 m_headers
+    char *m_method;
+    char *m_path;
+    char *m_authority;
+    bool m_bad_request;        // 请求头不合法或者太大
+    int m_scratch_len;
+    char m_scratch[MAX_REQUEST_HEADERS];
+};
+
+#endif
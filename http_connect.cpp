@@ -1,42 +1,204 @@
 #include "http_connect.h"
+#include <new>
+#include <climits>
+#include <sys/sendfile.h>
+#include "http_scan.h"
+#include "http_date.h"
+#include "http2.h"
+
+
+// 定义HTTP响应的一些状态信息，状态行和固定的响应头都预先拼好，用 sizeof 取长度
+static const char switching_101_line[] = "HTTP/1.1 101 Switching Protocols\r\n";
+static const char ok_200_line[] = "HTTP/1.1 200 OK\r\n";
+static const char ok_206_line[] = "HTTP/1.1 206 Partial Content\r\n";
+static const char not_modified_304_line[] = "HTTP/1.1 304 Not Modified\r\n";
+static const char error_400_line[] = "HTTP/1.1 400 Bad Request\r\n";
+static const char error_400_form[] = "Your request has bad syntax or is inherently impossible to satisfy.\n";
+static const char error_403_line[] = "HTTP/1.1 403 Forbidden\r\n";
+static const char error_403_form[] = "You do not have permission to get file from this server.\n";
+static const char error_404_line[] = "HTTP/1.1 404 Not Found\r\n";
+static const char error_404_form[] = "The requested file was not found on this server.\n";
+static const char error_416_line[] = "HTTP/1.1 416 Range Not Satisfiable\r\n";
+static const char error_500_line[] = "HTTP/1.1 500 Internal Error\r\n";
+static const char error_500_form[] = "There was an unusual problem serving the requested file.\n";
+
+static const char server_header[] = "Server: webserver\r\n";
+static const char content_length_header[] = "Content-Length: ";
+static const char content_type_header[] = "Content-Type: text/html\r\n";
+static const char keep_alive_header[] = "Connection: keep-alive\r\n";
+static const char close_header[] = "Connection: close\r\n";
+static const char gzip_header[] = "Content-Encoding: gzip\r\n";
+static const char vary_header[] = "Vary: Accept-Encoding\r\n";
+static const char accept_ranges_header[] = "Accept-Ranges: bytes\r\n";
+static const char content_range_header[] = "Content-Range: bytes ";
+static const char etag_header[] = "ETag: \"";
+static const char last_modified_header[] = "Last-Modified: ";
+static const char upgrade_h2c_header[] = "Connection: Upgrade\r\nUpgrade: h2c\r\n";
+
+// 多个区间的206响应是 multipart/byteranges，每个区间之前是分隔线和这个区间的响应头
+#define RANGE_BOUNDARY "9b2e61f4c07d3a85"
+static const char multipart_type_header[] = "Content-Type: multipart/byteranges; boundary=" RANGE_BOUNDARY "\r\n";
+static const char part_begin[] = "\r\n--" RANGE_BOUNDARY "\r\nContent-Type: text/html\r\n";
+static const char part_end[] = "\r\n--" RANGE_BOUNDARY "--\r\n";
+
+// 两位数字的表，整数一次转换两位
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// 非负整数转成十进制，返回写入的字节数，buf至少要有20个字节
+int format_uint(char *buf, unsigned long long value)
+{
+    char tmp[20];
+    int pos = 20;
+    while (value >= 100)
+    {
+        int i = (value % 100) * 2;
+        value /= 100;
+        tmp[--pos] = digit_pairs[i + 1];
+        tmp[--pos] = digit_pairs[i];
+    }
+    if (value >= 10)
+    {
+        int i = value * 2;
+        tmp[--pos] = digit_pairs[i + 1];
+        tmp[--pos] = digit_pairs[i];
+    }
+    else
+    {
+        tmp[--pos] = '0' + value;
+    }
+    memcpy(buf, tmp + pos, 20 - pos);
+    return 20 - pos;
+}
 
+// 十进制的位数
+static int uint_len(unsigned long long value)
+{
+    int len = 1;
+    while (value >= 10)
+    {
+        value /= 10;
+        len++;
+    }
+    return len;
+}
 
-// 定义HTTP响应的一些状态信息
-const char *ok_200_title = "OK";
-const char *error_400_title = "Bad Request";
-const char *error_400_form = "Your request has bad syntax or is inherently impossible to satisfy.\n";
-const char *error_403_title = "Forbidden";
-const char *error_403_form = "You do not have permission to get file from this server.\n";
-const char *error_404_title = "Not Found";
-const char *error_404_form = "The requested file was not found on this server.\n";
-const char *error_500_title = "Internal Error";
-const char *error_500_form = "There was an unusual problem serving the requested file.\n";
+// 值得压缩的文件的后缀，图片等已经压缩过的格式不在其中
+static const char *compressible_exts[] = {".html", ".htm", ".css", ".js", ".json", ".txt", ".svg", ".xml"};
 
-// 网站的根目录
-const char *doc_root = "/home/nowcoder/webserver/resources";
-extern Log * log;
+static bool is_compressible(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    if (!ext)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(compressible_exts) / sizeof(compressible_exts[0]); i++)
+    {
+        if (strcasecmp(ext, compressible_exts[i]) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
-// 设置文件描述符的非阻塞
-void setnonblocking(int fd)
+// Accept-Encoding 中是否有 gzip(或者*)，并且 q 不为0，例如 "gzip, deflate, br" 或者 "gzip;q=0.8"
+static bool accept_gzip(const char *value)
 {
-    // 获取文件描述符的状态
-    int old_option = fcntl(fd, F_GETFL);
-    if (old_option == -1)
+    while (*value)
     {
-        perror("fnctl get failed\n");
-        exit(-1);
+        value += strspn(value, " \t,");
+        const char *token = value;
+        size_t len = strcspn(value, ";, \t");
+        value += len;
+
+        bool gzip = (len == 4 && strncasecmp(token, "gzip", 4) == 0) || (len == 1 && *token == '*');
+        bool zero = false;
+        value += strspn(value, " \t");
+        if (*value == ';')
+        {
+            // 参数中只关心 q=0
+            const char *q = strstr(value, "q=");
+            const char *end = value + strcspn(value, ",");
+            if (q && q < end)
+            {
+                zero = atof(q + 2) == 0;
+            }
+            value = end;
+        }
+        if (gzip)
+        {
+            return !zero;
+        }
     }
+    return false;
+}
 
-    // 设置文件描述符状态
-    int new_option = old_option | O_NONBLOCK;
-    if (fcntl(fd, F_SETFL, new_option) == -1)
+// Connection 请求头，逗号分隔的选项中有 close 就关闭连接，有 keep-alive 就保持连接，
+// 都没有时不改变 linger (HTTP/1.1默认保持连接，HTTP/1.0默认关闭)
+static void parse_connection(const char *value, bool &linger)
+{
+    while (*value)
     {
-        perror("fcntl set failed\n");
-        exit(-1);
+        value += strspn(value, " \t,");
+        const char *token = value;
+        size_t len = strcspn(value, ", \t");
+        value += len;
+
+        if (len == 5 && strncasecmp(token, "close", 5) == 0)
+        {
+            linger = false;
+        }
+        else if (len == 10 && strncasecmp(token, "keep-alive", 10) == 0)
+        {
+            linger = true;
+        }
+    }
+}
+
+// Upgrade 请求头的逗号分隔的协议中有没有 h2c
+static bool want_h2c(const char *value)
+{
+    while (*value)
+    {
+        value += strspn(value, " \t,");
+        const char *token = value;
+        size_t len = strcspn(value, ", \t");
+        value += len;
+
+        if (len == 3 && strncasecmp(token, "h2c", 3) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Range请求头中的一个偏移，没有数字或者数字太长返回false
+static bool parse_offset(const char *&p, const char *end, off_t &value)
+{
+    const char *begin = p;
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        if (p - begin == 18)
+        {
+            return false;
+        }
+        value = value * 10 + (*p - '0');
+        p++;
     }
+    return p > begin;
 }
 
-// 向epoll代理中加入需要监听的文件描述符
+// 网站的根目录
+const char *doc_root = "/home/nowcoder/webserver/resources";
+extern Log * log;
+
+// 向epoll代理中加入需要监听的文件描述符，文件描述符由accept4创建时已经是非阻塞的
 void addfd(int epollfd, int fd, bool one_shot)
 {
     epoll_event event;
@@ -57,14 +219,16 @@ void addfd(int epollfd, int fd, bool one_shot)
         perror("epoll_ctl failed");
         exit(-1);
     }
-    // 设置文件为非阻塞
-    setnonblocking(fd);
 }
 
 // 从epollfd中删除文件描述符
 void removefd(int epollfd, int fd)
 {
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, nullptr);
+    // io_uring后端的连接没有注册到epoll中
+    if (epollfd != -1)
+    {
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, nullptr);
+    }
     close(fd);
 }
 
@@ -76,69 +240,204 @@ void modifyfd(int epollfd, int fd, int event)
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &eventt);
 }
 
-// 所有socket的epoll文件描述符，指向红黑树
-int Http_Connect::m_epollfd = -1;
 // 用户的数量，客户端的数量
-int Http_Connect::m_uesr_count = 0;
+std::atomic<int> Http_Connect::m_uesr_count(0);
+int Http_Connect::m_max_header_size = 8192;
+BodyHandler Http_Connect::m_body_handler = nullptr;
+int Http_Connect::m_send_rate = 0;
+std::atomic<unsigned> Http_Connect::m_handoff_ns(0);
 
-void Http_Connect::close_connect()
+void *Http_Connect::operator new[](size_t size)
+{
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, alignof(Http_Connect), size) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void Http_Connect::operator delete[](void *ptr)
+{
+    free(ptr);
+}
+
+void Http_Connect::close_connect(bool real_close)
 {
     // 如果没有被关闭
     if (m_sockfd != -1)
     {
-        removefd(m_epollfd, m_sockfd);
+        // 先标记为空余再关闭，文件描述符一关闭就可能被别的reactor接受的新连接复用
+        int sockfd = m_sockfd;
+        delete m_h2;
+        m_h2 = nullptr;
+        close_file();
+        release_buffer();
         m_sockfd = -1;  // 设置为当前数组中用户已经被关闭，已经空余
         m_uesr_count--; // 用户数减 1
+        if (real_close)
+        {
+            removefd(m_epollfd, sockfd);
+        }
     }
 }
 
 // 加入文件描述符的时候进行的初始化
-void Http_Connect::init(int sockfd, const sockaddr_in &addr)
+void Http_Connect::init(int sockfd, const sockaddr_in &addr, int epollfd)
 {
     this->m_sockfd = sockfd;
     this->m_address = addr;
-
-    // 端口复用
-    int reuse = 1;
-    setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-    addfd(m_epollfd, m_sockfd, true);
+    this->m_epollfd = epollfd;
+    this->m_timer.user_data = this;
+    this->m_busy = BUSY_IDLE;
+    // 新连接的令牌桶是满的，小的响应不受限速的影响
+    this->m_send_credit = SEND_WINDOW * 1000;
+    this->m_send_stamp = TimerWheel::now_ms();
+    this->m_throttle_ms = 0;
+    this->m_inline = false;
+    this->m_sent_direct = false;
+    this->m_dispatch_stamp = 0;
+
+    // epollfd为-1表示连接由io_uring驱动，不需要注册到epoll
+    if (m_epollfd != -1)
+    {
+        addfd(m_epollfd, m_sockfd, true);
+    }
     m_uesr_count++;
     init();
 }
 
 void Http_Connect::init()
 {
-    bzero(m_read_buf, READ_BUFFER_SIZE);
-    m_read_idx = 0;    // 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
-    m_checked_idx = 0; // 当前正在分析的字符在读缓冲区中的位置
-    m_start_line = 0;  // 当前正在解析的行的起始位置
+    // 请求处理完了，缓存区还给缓存池，下一个请求到来时再申请
+    release_buffer();
+    m_read_idx = 0;      // 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
+    m_checked_idx = 0;   // 当前正在分析的字符在读缓冲区中的位置
+    m_request_start = 0; // 还没有处理完的第一个请求的起始位置
+    init_request();
+}
+
+void Http_Connect::init_request()
+{
+    close_file();
+    m_start_line = m_checked_idx; // 当前正在解析的行的起始位置
+    m_colon_idx = -1;             // 当前正在解析的行中第一个':'的位置
 
     m_check_state = CHECK_STATE_REQUESTLINE; // 主状态机当前所处的状态
     m_method = GET;                          // 请求方法
 
-    bzero(m_real_file, FILENAME_LEN); // 存储文件的真实文件路径，doc_root + m_url
     m_url = nullptr;                    // 请求目标文件的文件名
-    m_version = nullptr;                // 协议版本，这里只支持1.1
+    m_version = nullptr;                // 协议版本，支持1.0和1.1
     m_host = nullptr;                   // 请求主机名
     m_content_length = 0;               // 请求体的总长度
+    m_content_read = 0;
+    m_deferred = false;
     m_linger = false;
+    m_accept_gzip = false;
+    m_gzip = false;
+    m_vary = false;
+    m_body = nullptr;
+    m_cache_policy = nullptr;
+    m_file_size = 0;
+}
+
+bool Http_Connect::acquire_read_buf()
+{
+    BufferPool *pool = BufferPool::get_instance();
+    if (!(m_read_buf = pool->acquire(READ_BUFFER_SIZE)))
+    {
+        return false;
+    }
+    // 请求头表只在解析和处理请求时使用，不放在连接对象中
+    if (!(m_headers = (HeaderTable *)pool->acquire(sizeof(HeaderTable))))
+    {
+        pool->release(m_read_buf, READ_BUFFER_SIZE);
+        m_read_buf = nullptr;
+        return false;
+    }
+    m_read_size = READ_BUFFER_SIZE;
+    new (m_headers) HeaderTable();
+    m_headers->reset(m_read_buf);
+    return true;
+}
+
+void Http_Connect::release_buffer()
+{
+    release_write_buf();
+    if (m_read_buf)
+    {
+        BufferPool *pool = BufferPool::get_instance();
+        pool->release(m_read_buf, m_read_size);
+        pool->release((char *)m_headers, sizeof(HeaderTable));
+        m_read_buf = nullptr;
+        m_headers = nullptr;
+    }
+}
 
-    bzero(m_write_buf, WRITE_BUFFER_SIZE);
+void Http_Connect::release_write_buf()
+{
+    BufferPool *pool = BufferPool::get_instance();
+    clear_queue();
+    if (m_queue)
+    {
+        pool->release((char *)m_queue, sizeof(ResponseQueue));
+        m_queue = nullptr;
+    }
+    if (m_write_buf)
+    {
+        pool->release(m_write_buf, WRITE_BUFFER_SIZE);
+        m_write_buf = nullptr;
+    }
     m_write_idx = 0;
-    m_file_address = nullptr;
-    m_iv_count = 0;
+}
+
+void Http_Connect::compact_read_buf()
+{
+    // 请求体不需要整个放在缓存区中，已经交给处理函数的部分用后面的数据覆盖掉，
+    // 请求体从 m_start_line 开始，请求头要留到请求处理完
+    if (m_check_state == CHECK_STATE_CONTENT && m_checked_idx > m_start_line)
+    {
+        memmove(m_read_buf + m_start_line, m_read_buf + m_checked_idx, m_read_idx - m_checked_idx);
+        m_read_idx -= m_checked_idx - m_start_line;
+        m_checked_idx = m_start_line;
+    }
+
+    int start = m_request_start;
+    if (start == 0)
+    {
+        return;
+    }
+
+    memmove(m_read_buf, m_read_buf + start, m_read_idx - start);
+    m_read_idx -= start;
+    m_checked_idx -= start;
+    m_start_line -= start;
+    m_request_start = 0;
+    if (m_colon_idx != -1)
+    {
+        m_colon_idx -= start;
+    }
 
-    byte_to_send = 0;
-    byte_have_send = 0;
+    // 解析了一半的请求中指向读缓存区的位置也要跟着移动
+    if (m_url)
+    {
+        m_url -= start;
+    }
+    if (m_version)
+    {
+        m_version -= start;
+    }
+    if (m_host)
+    {
+        m_host -= start;
+    }
+    m_headers->shift(start);
 }
 
 bool Http_Connect::read()
 {
-    // 一次性缓存区都读取
-    // std::cout << "一次性读完\n";
-
-    // 如果读到的缓存区的位置大于缓存区的大小
-    if (m_read_idx >= READ_BUFFER_SIZE)
+    // 有数据到来才申请读缓存区
+    if (!m_read_buf && !acquire_read_buf())
     {
         return false;
     }
@@ -147,9 +446,15 @@ bool Http_Connect::read()
     int bytes_read = 0;
     while (true)
     {
-        // 从m_read_buf + m_read_idx索引出开始保存数据，大小是READ_BUFFER_SIZE - m_read_idx
+        // 缓存区满了又腾不出空间，先处理已经收到的，处理之后再继续读
+        if (m_read_idx == m_read_size && !make_room(1))
+        {
+            break;
+        }
+
+        // 从m_read_buf + m_read_idx索引出开始保存数据，大小是m_read_size - m_read_idx
         bytes_read = recv(m_sockfd, m_read_buf + m_read_idx,
-                          READ_BUFFER_SIZE - m_read_idx, 0);
+                          m_read_size - m_read_idx, 0);
 
         if (bytes_read == -1)
         {
@@ -174,51 +479,113 @@ bool Http_Connect::read()
         m_read_idx += bytes_read;
     }
 
-    // std::cout << "读取到的数据\n" << m_read_buf << std::endl;
+    return true;
+}
+
+bool Http_Connect::feed(const char *data, int len)
+{
+    if (!m_read_buf && !acquire_read_buf())
+    {
+        return false;
+    }
+    // 读缓存区放不下了
+    if (m_read_size - m_read_idx < len && !make_room(len))
+    {
+        return false;
+    }
+
+    memcpy(m_read_buf + m_read_idx, data, len);
+    m_read_idx += len;
+    return true;
+}
+
+bool Http_Connect::make_room(int need)
+{
+    compact_read_buf();
+    if (m_read_size - m_read_idx >= need)
+    {
+        return true;
+    }
+
+    // 成倍扩大，最大到请求头上限的两倍，这样请求头之后总还有地方放请求体，
+    // HTTP/2要放得下一个最大的帧
+    int size = m_read_size;
+    int max_size = m_h2 ? Http2Session::READ_BUFFER_SIZE : m_max_header_size * 2;
+    while (size < max_size && size - m_read_idx < need)
+    {
+        size = size * 2 < max_size ? size * 2 : max_size;
+    }
+    if (size - m_read_idx < need)
+    {
+        return false;
+    }
+
+    BufferPool *pool = BufferPool::get_instance();
+    char *buf = pool->acquire(size);
+    if (!buf)
+    {
+        return false;
+    }
+    memcpy(buf, m_read_buf, m_read_idx);
+
+    // 解析了一半的请求中指向读缓存区的指针换到新的缓存区
+    if (m_url)
+    {
+        m_url = buf + (m_url - m_read_buf);
+    }
+    if (m_version)
+    {
+        m_version = buf + (m_version - m_read_buf);
+    }
+    if (m_host)
+    {
+        m_host = buf + (m_host - m_read_buf);
+    }
+    m_headers->rebase(buf);
+
+    pool->release(m_read_buf, m_read_size);
+    m_read_buf = buf;
+    m_read_size = size;
     return true;
 }
 
 // 解析http的一行数据，判断依据为\r\n
-// 其实是获取一行数据
+// 其实是获取一行数据，用 scan_line 一次找到行尾和行中第一个':'
 Http_Connect::LINE_STATE Http_Connect::parse_line()
 {
-    char temp;
+    const char *colon = nullptr;
+    const char *end = m_read_buf + m_read_idx;
+    const char *eol = scan_line(m_read_buf + m_checked_idx, end, &colon);
+    // 一行可能分几次读到，只记录这一行的第一个':'
+    if (colon && m_colon_idx == -1)
+    {
+        m_colon_idx = colon - m_read_buf;
+    }
+    m_checked_idx = eol - m_read_buf;
 
-    for (; m_checked_idx < m_read_idx; m_checked_idx++)
+    if (eol == end)
+    {
+        // 没有找到行尾，数据不完整
+        return LINE_OPEN;
+    }
+    if (eol[0] == '\r')
     {
-        temp = m_read_buf[m_checked_idx];
-        if (temp == '\r')
+        if (eol + 1 == end)
         {
-            if ((m_checked_idx + 1 == m_read_idx))
-            {
-                // 发现到\r就结束了，那么数据不完整
-                return LINE_OPEN;
-            }
-            else if (m_read_buf[m_checked_idx + 1] == '\n')
-            {
-                // 匹配到\r\n
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            // 数据错误
-            return LINE_BAD;
+            // 发现到\r就结束了，那么数据不完整，下一次从\r开始继续找
+            return LINE_OPEN;
         }
-        else if (temp == '\n')
+        if (eol[1] != '\n')
         {
-            // 匹配到\n，检查\r
-            if ((m_checked_idx > 1) && (m_read_buf[m_checked_idx - 1] == '\r'))
-            {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            // 数据错误
             return LINE_BAD;
         }
+        // 匹配到\r\n
+        m_read_buf[m_checked_idx++] = '\0';
+        m_read_buf[m_checked_idx++] = '\0';
+        return LINE_OK;
     }
-
-    return LINE_OPEN;
+    // 单独的\n，数据错误
+    return LINE_BAD;
 }
 
 // 解析http请求行，获取请求方法，目标URL， HTTP版本
@@ -242,6 +609,14 @@ Http_Connect::HTTP_CODE Http_Connect::parse_request_line(char *text)
     {
         m_method = GET;
     }
+    else if (strcasecmp(method, "POST") == 0)
+    {
+        m_method = POST;
+    }
+    else if (strcasecmp(method, "PUT") == 0)
+    {
+        m_method = PUT;
+    }
     else
     {
         return BAD_REQUEST;
@@ -256,7 +631,16 @@ Http_Connect::HTTP_CODE Http_Connect::parse_request_line(char *text)
     // /index.html\0HTTP/1.1
     *m_version = '\0';
     m_version++;
-    if (strcasecmp(m_version, "HTTP/1.1") != 0)
+    // HTTP/1.1默认保持连接，HTTP/1.0默认关闭，Connection 请求头可以改变
+    if (strcasecmp(m_version, "HTTP/1.1") == 0)
+    {
+        m_linger = true;
+    }
+    else if (strcasecmp(m_version, "HTTP/1.0") == 0)
+    {
+        m_linger = false;
+    }
+    else
     {
         return BAD_REQUEST;
     }
@@ -276,13 +660,14 @@ Http_Connect::HTTP_CODE Http_Connect::parse_request_line(char *text)
     }
 
     // 检查状态变成检查头
+    m_headers->reset(m_read_buf);
     m_check_state = CHECK_STATE_HEADER;
 
     return NO_REQUEST;
 }
 
-// 解析http的一个头部信息
-Http_Connect::HTTP_CODE Http_Connect::parse_request_headers(char *text)
+// 解析http的一个头部信息，colon为扫描这一行时找到的第一个':'
+Http_Connect::HTTP_CODE Http_Connect::parse_request_headers(char *text, char *colon)
 {
     // 遇到空行，表示解析头完毕
     if (text[0] == '\0') {
@@ -290,60 +675,97 @@ Http_Connect::HTTP_CODE Http_Connect::parse_request_headers(char *text)
         // 状态机转移到CHECK_STATE_CONTENT
         if (m_content_length != 0) {
             m_check_state = CHECK_STATE_CONTENT;
+            m_content_read = 0;
             return NO_REQUEST;
         }
 
         //否则说明我们已经到达边界，已经解析完http请求头内容
         return GET_REQUEST;
-    } 
-    else if (strncasecmp(text, "Host:", 5) == 0)
+    }
+
+    // 没有':'的请求头是错误的
+    if (!colon)
+    {
+        return BAD_REQUEST;
+    }
+
+    // 名字为 [text, colon)，值为':'之后去掉前后空格和制表符的部分
+    // 这一行刚刚解析完，行尾的\r\n已经换成了\0\0
+    char *value = colon + 1;
+    char *end = m_read_buf + m_checked_idx - 2;
+    while (value < end && (*value == ' ' || *value == '\t'))
     {
-        text += 5;
-        /* 
-            strspn函数会在str1中从左到右扫描每个字符，直到遇到第一个不在str2中的字符为止，
-            并返回此时已经扫描过的str1的前缀长度。
-            如果str1中的所有字符都在str2中出现过，则返回str1的长度。
-        */
-       text += strspn(text, " \t"); // 转移到空格和制表符后面
-       m_host = text;
+        value++;
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0) {
-        text += 11;
-        text += strspn(text, " \t");
-        // 判断是不是长连接
-        if (strncasecmp(text, "keep-alive", 10))
-        {
-            m_linger = true;
-        }
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+    {
+        end--;
     }
-    else if (strncasecmp(text, "Content-Length:", 15) == 0)
+    *end = '\0';
+
+    HEADER_NAME id;
+    if (!m_headers->add(text, colon - text, value, end - value, id))
     {
-        text += 15;
-        text += strspn(text, " \t");
-        // 获取了请求体的长度大小
-        m_content_length = atol(text);
+        // 请求头太多了
+        return BAD_REQUEST;
     }
-    else 
+
+    // 影响请求解析和连接的请求头在这里处理，其他的需要时从 m_headers 中取
+    switch (id)
     {
-        printf("oop! unknow header %s\n", text);
+    case HEADER_HOST:
+        m_host = value;
+        break;
+    case HEADER_CONNECTION:
+        parse_connection(value, m_linger);
+        break;
+    case HEADER_CONTENT_LENGTH:
+    {
+        // 获取了请求体的长度大小
+        long length = atol(value);
+        if (length < 0 || length > INT_MAX)
+        {
+            return BAD_REQUEST;
+        }
+        m_content_length = length;
+        break;
+    }
+    case HEADER_TRANSFER_ENCODING:
+        // 不支持分块传输的请求体，不知道请求在哪里结束，之后的请求也没法解析了
+        return BAD_REQUEST;
+    case HEADER_ACCEPT_ENCODING:
+        m_accept_gzip = accept_gzip(value);
+        break;
+    default:
+        break;
     }
 
     return NO_REQUEST;
 }
 
 
-// 我们没有真正解析http的请求体，只是判断有没有完整的读入了
+// 请求体收到一段就交给处理函数一段，交出去的部分之后整理读缓存区时会被覆盖
 Http_Connect::HTTP_CODE Http_Connect::parse_request_content(char * text)
 {
-    if (m_read_idx >= m_content_length + m_checked_idx)
+    int len = m_read_idx - m_checked_idx;
+    if (len > m_content_length - m_content_read)
     {
-        // 条件满足时，其实就是解析完成了请求头，请求体的长度 + 解析到的长度
-        // 而 text 就是就是请求体的起始地址
-        text[m_content_length] = '\0';
-        return GET_REQUEST;
+        // 后面是流水线上的下一个请求
+        len = m_content_length - m_content_read;
     }
 
-    return NO_REQUEST;
+    if (len > 0)
+    {
+        m_checked_idx += len;
+        m_content_read += len;
+        bool last = m_content_read == m_content_length;
+        if (m_body_handler && !m_body_handler(this, text, len, last))
+        {
+            return BAD_REQUEST;
+        }
+    }
+
+    return m_content_read == m_content_length ? GET_REQUEST : NO_REQUEST;
 }
 
 // 主状态机，解析请求
@@ -355,16 +777,46 @@ Http_Connect::HTTP_CODE Http_Connect::process_read()
 
     char *text = nullptr;
 
-    // 解析到了一行完整的数据，或者解析到了请求体就不用一行一行解析，而是一整个解析
-    while ((line_state = parse_line()) == LINE_OK 
-        || ((m_check_state == CHECK_STATE_CONTENT) && (line_state == LINE_OK)))
+    while (true)
     {
+        // 请求体不用一行一行解析，而是一整个解析
+        if (m_check_state == CHECK_STATE_CONTENT)
+        {
+            // 请求体可能很大，处理函数做什么也不知道，交给工作线程
+            if (m_inline)
+            {
+                return OFFLOAD_REQUEST;
+            }
+            ret = parse_request_content(m_read_buf + m_checked_idx);
+            if (ret == GET_REQUEST)
+            {
+                return do_request();
+            }
+            // 请求尚未完整，或者处理函数出错
+            return ret;
+        }
+
+        // 解析到了一行完整的数据才继续，请求行和请求头加起来不能超过上限
+        line_state = parse_line();
+        if (m_checked_idx - m_request_start > m_max_header_size)
+        {
+            return BAD_REQUEST;
+        }
+        if (line_state == LINE_OPEN)
+        {
+            return NO_REQUEST;
+        }
+        if (line_state == LINE_BAD)
+        {
+            return BAD_REQUEST;
+        }
 
         // 获取行的起始地址，就是获取一行数据
         text = get_line();
+        char *colon = m_colon_idx == -1 ? nullptr : m_read_buf + m_colon_idx;
+        m_colon_idx = -1;
 
         m_start_line = m_checked_idx;
-        printf("got 1 http line : %s\n", text);
 
         // 有限状态机，看判断主状态机的状态
         switch (m_check_state)
@@ -383,7 +835,7 @@ Http_Connect::HTTP_CODE Http_Connect::process_read()
             case CHECK_STATE_HEADER:
             {
                 // 解析请求头
-                ret = parse_request_headers(text);
+                ret = parse_request_headers(text, colon);
                 if (ret == BAD_REQUEST)
                 {
                     return BAD_REQUEST;
@@ -396,316 +848,1189 @@ Http_Connect::HTTP_CODE Http_Connect::process_read()
                 break;
             }
 
-            case CHECK_STATE_CONTENT:
-            {
-                // 解析请求体
-                ret = parse_request_content(text);
-
-                if (ret == GET_REQUEST)
-                {
-                    return do_request();
-                }
-                // 失败表示请求尚未完整
-                line_state = LINE_OPEN;
-                break;
-            }
-
             default:
             {
                 return INTERNAL_ERROR;
             }
         }
     }
-
-    return NO_REQUEST;
 }
 
 
 
 // 当得到一个完整、正确的HTTP请求时，我们就分析目标文件的属性，
-// 如果目标文件存在、对所有用户可读，且不是目录，则使用mmap将其
-// 映射到内存地址m_file_address处，并告诉调用者获取文件成功
+// 如果目标文件存在、对所有用户可读，且不是目录，则打开文件，
+// 之后用sendfile直接发送，并告诉调用者获取文件成功
 Http_Connect::HTTP_CODE Http_Connect::do_request()
 {
     // 根目录 /home/nowcoder/webserver/resources
-    // 先将根目录获取到
-    strcpy(m_real_file, doc_root);
+    // 文件的真实路径只在这里用到，放在栈上，doc_root + m_url
+    char real_file[FILENAME_LEN];
+    strcpy(real_file, doc_root);
     int len = strlen(doc_root);
     // 留一个空字符的位置
-    strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
-
-    if (stat(m_real_file, &m_file_stat) < 0)
+    strncpy(real_file + len, m_url, FILENAME_LEN - len - 1);
+    real_file[FILENAME_LEN - 1] = '\0';
+
+    // 从文件缓存中取得打开的文件和它的状态，缓存命中时没有任何系统调用
+    // 在reactor中直接处理时只用缓存中不需要重新检查的文件，打开文件交给工作线程
+    int err = 0;
+    m_file = FileCache::get_instance()->acquire(real_file, err, m_inline);
+    if (!m_file)
     {
-        // stat函数调用失败, 认为没有这个资源
-        return NO_REQUEST;
+        if (err == EWOULDBLOCK)
+        {
+            m_deferred = true;
+            return OFFLOAD_REQUEST;
+        }
+        // 打开失败, 认为没有这个资源
+        return err == EACCES ? FORBIDDEN_REQUEST : NO_RESOURCE;
     }
 
+    /*
+        目标文件的状态
+        st_mode：文件类型和权限，包括文件类型、访问权限、特殊权限等。
+        st_size：文件大小（字节数）。
+    */
+    const struct stat &file_stat = m_file->st;
+
     // 判断访问的权限
     // S_IROTH 是 stat 的宏，表明其他用户的可读权限
-    if (!(m_file_stat.st_mode & S_IROTH))
+    if (!(file_stat.st_mode & S_IROTH))
     {
+        close_file();
         return FORBIDDEN_REQUEST;
     }
 
     // 判断是否是目录
-    if (S_ISDIR(m_file_stat.st_mode))
+    if (S_ISDIR(file_stat.st_mode))
     {
+        close_file();
         return BAD_REQUEST;
     }
     // 判断文件类型也可以用以下方法
     // if ((m_file_stat.st_mode & S_IFMT) == S_IFDIR)
 
-    // 只读方式打开文件
-    int fd = open(m_real_file, O_RDONLY);
-    // 创建内存映射
-    m_file_address = (char * ) mmap(nullptr, m_file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // 不需要内存映射，发送时由内核直接从页缓存拷贝到socket
+    m_file_size = file_stat.st_size;
+    m_cache_policy = find_cache_policy(m_url);
 
-    if (m_file_address == nullptr)
+    // 文本类的文件可以发送压缩的版本，响应要带上 Vary 让中间的缓存区分
+    if (is_compressible(real_file))
     {
-        perror("mmap");
-        exit(-1);
+        m_vary = true;
+        // 区间是按原文件的偏移算的，Range请求不压缩
+        if (m_accept_gzip && !want_range() && !negotiate_gzip(real_file))
+        {
+            close_file();
+            m_deferred = true;
+            return OFFLOAD_REQUEST;
+        }
     }
 
-    close(fd);
-    // 数据内存映射成功
+    // 验证器在文件缓存项中，判断客户端的缓存是否有效不需要读文件，只有GET可以回复304
+    if (m_method == GET && not_modified())
+    {
+        return NOT_MODIFIED;
+    }
     return FILE_REQUEST;
 }
 
-
-void Http_Connect::unmap()
+bool Http_Connect::not_modified() const
 {
-    if (m_file_address)
+    // 同时有两个时只看 If-None-Match
+    HeaderView etags = m_headers->get(HEADER_IF_NONE_MATCH);
+    if (etags.data)
     {
-        munmap(m_file_address, sizeof(m_file_address));
-        m_file_address = nullptr;
+        return match_etag(etags, m_file->etag, m_file->etag_len, m_body ? "-gz" : "", true);
     }
+
+    HeaderView since = m_headers->get(HEADER_IF_MODIFIED_SINCE);
+    time_t t;
+    return since.data && parse_http_date(since.data, since.len, t) && m_file->st.st_mtime <= t;
 }
 
-bool Http_Connect::write()
+bool Http_Connect::want_range() const
 {
-    // 一次性写
-    int temp = 0;
+    // Range只对GET有效
+    if (m_method != GET || !m_headers->has(HEADER_RANGE))
+    {
+        return false;
+    }
 
-    if (byte_to_send == 0)
+    // If-Range 的值是ETag或者日期，和文件现在的一样才发送一部分，否则发送整个文件
+    HeaderView value = m_headers->get(HEADER_IF_RANGE);
+    if (!value.data)
     {
-        modifyfd(m_epollfd, m_sockfd, EPOLLIN);
-        init();
         return true;
     }
-
-    while (1)
+    if ((value.len > 0 && value.data[0] == '"') || (value.len > 1 && value.data[0] == 'W' && value.data[1] == '/'))
     {
-        // 分散写
-        temp = writev(m_sockfd, m_iv, m_iv_count);
-        if (temp == -1)
-        {
+        return match_etag(value, m_file->etag, m_file->etag_len, "", false);
+    }
+    time_t t;
+    return parse_http_date(value.data, value.len, t) && t == m_file->st.st_mtime;
+}
+
+bool Http_Connect::negotiate_gzip(const char *real_file)
+{
+    // 优先使用预先压缩好的 file.gz，它不能比原文件旧；
+    // 最近确认过没有 .gz 文件时不再去打开，不用每个请求都多一次失败的open
+    char gz_file[FILENAME_LEN];
+    if (!FileCache::gzip_missing(m_file) && snprintf(gz_file, FILENAME_LEN, "%s.gz", real_file) < FILENAME_LEN)
+    {
+        int err = 0;
+        FileEntry *gz = FileCache::get_instance()->acquire(gz_file, err, m_inline);
+        if (!gz && err == EWOULDBLOCK)
+        {
+            return false;
+        }
+        if (!gz && err == ENOENT)
+        {
+            FileCache::set_gzip_missing(m_file);
+        }
+        if (gz && S_ISREG(gz->st.st_mode) && (gz->st.st_mode & S_IROTH) &&
+            gz->st.st_mtime >= m_file->st.st_mtime)
+        {
+            close_file();
+            m_file = gz;
+            m_file_size = gz->st.st_size;
+            m_gzip = true;
+            return true;
+        }
+        FileCache::release(gz);
+    }
+
+    // 没有 .gz 文件的小文件在内存中压缩，压缩的结果和文件缓存项一起缓存
+    if (m_file_size <= FileEntry::SMALL_FILE_SIZE)
+    {
+        // 第一次压缩要读文件，交给工作线程
+        if (m_inline && m_file->gzip_len.load(std::memory_order_relaxed) == 0)
+        {
+            return false;
+        }
+        int len = 0;
+        const char *gzip = FileCache::get_gzip(m_file, len);
+        if (gzip)
+        {
+            m_body = gzip;
+            m_file_size = len;
+            m_gzip = true;
+        }
+    }
+    return true;
+}
+
+
+void Http_Connect::close_file()
+{
+    if (m_file)
+    {
+        FileCache::release(m_file);
+        m_file = nullptr;
+    }
+}
+
+bool Http_Connect::write()
+{
+    m_throttle_ms = 0;
+    if (!m_queue || m_queue->head == m_queue->tail)
+    {
+        modifyfd(m_epollfd, m_sockfd, EPOLLIN);
+        init();
+        return true;
+    }
+
+    switch (send_response())
+    {
+    case WRITE_DONE:
+        // 读缓存区中还有没处理的请求时由reactor交给工作线程，不用等读事件
+        if (!has_pending())
+        {
+            modifyfd(m_epollfd, m_sockfd, EPOLLIN);
+        }
+        return true;
+    case WRITE_AGAIN:
+        modifyfd(m_epollfd, m_sockfd, EPOLLOUT);
+        return true;
+    case WRITE_THROTTLED:
+        // 超过了限速，不注册EPOLLOUT，reactor的定时器到期之后再注册
+        return true;
+    default:
+        return false;
+    }
+}
+
+Http_Connect::WRITE_STATE Http_Connect::send_response()
+{
+    // 一次最多写一个窗口，发送的位置保存在响应队列中，下一次写事件从那里继续
+    ssize_t temp = 0;
+    m_throttle_ms = 0;
+
+    off_t budget = send_budget(m_throttle_ms);
+    if (budget == 0)
+    {
+        return WRITE_THROTTLED;
+    }
+
+    off_t sent = 0;
+    while (1)
+    {
+        if (sent >= budget)
+        {
+            // 窗口用完了，socket可能还可写，先让reactor处理别的连接
+            return WRITE_AGAIN;
+        }
+
+        int count = 0;
+        struct iovec *iov = get_iov(count);
+        off_t offset, len;
+        int file_fd = get_file(offset, len);
+        if (count)
+        {
+            // 多个响应的内存部分聚合成一次发送，后面还有文件时带上MSG_MORE，
+            // 让内核把它们和文件的开头合并成一个报文
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            temp = sendmsg(m_sockfd, &msg, file_fd != -1 ? MSG_MORE : 0);
+        }
+        else
+        {
+            // 文件内容由内核直接从页缓存发送，offset 是局部变量，发送的位置由 update_iov 更新
+            temp = sendfile(m_sockfd, file_fd, &offset, len < budget - sent ? len : budget - sent);
+        }
+
+        if (temp == -1)
+        {
             // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
             // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
-            if (errno == EAGAIN)
-            {
-                modifyfd(m_epollfd, m_sockfd, EPOLLOUT);
-            }
+            return errno == EAGAIN ? WRITE_AGAIN : WRITE_ERROR;
         }
 
-        byte_to_send -= temp;
-        byte_have_send += temp;
+        sent += temp;
+        if (update_iov(temp))
+        {
+            // 没有数据需要发送了，不保持连接时返回错误，由调用者关闭
+            return finish_write() ? WRITE_DONE : WRITE_ERROR;
+        }
+    }
+}
 
-        if (byte_have_send >= m_iv[0].iov_len)
+struct iovec *Http_Connect::get_iov(int &count)
+{
+    count = 0;
+    for (int i = m_queue->head; i < m_queue->tail; i++)
+    {
+        const Response &response = m_queue->items[i];
+        if (response.head_len > 0)
+        {
+            m_queue->iov[count].iov_base = (void *)response.head;
+            m_queue->iov[count].iov_len = response.head_len;
+            count++;
+        }
+        if (response.len > 0)
         {
-            m_iv[1].iov_base = m_file_address + byte_have_send - m_write_idx;
-            m_iv[1].iov_len = byte_to_send;
+            m_queue->iov[count].iov_base = (void *)response.data;
+            m_queue->iov[count].iov_len = response.len;
+            count++;
         }
-        else 
+        // 文件的内容不能和后面的响应一起聚合发送
+        if (response.file_len > 0)
         {
-            m_iv[0].iov_base = m_write_buf + byte_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - temp;
+            break;
         }
+    }
+    return m_queue->iov;
+}
 
-        if (byte_to_send <= 0)
+int Http_Connect::get_file(off_t &offset, off_t &len) const
+{
+    for (int i = m_queue->head; i < m_queue->tail; i++)
+    {
+        const Response &response = m_queue->items[i];
+        if (response.file_len > 0)
         {
-            // 没有数据需要发送了
-            unmap();
-            modifyfd(m_epollfd, m_sockfd, EPOLLIN);
+            offset = response.file_offset;
+            len = response.file_len;
+            return response.file->fd;
+        }
+    }
+    offset = 0;
+    len = 0;
+    return -1;
+}
 
-            if (m_linger)
-            {
-                init();
-                return true;
-            }
-            else 
-            {
-                return false;
-            }
+bool Http_Connect::update_iov(off_t bytes)
+{
+    if (m_send_rate > 0)
+    {
+        m_send_credit -= bytes * 1000;
+    }
 
+    while (m_queue->head < m_queue->tail)
+    {
+        Response &response = m_queue->items[m_queue->head];
+
+        // 依次是写缓存区中的响应头，文件缓存中的内容，文件
+        off_t sent = bytes < response.head_len ? bytes : response.head_len;
+        response.head += sent;
+        response.head_len -= sent;
+        bytes -= sent;
+        if (response.head_len == 0)
+        {
+            sent = bytes < response.len ? bytes : response.len;
+            response.data += sent;
+            response.len -= sent;
+            bytes -= sent;
+        }
+        if (response.head_len == 0 && response.len == 0)
+        {
+            sent = bytes < response.file_len ? bytes : response.file_len;
+            response.file_offset += sent;
+            response.file_len -= sent;
+            bytes -= sent;
         }
 
+        if (response.head_len > 0 || response.len > 0 || response.file_len > 0)
+        {
+            // 这个响应只发送了一部分
+            return false;
+        }
+
+        // 这个响应发送完了，文件还给文件缓存
+        FileCache::release(response.file);
+        response.file = nullptr;
+        m_queue->head++;
     }
+    return true;
+}
 
+off_t Http_Connect::send_budget(int &delay_ms)
+{
+    // 不限速时也记下发送的时刻，工作线程直接发送之后reactor按它计算空闲超时
+    delay_ms = 0;
+    unsigned long long now = TimerWheel::now_ms();
+    if (m_send_rate <= 0)
+    {
+        m_send_stamp = now;
+        return SEND_WINDOW;
+    }
+
+    // 令牌桶，令牌以千分之一字节为单位按经过的毫秒数补充，没有舍入的损失，最多攒一个窗口
+    m_send_credit += (long long)(now - m_send_stamp) * m_send_rate;
+    m_send_stamp = now;
+    if (m_send_credit > SEND_WINDOW * 1000)
+    {
+        m_send_credit = SEND_WINDOW * 1000;
+    }
+
+    // 至少攒够50毫秒的量再发送，不发送很小的片段
+    long long quantum = m_send_rate / 20 > 0 ? (long long)m_send_rate / 20 * 1000 : 1000;
+    if (quantum > SEND_WINDOW * 1000)
+    {
+        quantum = SEND_WINDOW * 1000;
+    }
+    if (m_send_credit < quantum)
+    {
+        delay_ms = (quantum - m_send_credit + m_send_rate - 1) / m_send_rate;
+        return 0;
+    }
+    return m_send_credit / 1000 < SEND_WINDOW ? m_send_credit / 1000 : SEND_WINDOW;
+}
+
+bool Http_Connect::take_sent_direct()
+{
+    bool sent = m_sent_direct;
+    m_sent_direct = false;
+    return sent;
+}
+
+bool Http_Connect::resume_write()
+{
+    if (m_throttle_ms == 0)
+    {
+        return false;
+    }
+    m_throttle_ms = 0;
+    modifyfd(m_epollfd, m_sockfd, EPOLLOUT);
     return true;
 }
 
-bool Http_Connect::add_reponse(const char * format, ...)
+bool Http_Connect::finish_write()
 {
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
+    bool linger = is_linger();
+    if (!linger)
     {
         return false;
     }
 
-    va_list arg_list;
-    va_start(arg_list, format);
-    /*
-        vsnprintf是C语言中的一个函数，用于格式化字符串。
-        它的作用类似于printf函数，但使用可变数量的参数而非固定数量的参数。
-        vsnprintf函数的第一个参数为目标缓冲区，第二个参数为缓冲区大小，第三个参数为格式化字符串，
-        后面的参数为可变数量的参数列表。
-        自动最后填空格
-    */
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - m_write_idx,
-        format, arg_list);
+    if (m_request_start == m_read_idx)
+    {
+        // 没有剩下的请求，缓存区都还给缓存池
+        init();
+        return true;
+    }
 
-    if (len >= WRITE_BUFFER_SIZE - m_write_idx - 1)
-    {// 读取的长度大于缓存区长度
+    // 流水线上还有请求，留下没处理的数据，响应用的缓存区先还回去
+    release_write_buf();
+    compact_read_buf();
+    return true;
+}
+
+bool Http_Connect::can_queue() const
+{
+    if (!m_queue || m_queue->tail == 0)
+    {
+        return true;
+    }
+    // 不保持连接的响应之后的请求不再处理
+    return m_queue->linger && m_queue->tail < MAX_PIPELINE &&
+           WRITE_BUFFER_SIZE - m_write_idx >= RESPONSE_RESERVE;
+}
+
+void Http_Connect::push_response(int start, const char *data, int len, FileEntry *file, off_t file_offset, off_t file_len)
+{
+    Response &response = m_queue->items[m_queue->tail++];
+    response.head = m_write_buf + start;
+    response.head_len = m_write_idx - start;
+    response.data = data;
+    response.len = len;
+    response.file = file;
+    response.file_offset = file_offset;
+    response.file_len = file_len;
+    m_queue->linger = m_linger;
+}
+
+void Http_Connect::clear_queue()
+{
+    if (!m_queue)
+    {
+        return;
+    }
+    for (int i = m_queue->head; i < m_queue->tail; i++)
+    {
+        FileCache::release(m_queue->items[i].file);
+    }
+    m_queue->head = 0;
+    m_queue->tail = 0;
+}
+
+bool Http_Connect::add_bytes(const char *data, int len)
+{
+    if (len > WRITE_BUFFER_SIZE - m_write_idx)
+    {
         return false;
     }
+    memcpy(m_write_buf + m_write_idx, data, len);
     m_write_idx += len;
+    return true;
+}
 
-    va_end(arg_list);
+bool Http_Connect::add_number(long long value)
+{
+    if (value < 0 || WRITE_BUFFER_SIZE - m_write_idx < 20)
+    {
+        return false;
+    }
+    m_write_idx += format_uint(m_write_buf + m_write_idx, value);
     return true;
 }
 
-bool Http_Connect::add_status_line(int status, const char * title)
+bool Http_Connect::add_status_line(int status)
 {
-    return add_reponse("%s %d %s\r\n", "HTTP/1.1", status, title);
+    bool ret;
+    switch (status)
+    {
+        case 101:
+            ret = add_bytes(switching_101_line, sizeof(switching_101_line) - 1);
+            break;
+        case 200:
+            ret = add_bytes(ok_200_line, sizeof(ok_200_line) - 1);
+            break;
+        case 206:
+            ret = add_bytes(ok_206_line, sizeof(ok_206_line) - 1);
+            break;
+        case 304:
+            ret = add_bytes(not_modified_304_line, sizeof(not_modified_304_line) - 1);
+            break;
+        case 400:
+            ret = add_bytes(error_400_line, sizeof(error_400_line) - 1);
+            break;
+        case 403:
+            ret = add_bytes(error_403_line, sizeof(error_403_line) - 1);
+            break;
+        case 404:
+            ret = add_bytes(error_404_line, sizeof(error_404_line) - 1);
+            break;
+        case 416:
+            ret = add_bytes(error_416_line, sizeof(error_416_line) - 1);
+            break;
+        default:
+            ret = add_bytes(error_500_line, sizeof(error_500_line) - 1);
+            break;
+    }
+
+    // 每个线程缓存的Date，每秒只格式化一次
+    int len = 0;
+    const char *date = date_header(len);
+    return ret && add_bytes(date, len);
 }
 
-bool Http_Connect::add_headers(int content_length)  
+bool Http_Connect::add_headers(off_t content_length)
 {
+    if (!add_bytes(server_header, sizeof(server_header) - 1)) { return false; }
     if (!add_content_length(content_length)) { return false; }
     if (!add_content_type()) { return false; }
     if (!add_linger()) { return false; }
+    if (!add_encoding()) { return false; }
     if (!add_blank_line()) { return false; }
     return true;
 }
 
-bool Http_Connect::add_content_length(int content_length)
+bool Http_Connect::add_content_length(off_t content_length)
 {
-    return add_reponse("Content-Length: %d\r\n", content_length);
+    return add_bytes(content_length_header, sizeof(content_length_header) - 1) &&
+           add_number(content_length) && add_bytes("\r\n", 2);
 }
 
 bool Http_Connect::add_linger()
 {
-    return add_reponse("Connection: %s\r\n", m_linger ? "keep-alive" : "close");
+    if (m_linger)
+    {
+        return add_bytes(keep_alive_header, sizeof(keep_alive_header) - 1);
+    }
+    return add_bytes(close_header, sizeof(close_header) - 1);
+}
+
+bool Http_Connect::add_encoding()
+{
+    if (m_gzip && !add_bytes(gzip_header, sizeof(gzip_header) - 1))
+    {
+        return false;
+    }
+    return !m_vary || add_bytes(vary_header, sizeof(vary_header) - 1);
 }
 
 bool Http_Connect::add_blank_line()
 {
-    return add_reponse("%s", "\r\n");
+    return add_bytes("\r\n", 2);
 }
 
-bool Http_Connect::add_content(const char * content)
+bool Http_Connect::add_content(const char *content, int len)
 {
-    return add_reponse("%s", content);
+    return add_bytes(content, len);
 }
 
 bool Http_Connect::add_content_type()
 {
-    return add_reponse("Content-Type: %s\r\n", "text/html");
+    return add_bytes(content_type_header, sizeof(content_type_header) - 1);
+}
+
+bool Http_Connect::add_content_range(off_t first, off_t last)
+{
+    return add_bytes(content_range_header, sizeof(content_range_header) - 1) &&
+           add_number(first) && add_bytes("-", 1) && add_number(last) && add_bytes("/", 1) &&
+           add_number(m_file_size) && add_bytes("\r\n", 2);
+}
+
+bool Http_Connect::add_validators()
+{
+    // 内存中压缩的内容是另一种表示，ETag加上后缀区分
+    return add_bytes(etag_header, sizeof(etag_header) - 1) && add_bytes(m_file->etag, m_file->etag_len) &&
+           (!m_body || add_bytes("-gz", 3)) && add_bytes("\"\r\n", 3) &&
+           add_bytes(last_modified_header, sizeof(last_modified_header) - 1) &&
+           add_bytes(m_file->last_modified, HTTP_DATE_LEN) && add_bytes("\r\n", 2);
+}
+
+bool Http_Connect::add_cache_control()
+{
+    return !m_cache_policy || add_bytes(m_cache_policy->cache_control, m_cache_policy->cache_control_len);
+}
+
+bool Http_Connect::add_expires()
+{
+    int len = 0;
+    const char *expires = m_cache_policy ? expires_header(m_cache_policy, len) : nullptr;
+    return !expires || add_bytes(expires, len);
+}
+
+bool Http_Connect::use_cached_response()
+{
+    if (m_file_size > FileEntry::SMALL_FILE_SIZE)
+    {
+        return false;
+    }
+
+    int index = response_index();
+    char *response = m_file->response[index].load(std::memory_order_acquire);
+    if (!response)
+    {
+        return false;
+    }
+
+    // 状态行、Date和Expires每次生成，后面的响应头和文件内容用缓存的，
+    // 缓存的内存属于文件缓存项，由响应队列持有它的引用
+    int start = m_write_idx;
+    if (!add_status_line(200) || !add_expires())
+    {
+        m_write_idx = start;
+        return false;
+    }
+    push_response(start, response, m_file->response_len[index].load(std::memory_order_relaxed), m_file, 0, 0);
+    m_file = nullptr;
+    return true;
+}
+
+void Http_Connect::cache_response(int start)
+{
+    if (m_file_size > FileEntry::SMALL_FILE_SIZE)
+    {
+        return;
+    }
+
+    int header_len = m_write_idx - start;
+    int len = header_len + m_file_size;
+    char *response = new char[len];
+    memcpy(response, m_write_buf + start, header_len);
+    if (m_body)
+    {
+        memcpy(response + header_len, m_body, m_file_size);
+    }
+    else if (pread(m_file->fd, response + header_len, m_file_size, 0) != m_file_size)
+    {
+        delete[] response;
+        return;
+    }
+
+    // 多个线程可能同时生成同一个响应，只保留先放进去的那个
+    int index = response_index();
+    char *expected = nullptr;
+    m_file->response_len[index].store(len, std::memory_order_relaxed);
+    if (!m_file->response[index].compare_exchange_strong(expected, response, std::memory_order_release))
+    {
+        delete[] response;
+    }
+}
+
+bool Http_Connect::prepare_write()
+{
+    // 有响应要发送才申请响应队列和写缓存区，流水线上的响应头依次放在写缓存区后面
+    if (!m_queue)
+    {
+        m_queue = (ResponseQueue *)BufferPool::get_instance()->acquire(sizeof(ResponseQueue));
+        if (!m_queue)
+        {
+            return false;
+        }
+        m_queue->head = 0;
+        m_queue->tail = 0;
+    }
+    return m_write_buf || (m_write_buf = BufferPool::get_instance()->acquire(WRITE_BUFFER_SIZE));
 }
 
 bool Http_Connect::process_write(Http_Connect::HTTP_CODE ret)
 {
+    if (!prepare_write())
+    {
+        return false;
+    }
+
+    if (ret == FILE_REQUEST && want_range())
+    {
+        ByteRange ranges[MAX_RANGES];
+        int count = parse_ranges(m_headers->get(HEADER_RANGE), m_file_size, ranges);
+        // 多个区间要占用队列中的多个位置和写缓存区中的多个分隔线，放不下时发送整个文件
+        if (count > 1 && (MAX_PIPELINE - m_queue->tail < count + 1 ||
+                          WRITE_BUFFER_SIZE - m_write_idx < RESPONSE_RESERVE + count * 160))
+        {
+            count = -1;
+        }
+        if (count >= 0)
+        {
+            return add_range_response(ranges, count);
+        }
+    }
+
+    // 小文件已经有生成好的响应了，只需要状态行和Date
+    if (ret == FILE_REQUEST && use_cached_response())
+    {
+        return true;
+    }
+
+    int start = m_write_idx;
     switch(ret)
     {
         case BAD_REQUEST:
+            // 请求的边界已经不可信了，发送完就关闭连接
+            m_linger = false;
+            // fall through
+        case NO_RESOURCE:
+        case FORBIDDEN_REQUEST:
+        case INTERNAL_ERROR:
         {
-            // 增加响应状态行
-            add_status_line(400, error_400_title);
-            // 响应状态头
-            add_headers(strlen(error_400_form));
-            if (!add_content(error_400_form))
+            int status = 0;
+            int len = 0;
+            const char *form = error_form(ret, status, len);
+            // 增加响应状态行和响应头
+            add_status_line(status);
+            add_headers(len);
+            if (!add_content(form, len))
             {
                 return false;
             }
             break;
         }
 
-        case NO_RESOURCE:
+        case FILE_REQUEST:
         {
-            add_status_line(404, error_404_title);
-            add_headers(strlen(error_404_form));
-            if (!add_content(error_404_form))
+            add_status_line(200);
+            add_expires();
+            int fixed = m_write_idx;
+            if (!add_bytes(accept_ranges_header, sizeof(accept_ranges_header) - 1) || !add_validators() ||
+                !add_cache_control() || !add_headers(m_file_size))
             {
                 return false;
             }
-            break;
+
+            // 这次照常发送，之后同样的请求直接使用缓存的响应，缓存的部分不含状态行、Date和Expires
+            cache_response(fixed);
+            if (m_body)
+            {
+                // 内容只在内存中，只能通过缓存的响应发送，刚生成的响应头不要了
+                m_write_idx = start;
+                return use_cached_response();
+            }
+            push_response(start, nullptr, 0, m_file, 0, m_file_size);
+            m_file = nullptr;
+            return true;
         }
 
-        case FORBIDDEN_REQUEST:
+        case NOT_MODIFIED:
         {
-            add_status_line(403, error_403_title);
-            add_headers(strlen(error_403_form));
-            if (!add_content(error_403_form))
+            // 没有响应体，响应头和200时一样带上验证器、缓存策略和Vary
+            bool ok = add_status_line(304) && add_bytes(server_header, sizeof(server_header) - 1) &&
+                      add_validators() && add_cache_control() && add_expires() && add_linger() && (!m_vary || add_bytes(vary_header, sizeof(vary_header) - 1)) &&
+                      add_blank_line();
+            close_file();
+            if (!ok)
             {
                 return false;
             }
             break;
         }
 
-        case FILE_REQUEST:
+        default:
+            return false;
+    }
+
+    push_response(start, nullptr, 0, nullptr, 0, 0);
+    return true;
+}
+
+const char *Http_Connect::error_form(HTTP_CODE ret, int &status, int &len)
+{
+    switch (ret)
+    {
+        case BAD_REQUEST:
+            status = 400;
+            len = sizeof(error_400_form) - 1;
+            return error_400_form;
+        case NO_RESOURCE:
+            status = 404;
+            len = sizeof(error_404_form) - 1;
+            return error_404_form;
+        case FORBIDDEN_REQUEST:
+            status = 403;
+            len = sizeof(error_403_form) - 1;
+            return error_403_form;
+        default:
+            status = 500;
+            len = sizeof(error_500_form) - 1;
+            return error_500_form;
+    }
+}
+
+const char *Http_Connect::cached_body() const
+{
+    if (m_body)
+    {
+        return m_body;
+    }
+    if (m_file_size > FileEntry::SMALL_FILE_SIZE)
+    {
+        return nullptr;
+    }
+
+    // 缓存的响应最后是文件的内容，长连接和短连接的都可以用
+    for (int index = m_gzip ? 2 : 0; index < (m_gzip ? 4 : 2); index++)
+    {
+        const char *response = m_file->response[index].load(std::memory_order_acquire);
+        if (response)
         {
-            add_status_line(200, ok_200_title);
-            add_headers(m_file_stat.st_size);
-            m_iv[0].iov_base = m_write_buf;
-            m_iv[0].iov_len = m_write_idx;
-            m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
+            return response + m_file->response_len[index].load(std::memory_order_relaxed) - m_file_size;
+        }
+    }
+    return nullptr;
+}
 
-            byte_to_send = m_write_idx + m_file_stat.st_size;
-            return true;
+int Http_Connect::parse_ranges(HeaderView value, off_t size, ByteRange *ranges)
+{
+    // bytes=0-99, 200-, -50
+    const char *p = value.data;
+    const char *end = p + value.len;
+    if (value.len < 6 || strncasecmp(p, "bytes=", 6) != 0)
+    {
+        return -1;
+    }
+    p += 6;
+
+    int count = 0;
+    bool any = false;
+    while (p < end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+        {
+            p++;
+        }
+        if (p == end)
+        {
+            break;
         }
 
-        case INTERNAL_ERROR:
+        off_t first = 0, last = 0;
+        bool has_first = parse_offset(p, end, first);
+        if (p == end || *p != '-')
+        {
+            return -1;
+        }
+        p++;
+        bool has_last = parse_offset(p, end, last);
+        while (p < end && (*p == ' ' || *p == '\t'))
+        {
+            p++;
+        }
+        if ((p < end && *p != ',') || (!has_first && !has_last) || (has_first && has_last && last < first))
+        {
+            return -1;
+        }
+        any = true;
+
+        // 超出文件的区间不能满足，跳过，结尾超出文件的截到文件结尾
+        if (!has_first)
         {
-            add_status_line(500, error_500_title);
-            add_headers(strlen(error_500_form));
-            if (!add_content(error_500_form))
+            // 最后的last个字节
+            if (last == 0 || size == 0)
             {
-                return false;
+                continue;
+            }
+            first = last >= size ? 0 : size - last;
+            last = size - 1;
+        }
+        else
+        {
+            if (first >= size)
+            {
+                continue;
+            }
+            if (!has_last || last >= size)
+            {
+                last = size - 1;
             }
-            break;
         }
 
-        default:
+        if (count == MAX_RANGES)
+        {
+            return -1;
+        }
+        ranges[count].first = first;
+        ranges[count].last = last;
+        count++;
+    }
+    return any ? count : -1;
+}
+
+bool Http_Connect::add_range_response(const ByteRange *ranges, int count)
+{
+    int start = m_write_idx;
+    if (count == 0)
+    {
+        // 没有一个区间能满足，告诉客户端文件的大小
+        close_file();
+        if (!add_status_line(416) || !add_bytes(server_header, sizeof(server_header) - 1) ||
+            !add_bytes(content_range_header, sizeof(content_range_header) - 1) || !add_bytes("*/", 2) ||
+            !add_number(m_file_size) || !add_bytes("\r\n", 2) || !add_content_length(0) ||
+            !add_linger() || !add_blank_line())
+        {
+            return false;
+        }
+        push_response(start, nullptr, 0, nullptr, 0, 0);
+        return true;
+    }
+
+    if (!add_status_line(206) || !add_bytes(server_header, sizeof(server_header) - 1) || !add_validators() ||
+        !add_cache_control() || !add_expires())
+    {
+        return false;
+    }
+
+    if (count == 1)
+    {
+        // 只发送文件中的这一段
+        off_t len = ranges[0].last - ranges[0].first + 1;
+        if (!add_content_range(ranges[0].first, ranges[0].last) || !add_content_length(len) ||
+            !add_content_type() || !add_linger() || !add_encoding() || !add_blank_line())
+        {
+            return false;
+        }
+        push_response(start, nullptr, 0, m_file, ranges[0].first, len);
+        m_file = nullptr;
+        return true;
+    }
+
+    // 每个区间之前的分隔线和区间的响应头长度可以算出来，先算出整个响应的长度
+    off_t length = sizeof(part_end) - 1;
+    int size_len = uint_len(m_file_size);
+    for (int i = 0; i < count; i++)
+    {
+        length += sizeof(part_begin) - 1 + sizeof(content_range_header) - 1 + uint_len(ranges[i].first) + 1 +
+                  uint_len(ranges[i].last) + 1 + size_len + 4;
+        length += ranges[i].last - ranges[i].first + 1;
+    }
+    if (!add_content_length(length) || !add_bytes(multipart_type_header, sizeof(multipart_type_header) - 1) ||
+        !add_linger() || !add_encoding() || !add_blank_line())
+    {
+        return false;
+    }
+
+    // 每个区间是队列中的一个响应，分隔线在写缓存区中，区间的内容从文件发送，
+    // 第一个区间的分隔线前面是整个响应的响应头，最后一个响应只有结束的分隔线。
+    // 每个响应都持有文件的一个引用，发送完一个区间就释放一个
+    for (int i = 0; i < count; i++)
+    {
+        if (!add_bytes(part_begin, sizeof(part_begin) - 1) ||
+            !add_content_range(ranges[i].first, ranges[i].last) || !add_blank_line())
+        {
             return false;
+        }
+        m_file->ref++;
+        push_response(start, nullptr, 0, m_file, ranges[i].first, ranges[i].last - ranges[i].first + 1);
+        start = m_write_idx;
     }
-    
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    byte_to_send = m_write_idx;
+    close_file();
+
+    if (!add_bytes(part_end, sizeof(part_end) - 1))
+    {
+        return false;
+    }
+    push_response(start, nullptr, 0, nullptr, 0, 0);
     return true;
 }
 
-void Http_Connect::process()
+bool Http_Connect::upgrade_h2(HTTP_CODE ret)
 {
+    // 只升级没有请求体的请求，否则请求体之后才能开始HTTP/2的帧
+    HeaderView upgrade = m_headers->get(HEADER_UPGRADE);
+    HeaderView settings = m_headers->get(HEADER_HTTP2_SETTINGS);
+    if (!upgrade.data || !settings.data || m_content_length != 0 || ret == BAD_REQUEST || !want_h2c(upgrade.data))
+    {
+        return false;
+    }
+    if (!prepare_write() || !(m_h2 = new (std::nothrow) Http2Session(this)))
+    {
+        return false;
+    }
 
-    // 解析读
-    HTTP_CODE read_ret = process_read();
-    if (read_ret == NO_REQUEST)
+    // 先发送101，之后的都是HTTP/2的帧。SETTINGS和流1的HEADERS很小，和101合并成队列中的一个响应，
+    // 流1的DATA要等客户端处理完101、发来连接前言之后才发送
+    int start = m_write_idx;
+    if (!add_status_line(101) || !add_bytes(upgrade_h2c_header, sizeof(upgrade_h2c_header) - 1) ||
+        !add_blank_line())
+    {
+        m_write_idx = start;
+        delete m_h2;
+        m_h2 = nullptr;
+        return false;
+    }
+    push_response(start, nullptr, 0, nullptr, 0, 0);
+    if (!m_h2->upgrade(settings.data, settings.len, ret))
+    {
+        // HTTP2-Settings 不对，还是用HTTP/1.1回复
+        m_queue->tail--;
+        m_write_idx = start;
+        delete m_h2;
+        m_h2 = nullptr;
+        return false;
+    }
+    return true;
+}
+
+Http_Connect::HTTP_CODE Http_Connect::process_h2_request(char *url, char *host)
+{
+    log->write_log(0, "GET %s HTTP/2", url);
+    m_url = url;
+    m_host = host;
+    m_linger = true;
+    HeaderView encoding = m_headers->get(HEADER_ACCEPT_ENCODING);
+    m_accept_gzip = encoding.data && accept_gzip(encoding.data);
+    if (m_url[0] != '/')
+    {
+        return BAD_REQUEST;
+    }
+    return do_request();
+}
+
+bool Http_Connect::has_pending() const
+{
+    if (m_queue && m_queue->head != m_queue->tail)
+    {
+        return false;
+    }
+    return m_request_start < m_read_idx || (m_h2 && m_h2->want_write());
+}
+
+Http_Connect::PROCESS_STATE Http_Connect::process_request()
+{
+    // HTTP/2的流多路复用，处理的代价不好估计，都交给工作线程
+    if (m_h2)
+    {
+        return m_inline ? PROCESS_OFFLOAD : m_h2->process();
+    }
+
+    // 读缓存区中可能有流水线上的多个请求，一个接一个处理，响应按顺序放进响应队列
+    while (can_queue())
+    {
+        // 请求行的位置是HTTP/2的连接前言，客户端直接使用h2c
+        if (m_check_state == CHECK_STATE_REQUESTLINE && m_start_line == m_request_start && m_request_start < m_read_idx)
+        {
+            int preface = Http2Session::check_preface(m_read_buf + m_request_start, m_read_idx - m_request_start);
+            if (preface < 0)
+            {
+                break;
+            }
+            if (preface > 0)
+            {
+                m_checked_idx = m_request_start;
+                m_colon_idx = -1;
+                if (!prepare_write() || !(m_h2 = new (std::nothrow) Http2Session(this)))
+                {
+                    return PROCESS_CLOSE;
+                }
+                m_h2->start();
+                return m_inline ? PROCESS_OFFLOAD : m_h2->process();
+            }
+        }
+
+        // 解析读，请求在reactor中已经解析完了的，直接从 do_request 继续
+        HTTP_CODE read_ret = m_deferred ? do_request() : process_read();
+        if (read_ret == NO_REQUEST)
+        {
+            // 请求数据不完整
+            break;
+        }
+        if (read_ret == OFFLOAD_REQUEST)
+        {
+            // 解析的状态都保存着，工作线程从这里接着处理，已经生成的响应留在队列中
+            return PROCESS_OFFLOAD;
+        }
+        m_request_start = m_checked_idx;
+
+        // 升级到h2c，这个请求在流1上回复，之后的数据都是HTTP/2的帧
+        if (upgrade_h2(read_ret))
+        {
+            init_request();
+            return m_inline ? PROCESS_OFFLOAD : m_h2->process();
+        }
+
+        // 生成响应
+        if (!process_write(read_ret))
+        {
+            // 发现请求有错误，那么就关闭连接
+            return PROCESS_CLOSE;
+        }
+        init_request();
+    }
+
+    if (!m_queue || m_queue->head == m_queue->tail)
+    {
+        return PROCESS_NEED_READ;
+    }
+    return PROCESS_WRITE;
+}
+
+Http_Connect::PROCESS_STATE Http_Connect::process_inline()
+{
+    m_inline = true;
+    PROCESS_STATE state = process_request();
+    m_inline = false;
+
+    if (state == PROCESS_NEED_READ)
     {
-        // 请求数据不完整
         modifyfd(m_epollfd, m_sockfd, EPOLLIN);
-        return;
     }
+    return state;
+}
 
-    // 生成响应
-    bool write_ret = process_write(read_ret);
-    if (!write_ret)
+void Http_Connect::process()
+{
+    // 统计从reactor交出到开始处理的耗时，按 1/8 的权重更新平均值，
+    // 时刻只保存了低32位，超过一秒的样本不可信，丢掉
+    if (m_dispatch_stamp)
     {
-        // 发现请求有错误，那么就关闭连接
-        close_connect();
+        unsigned elapsed = (unsigned)TimerWheel::now_ns() - m_dispatch_stamp;
+        if (elapsed < 1000000000u)
+        {
+            unsigned avg = m_handoff_ns.load(std::memory_order_relaxed);
+            m_handoff_ns.store(avg - avg / 8 + elapsed / 8, std::memory_order_relaxed);
+        }
+        m_dispatch_stamp = 0;
     }
-    // 注册写事件，将错误或者资源返回给客户
-    modifyfd(m_epollfd, m_sockfd, EPOLLOUT);
-}
\ No newline at end of file
+
+    // 响应几乎都能一次放进socket的发送缓存区，生成之后直接发送，不用注册EPOLLOUT再让reactor发送；
+    // 发送完了读缓存区中还有流水线上的请求，接着处理
+    PROCESS_STATE state;
+    WRITE_STATE sent = WRITE_DONE;
+    while (true)
+    {
+        state = process_request();
+        if (state != PROCESS_WRITE)
+        {
+            break;
+        }
+        m_sent_direct = true;
+        sent = send_response();
+        if (sent != WRITE_DONE || !has_pending())
+        {
+            break;
+        }
+    }
+
+    // 重新注册事件之后reactor可能马上收到事件，又把连接交给别的工作线程，
+    // 所以先标记为正在交还，用完文件描述符之后，状态没有被reactor改过才标记为空闲。
+    // 空闲之后reactor可以因为超时关闭连接，文件描述符随时可能被新连接复用，之后不能再用它
+    int sockfd = m_sockfd;
+    int epollfd = m_epollfd;
+    m_busy.store(BUSY_RELEASING, std::memory_order_release);
+
+    if (state == PROCESS_CLOSE || (state == PROCESS_WRITE && sent == WRITE_ERROR))
+    {
+        // 连接的定时器属于reactor线程，这里不直接关闭，
+        // 关闭读写之后reactor会收到EPOLLHUP，由它来关闭连接
+        shutdown(sockfd, SHUT_RDWR);
+        modifyfd(epollfd, sockfd, EPOLLIN);
+    }
+    else if (state == PROCESS_NEED_READ || sent == WRITE_DONE)
+    {
+        modifyfd(epollfd, sockfd, EPOLLIN);
+    }
+    else
+    {
+        // socket的发送缓存区满了或者用完了一个窗口，注册写事件由reactor继续发送；
+        // 超过了限速也注册写事件，由reactor的 write() 设置定时器等待令牌
+        modifyfd(epollfd, sockfd, EPOLLOUT);
+    }
+
+    char releasing = BUSY_RELEASING;
+    m_busy.compare_exchange_strong(releasing, BUSY_IDLE, std::memory_order_release, std::memory_order_relaxed);
+}
@@ -9,19 +9,47 @@
 #include <unistd.h>
 #include <cstring>
 #include <sys/uio.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
-#include <stdarg.h>
+#include <atomic>
 #include "log.h"
+#include "timer_wheel.h"
+#include "buffer_pool.h"
+#include "file_cache.h"
+#include "http_header.h"
+#include "cache_policy.h"
 
-class Http_Connect
+class Http_Connect;
+class Http2Session;
+
+// 非负整数转成十进制，返回写入的字节数，buf至少要有20个字节
+int format_uint(char *buf, unsigned long long value);
+
+// 请求体的处理函数，请求体不会整个放在内存中，收到一段就交给它一段，
+// last表示这是最后一段，返回false表示出错，之后会关闭连接
+typedef bool (*BodyHandler)(Http_Connect *conn, const char *data, int len, bool last);
+
+/*
+    每个文件描述符对应一个连接对象，对象本身只保存解析和发送的状态，按缓存行对齐，一共256字节。
+    读写缓存区、响应队列和请求头表只在有请求正在处理时才从缓存池中申请，处理完就归还，
+    所以空闲的长连接只占用这个对象本身的内存。
+    客户端可以不等响应就发送多个请求(流水线)，读缓存区中所有完整的请求一次处理完，
+    响应按顺序放进响应队列，内存中的部分用一次 writev 聚合发送。
+    HTTP/2(h2c)的连接由 Http2Session 解析帧，缓存区和响应队列仍然在这里。
+*/
+class alignas(64) Http_Connect
 {
+    friend class Http2Session;
+
 public:
     static const int FILENAME_LEN = 200;       // 文件的实际路径的最大长度
-    static const int READ_BUFFER_SIZE = 2048;  // 读缓存区的大小
-    static const int WRITE_BUFFER_SIZE = 1024; // 写缓存区的大小
+    static const int READ_BUFFER_SIZE = 2048;  // 读缓存区开始的大小，放不下时成倍扩大到请求头上限的两倍
+    static const int WRITE_BUFFER_SIZE = 4096; // 写缓存区的大小，流水线上的多个响应头都放在这里
+    static const int MAX_PIPELINE = 16;        // 一次最多处理多少个流水线上的请求
+    static const int RESPONSE_RESERVE = 512;   // 写缓存区剩余的空间少于这个数就不再处理下一个请求
+    static const int MAX_RANGES = 8;           // 一个Range请求头最多的区间数，更多时忽略Range，发送整个文件
+    static const off_t SEND_WINDOW = 256 * 1024; // 一次写事件最多发送的字节数，大文件分多次发送，不让一个连接占住reactor
 
-    // HTTP请求方法，这里只支持GET
+    // HTTP请求方法，这里支持GET、POST和PUT，POST和PUT的请求体交给处理函数，之后和GET一样回复请求的目标
     enum METHOD
     {
         GET = 0,
@@ -66,6 +94,7 @@ public:
         FILE_REQUEST        :   文件请求,获取文件成功
         INTERNAL_ERROR      :   表示服务器内部错误
         CLOSED_CONNECTION   :   表示客户端已经关闭连接了
+        NOT_MODIFIED        :   条件请求的验证器匹配，客户端缓存的文件还可以用
     */
     enum HTTP_CODE
     {
@@ -76,71 +105,164 @@ public:
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
         INTERNAL_ERROR,
-        CLOSED_CONNECTION
+        CLOSED_CONNECTION,
+        NOT_MODIFIED,
+        OFFLOAD_REQUEST
+    };
+
+    /*
+        一次处理之后连接接下来要做的事情，由具体的I/O后端(epoll或io_uring)去执行
+        PROCESS_NEED_READ   :   请求还不完整，需要继续读
+        PROCESS_WRITE       :   响应已经准备好，需要发送
+        PROCESS_CLOSE       :   出错，需要关闭连接
+        PROCESS_OFFLOAD     :   在reactor中直接处理时遇到了可能阻塞的操作，要交给工作线程继续处理
+    */
+    enum PROCESS_STATE
+    {
+        PROCESS_NEED_READ = 0,
+        PROCESS_WRITE,
+        PROCESS_CLOSE,
+        PROCESS_OFFLOAD
+    };
+
+    /*
+        连接被工作线程占用的状态
+        BUSY_IDLE       :   没有被占用，reactor可以因为超时关闭连接
+        BUSY_WORKING    :   已经交给工作线程，还在队列中或者正在处理
+        BUSY_RELEASING  :   工作线程处理完了，正在重新注册事件，还在使用文件描述符；
+                            这时reactor可能已经收到新的事件又把连接交了出去，状态变回 BUSY_WORKING
+    */
+    enum BUSY_STATE
+    {
+        BUSY_IDLE = 0,
+        BUSY_WORKING,
+        BUSY_RELEASING
+    };
+
+    /*
+        一次发送的结果
+        WRITE_DONE      :   响应都发送完了
+        WRITE_AGAIN     :   socket的发送缓存区满了，或者用完了一个窗口，要等写事件
+        WRITE_THROTTLED :   超过了限速，要等 throttle_delay() 毫秒
+        WRITE_ERROR     :   出错，或者不保持连接的响应发送完了，要关闭连接
+    */
+    enum WRITE_STATE
+    {
+        WRITE_DONE = 0,
+        WRITE_AGAIN,
+        WRITE_THROTTLED,
+        WRITE_ERROR
     };
 
 public:
-    static int m_epollfd;    // 所有socket的epoll文件描述符，指向红黑树
-    static int m_uesr_count; // 用户的数量，客户端的数量
+    static std::atomic<int> m_uesr_count; // 用户的数量，客户端的数量，所有reactor共享
+
+    // 请求行和请求头的最大字节数，超过了回复400并关闭连接，读缓存区最大扩大到它的两倍
+    static void set_max_header_size(int size) { m_max_header_size = size; }
+    // 设置请求体的处理函数，没有设置时请求体被丢弃
+    static void set_body_handler(BodyHandler handler) { m_body_handler = handler; }
+    // 每个连接发送的速率上限，单位字节每秒，0表示不限制
+    static void set_send_rate(int rate) { m_send_rate = rate; }
+    // 从reactor交出连接到工作线程开始处理的平均耗时，单位纳秒
+    static unsigned handoff_ns() { return m_handoff_ns.load(std::memory_order_relaxed); }
 
 private:
-    int m_sockfd;          // 该http来连接的fd，用于通信
-    sockaddr_in m_address; // 客户端的信息
+    static int m_max_header_size;
+    static BodyHandler m_body_handler;
+    static int m_send_rate;
+    static std::atomic<unsigned> m_handoff_ns;
 
-    char m_read_buf[READ_BUFFER_SIZE]; /// 读缓存区
-    int m_read_idx;                    // 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
-    int m_checked_idx;                 // 当前正在分析的字符在读缓冲区中的位置
-    int m_start_line;                  // 当前正在解析的行的起始位置
+private:
+    // 每次读写都会访问的成员放在前面
+    int m_epollfd;       // 该连接所属reactor的epoll文件描述符
+    int m_sockfd;        // 该http来连接的fd，用于通信
+    char *m_read_buf;    // 读缓存区，从缓存池中申请，没有请求时为空
+    int m_read_size;     // 读缓存区的大小
+    char *m_write_buf;   // 写缓存区，从缓存池中申请，没有响应时为空
+    int m_read_idx;      // 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
+    int m_checked_idx;   // 当前正在分析的字符在读缓冲区中的位置
+    int m_request_start; // 还没有处理完的第一个请求的起始位置，之前的数据都可以丢掉
+    int m_start_line;    // 当前正在解析的行的起始位置
+    int m_colon_idx;     // 当前正在解析的行中第一个':'的位置，没有为-1
+    int m_write_idx;     // 读缓存区读到了哪里，也就是存进缓存区的字节数
 
     CHECK_STATE m_check_state; // 主状态机当前所处的状态
     METHOD m_method;           // 请求方法
+    bool m_linger;             //  http请求是否保持连接
+    bool m_accept_gzip;        // 客户端是否接受gzip压缩
+    bool m_gzip;               // 响应的内容是否是gzip压缩过的
+    bool m_vary;               // 响应的内容是否随Accept-Encoding变化
+    int m_content_length;      // 请求体的总长度
+    int m_content_read;        // 已经交给处理函数的请求体的长度
+    unsigned m_dispatch_stamp; // reactor交出连接的时刻，单调时钟纳秒数的低32位，0表示没有记录
 
-    char m_real_file[FILENAME_LEN]; // 存储文件的真实文件路径，doc_root + m_url
-    char *m_url;                      // 请求目标文件的文件名
-    char *m_version;                  // 协议版本，这里只支持1.1
-    char *m_host;                     // 请求主机名
-    int m_content_length;             // 请求体的总长度
-    bool m_linger;                    //  http请求是否保持连接
+    char *m_url;          // 请求目标文件的文件名，指向读缓存区
+    char *m_version;      // 协议版本，支持1.0和1.1
+    char *m_host;         // 请求主机名
+    FileEntry *m_file;    // 请求的目标文件，从文件缓存中取得，生成响应时交给响应队列
+    off_t m_file_size;    // 请求的目标文件的大小，gzip压缩时为压缩之后的大小
+    const char *m_body;   // 内存中的响应内容(小文件压缩之后的结果)，为空时从文件发送
+    const CachePolicy *m_cache_policy; // 请求的文件的缓存策略，没有为nullptr
 
-    char m_write_buf[WRITE_BUFFER_SIZE]; // 写缓存区
-    int m_write_idx;                     // 读缓存区读到了哪里，也就是存进缓存区的字节数
-    char *m_file_address;                // 请求的目标文件被内存映射到的地址
-    /*
-        目标文件的状态
-        st_mode：文件类型和权限，包括文件类型、访问权限、特殊权限等。
-        st_ino：文件的i-node号，用于唯一标识一个文件。
-        st_dev：文件所在设备的设备号。
-        st_nlink：该文件的硬链接数量。
-        st_uid：文件所有者的用户ID。
-        st_gid：文件所属组的组ID。
-        st_size：文件大小（字节数）。
-        st_atime：最后访问时间。
-        st_mtime：最后修改时间。
-        st_ctime：最后状态改变时间。
-    */
-    struct stat m_file_stat;
     /*
-        我们将采用writev来执行写操作，所以定义下面两个成员
-        其中m_iv_count表示被写内存块的数量。
-        iov_base：指向缓冲区的起始地址。
-        iov_len：缓冲区的大小（以字节为单位）。
-        通过使用struct iovec，可以将多个缓冲区的数据打包到一个数据结构中进行传输
+        队列中的一个响应，依次发送三个部分：
+        写缓存区中生成的响应头，文件缓存中的内容(小文件预先生成的响应头和文件内容)，文件
     */
-    struct iovec m_iv[2];
-    int m_iv_count; // 表示被写内存块的数量
+    struct Response
+    {
+        const char *head;  // 写缓存区中还没有发送的部分，至少有状态行和Date
+        int head_len;
+        const char *data;  // 文件缓存中还没有发送的部分，没有为nullptr
+        int len;
+        FileEntry *file;   // 持有的文件缓存项的引用，没有为nullptr
+        off_t file_offset; // 文件下一个要发送的字节的偏移，文件内容不经过用户态
+        off_t file_len;    // 文件还要发送的字节数，0表示没有文件部分
+    };
 
-    int byte_to_send;   // 将要发送的数据的字节数
-    int byte_have_send; // 已经发送的数据的字节数
+    // 已经处理的请求的响应，按请求的顺序发送，有响应要发送时才从缓存池中申请
+    struct ResponseQueue
+    {
+        Response items[MAX_PIPELINE];
+        struct iovec iov[MAX_PIPELINE * 2]; // 聚合发送的内存部分，到第一个有文件的响应为止
+        int head;                       // 第一个还没有发送完的响应
+        int tail;                       // 下一个响应放的位置
+        bool linger;                    // 最后一个响应发送完之后是否保持连接
+    };
+    ResponseQueue *m_queue;
+
+    // Range请求的一个区间，first和last都包含在内
+    struct ByteRange
+    {
+        off_t first;
+        off_t last;
+    };
+
+    TimerNode m_timer;         // 空闲超时的定时器，挂在所属reactor的时间轮上，限速时也用它等待令牌
+    long long m_send_credit;   // 限速的令牌桶中的令牌，单位千分之一字节，发送之后可能为负
+    unsigned long long m_send_stamp; // 上一次发送的时刻，单位毫秒，限速时也是上一次补充令牌的时刻
+    int m_throttle_ms;         // 超过了限速，要等待的毫秒数，这期间没有注册EPOLLOUT
+    std::atomic<char> m_busy;  // 被工作线程占用的状态(BUSY_STATE)，占用中的连接超时了也不能关闭
+    bool m_inline;             // 是否正在reactor中直接处理，这时不做可能阻塞的操作
+    bool m_deferred;           // 请求已经解析完，do_request 推迟到工作线程中执行
+    bool m_sent_direct;        // 工作线程直接发送过响应，reactor没有因此重新设置定时器
+    sockaddr_in m_address;     // 客户端的信息
+
+    HeaderTable *m_headers;    // 请求头，名字和值都指向读缓存区，和读缓存区一起从缓存池中申请
+    Http2Session *m_h2;        // HTTP/2连接的状态，HTTP/1.1的连接为nullptr
 
 public:
-    Http_Connect() {}
-    ~Http_Connect() {}
+    Http_Connect() : m_sockfd(-1), m_read_buf(nullptr), m_write_buf(nullptr), m_file(nullptr), m_queue(nullptr), m_busy(BUSY_IDLE), m_headers(nullptr), m_h2(nullptr) {}
+    ~Http_Connect() { close_file(); release_buffer(); }
+
+    // 连接对象按缓存行对齐，C++17之前 new[] 不保证这样的对齐，自己分配
+    static void *operator new[](size_t size);
+    static void operator delete[](void *ptr);
 
 public:
-    // 接收新的连接，将新的连接加入epoll等操作
-    void init(int sockfd, const sockaddr_in &addr);
-    // 断开连接，需要关闭文件描述符
-    void close_connect();
+    // 接收新的连接，将新的连接加入所属reactor的epoll等操作
+    void init(int sockfd, const sockaddr_in &addr, int epollfd);
+    // 断开连接，real_close为false时文件描述符已经由别处(io_uring)关闭了
+    void close_connect(bool real_close = true);
     // 处理客户端的请求
     void process();
     // 读取缓存区的数据,设置非阻塞
@@ -148,34 +270,130 @@ public:
     // 向缓存区中写入数据，设置非阻塞
     bool write();
 
+    // 下面的函数供io_uring后端使用，读写由io_uring完成，这里只驱动状态机
+    // 把收到的数据追加到读缓存区，缓存区满了返回false
+    bool feed(const char *data, int len);
+    // 解析读缓存区中所有完整的请求并生成响应
+    PROCESS_STATE process_request();
+    // 在reactor中直接处理，文件不在缓存中、有请求体等可能阻塞的情况返回 PROCESS_OFFLOAD，
+    // 之后交给工作线程从停下的地方继续；需要继续读时已经重新注册了EPOLLIN
+    PROCESS_STATE process_inline();
+    // reactor把连接交给工作线程的时刻，工作线程开始处理时据此统计交接的耗时
+    void set_dispatch_time(unsigned long long now_ns) { m_dispatch_stamp = (unsigned)now_ns | 1; }
+    // 接下来可以聚合发送的内存部分，到第一个有文件的响应为止，count为0表示要先发送文件
+    struct iovec *get_iov(int &count);
+    // 紧跟在 get_iov 的内容之后的文件内容，没有返回-1，offset和len为文件中的位置和长度
+    int get_file(off_t &offset, off_t &len) const;
+    // 已经发送了bytes个字节，按顺序更新各个响应发送的位置，全部发送完返回true
+    bool update_iov(off_t bytes);
+    // 响应都发送完毕，长连接则准备处理下一批请求并返回true，否则返回false
+    bool finish_write();
+    // 限速时现在可以发送的字节数，最多一个 SEND_WINDOW，为0时 delay_ms 为要等待的毫秒数
+    off_t send_budget(int &delay_ms);
+    // 最后一个响应发送完之后是否保持连接
+    bool is_linger() const { return m_queue ? m_queue->linger : m_linger; }
+    // 响应都发送完了，读缓存区中还有没有处理的数据，或者HTTP/2还有流在等待发送，需要再处理一次
+    bool has_pending() const;
+
+    // 下面的函数供reactor管理超时使用
+    int get_sockfd() const { return m_sockfd; }
+    bool in_request() const { return m_read_idx > 0 || m_h2; } // 是否已经收到了请求的一部分
+    // 是否正在接收请求体，HTTP/2的连接也按空闲超时算，流在帧之间可以等待很久
+    bool in_body() const { return m_check_state == CHECK_STATE_CONTENT || m_h2; }
+    const char *get_url() const { return m_url; } // 请求的目标，供请求体的处理函数使用
+    TimerNode *get_timer() { return &m_timer; }
+    // write() 因为限速停下来时要等待的毫秒数，不限速时为0
+    int throttle_delay() const { return m_throttle_ms; }
+    // 限速的等待结束了，重新注册EPOLLOUT继续发送，没有在等待时返回false
+    bool resume_write();
+    // 上次取之后工作线程有没有直接发送过响应，取了之后清除，只在连接不忙时调用
+    bool take_sent_direct();
+    // 上一次发送的时刻，单位毫秒，工作线程直接发送之后reactor用它计算还剩下的空闲时间
+    unsigned long long last_send() const { return m_send_stamp; }
+    void set_busy(bool busy) { m_busy.store(busy ? BUSY_WORKING : BUSY_IDLE, std::memory_order_release); }
+    bool is_busy() const { return m_busy.load(std::memory_order_acquire) != BUSY_IDLE; }
+
 private:
     // 初始化其他数据的
     void init();
+    // 初始化一个请求的解析状态
+    void init_request();
+    // 从缓存池申请读缓存区和请求头表，失败返回false
+    bool acquire_read_buf();
+    // 把读写缓存区、响应队列和请求头表还给缓存池
+    void release_buffer();
+    // 只把写缓存区和响应队列还给缓存池
+    void release_write_buf();
+    // 丢掉已经处理完的请求和已经交出去的请求体，把剩下的数据往前移
+    void compact_read_buf();
+    // 让读缓存区至少有need个字节的空间，先整理，不够再扩大，超过上限返回false
+    bool make_room(int need);
+    // 还能不能再处理一个流水线上的请求
+    bool can_queue() const;
+    // 把一个响应放进响应队列，响应头为写缓存区中从start开始的部分，持有file的引用
+    // 文件部分从file_offset开始，发送file_len个字节
+    void push_response(int start, const char *data, int len, FileEntry *file, off_t file_offset, off_t file_len);
+    // 释放响应队列中的所有响应
+    void clear_queue();
+    // 发送响应队列中的响应，最多一个窗口，不注册任何事件，由调用者根据结果注册
+    WRITE_STATE send_response();
     // 解析http请求
     HTTP_CODE process_read();
+    // 申请响应队列和写缓存区，失败返回false
+    bool prepare_write();
     // 填充http的问答，就是往里面准备发送的缓存区发数据
     bool process_write(HTTP_CODE ret);
+    // 请求要求升级到h2c并且升级成功，ret为请求的处理结果，在HTTP/2的流1上回复
+    bool upgrade_h2(HTTP_CODE ret);
+    // 处理HTTP/2的一个请求，url和host在 Http2Session 中，请求头已经放进 m_headers
+    HTTP_CODE process_h2_request(char *url, char *host);
+    // 错误响应的状态码和内容
+    static const char *error_form(HTTP_CODE ret, int &status, int &len);
+    // 小文件在内存中的内容(压缩的内容或者缓存的响应中的文件部分)，没有返回nullptr
+    const char *cached_body() const;
 
     // 下面的函数被 process_read 调用，用以解析数据
     HTTP_CODE parse_request_line(char *text);              // 请求行
-    HTTP_CODE parse_request_headers(char *text);           // 请求头
+    HTTP_CODE parse_request_headers(char *text, char *colon); // 请求头
     HTTP_CODE parse_request_content(char *text);           // 请求体
     HTTP_CODE do_request();                                // 做请求
     LINE_STATE parse_line();                               // 解析一行
     char *get_line() { return m_read_buf + m_start_line; } // 取得的行的首地址
 
     // 这一组函数被process_write调用用来填充HTTP应答。
-    // 释放内存映射
-    void unmap();
-    bool add_reponse(const char *format, ...); // 往缓存区中写入待发送的数据
-    // add_response 被以下函数调用
-    bool add_content(const char *content);
+    // 请求的是不是文件的一部分，带If-Range时文件要没有变化
+    bool want_range() const;
+    // If-None-Match 或者 If-Modified-Since 是否匹配请求的文件，匹配时回复304
+    bool not_modified() const;
+    // 解析Range请求头，返回能满足的区间数，格式错误或者区间太多返回-1，这时发送整个文件
+    static int parse_ranges(HeaderView value, off_t size, ByteRange *ranges);
+    // 生成206或者416响应，多个区间时每个区间是队列中的一个响应
+    bool add_range_response(const ByteRange *ranges, int count);
+    // 把请求的文件还给文件缓存
+    void close_file();
+    // 客户端接受gzip时，换成.gz文件或者内存中压缩的内容，在reactor中直接处理而需要阻塞时返回false
+    bool negotiate_gzip(const char *real_file);
+    // 缓存的完整响应的下标
+    int response_index() const { return (m_gzip ? 2 : 0) + (m_linger ? 1 : 0); }
+    // 小文件使用文件缓存中已经生成好的响应，只需要生成状态行、Date和Expires，没有返回false
+    bool use_cached_response();
+    // 把刚生成的响应头(写缓存区中从start开始，不含状态行、Date和Expires)和小文件的内容拼起来，放进文件缓存
+    void cache_response(int start);
+    // 往缓存区中写入待发送的数据，都是直接拷贝，不做格式化
+    bool add_bytes(const char *data, int len);
+    bool add_number(long long value);
+    // 下面的函数都通过上面两个函数写入
+    bool add_content(const char *content, int len);
     bool add_content_type();
-    bool add_status_line(int status, const char *title);
-    // 
-    bool add_headers(int content_length);
-    bool add_content_length(int content_length);
+    bool add_content_range(off_t first, off_t last);
+    bool add_validators(); // ETag和Last-Modified
+    bool add_cache_control(); // 不随时间变化，可以放进缓存的响应
+    bool add_expires();       // 随时间变化，和状态行一起每次生成
+    bool add_status_line(int status); // 状态行和Date
+    bool add_headers(off_t content_length);
+    bool add_content_length(off_t content_length);
     bool add_linger();
+    bool add_encoding();
     bool add_blank_line();
 
 };
@@ -0,0 +1,217 @@
+#include "http_date.h"
+#include <cstring>
+
+static const char week_names[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char week_full_names[7][10] = {"Sunday", "Monday", "Tuesday", "Wednesday",
+                                            "Thursday", "Friday", "Saturday"};
+static const char month_names[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// 两位数字
+static inline void put2(char *buf, int value)
+{
+    buf[0] = '0' + value / 10;
+    buf[1] = '0' + value % 10;
+}
+
+// 两位数字，不是数字返回-1
+static inline int get2(const char *buf)
+{
+    if (buf[0] < '0' || buf[0] > '9' || buf[1] < '0' || buf[1] > '9')
+    {
+        return -1;
+    }
+    return (buf[0] - '0') * 10 + (buf[1] - '0');
+}
+
+// 三个字母的月份，不是月份返回-1
+static int get_month(const char *buf)
+{
+    for (int i = 0; i < 12; i++)
+    {
+        if (memcmp(buf, month_names[i], 3) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// 三个字母的星期，只检查是不是星期的名字，不检查和日期是否一致
+static bool is_week_name(const char *buf)
+{
+    for (int i = 0; i < 7; i++)
+    {
+        if (memcmp(buf, week_names[i], 3) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// RFC 850 中星期的全名，len为名字的长度
+static bool is_week_full_name(const char *buf, int len)
+{
+    for (int i = 0; i < 7; i++)
+    {
+        if ((int)strlen(week_full_names[i]) == len && memcmp(buf, week_full_names[i], len) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// HH:MM:SS，允许闰秒
+static bool get_clock(const char *buf, struct tm &tm)
+{
+    if (buf[2] != ':' || buf[5] != ':')
+    {
+        return false;
+    }
+    tm.tm_hour = get2(buf);
+    tm.tm_min = get2(buf + 3);
+    tm.tm_sec = get2(buf + 6);
+    return tm.tm_hour >= 0 && tm.tm_hour <= 23 && tm.tm_min >= 0 && tm.tm_min <= 59 && tm.tm_sec >= 0 &&
+           tm.tm_sec <= 60;
+}
+
+// RFC 850 的两位年份：离现在超过50年以后的年份算作上一个世纪
+static int expand_year(int year)
+{
+    time_t now = time(nullptr);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    int current = tm.tm_year + 1900;
+    year += current - current % 100;
+    if (year > current + 50)
+    {
+        year -= 100;
+    }
+    return year;
+}
+
+bool parse_http_date(const char *s, int len, time_t &t)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int year = -1;
+
+    if (len == HTTP_DATE_LEN)
+    {
+        // IMF-fixdate: Sun, 06 Nov 1994 08:49:37 GMT
+        if (!is_week_name(s) || s[3] != ',' || s[4] != ' ' || s[7] != ' ' || s[11] != ' ' || s[16] != ' ' ||
+            memcmp(s + 25, " GMT", 4) != 0 || !get_clock(s + 17, tm))
+        {
+            return false;
+        }
+        tm.tm_mday = get2(s + 5);
+        tm.tm_mon = get_month(s + 8);
+        int century = get2(s + 12);
+        int low = get2(s + 14);
+        if (century >= 0 && low >= 0)
+        {
+            year = century * 100 + low;
+        }
+    }
+    else if (len == 24)
+    {
+        // asctime: Sun Nov  6 08:49:37 1994，一位数的日期前面补空格
+        if (!is_week_name(s) || s[3] != ' ' || s[7] != ' ' || s[10] != ' ' || s[19] != ' ' ||
+            !get_clock(s + 11, tm))
+        {
+            return false;
+        }
+        tm.tm_mon = get_month(s + 4);
+        if (s[8] == ' ' && s[9] >= '1' && s[9] <= '9')
+        {
+            tm.tm_mday = s[9] - '0';
+        }
+        else
+        {
+            tm.tm_mday = get2(s + 8);
+        }
+        int century = get2(s + 20);
+        int low = get2(s + 22);
+        if (century >= 0 && low >= 0)
+        {
+            year = century * 100 + low;
+        }
+    }
+    else
+    {
+        // RFC 850: Sunday, 06-Nov-94 08:49:37 GMT，星期是全名
+        const char *comma = (const char *)memchr(s, ',', len);
+        if (!comma || s + len - comma != 24 || !is_week_full_name(s, comma - s))
+        {
+            return false;
+        }
+        const char *d = comma + 2;
+        if (comma[1] != ' ' || d[2] != '-' || d[6] != '-' || d[9] != ' ' || memcmp(d + 18, " GMT", 4) != 0 ||
+            !get_clock(d + 10, tm))
+        {
+            return false;
+        }
+        tm.tm_mday = get2(d);
+        tm.tm_mon = get_month(d + 3);
+        int low = get2(d + 7);
+        if (low >= 0)
+        {
+            year = expand_year(low);
+        }
+    }
+
+    if (tm.tm_mon < 0 || year < 0 || tm.tm_mday < 1 || tm.tm_mday > 31)
+    {
+        return false;
+    }
+    tm.tm_year = year - 1900;
+    t = timegm(&tm);
+    return true;
+}
+
+void format_http_date(time_t t, char *buf)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+
+    // Sun, 06 Nov 1994 08:49:37 GMT
+    memcpy(buf, week_names[tm.tm_wday], 3);
+    buf[3] = ',';
+    buf[4] = ' ';
+    put2(buf + 5, tm.tm_mday);
+    buf[7] = ' ';
+    memcpy(buf + 8, month_names[tm.tm_mon], 3);
+    buf[11] = ' ';
+    int year = tm.tm_year + 1900;
+    put2(buf + 12, year / 100);
+    put2(buf + 14, year % 100);
+    buf[16] = ' ';
+    put2(buf + 17, tm.tm_hour);
+    buf[19] = ':';
+    put2(buf + 20, tm.tm_min);
+    buf[22] = ':';
+    put2(buf + 23, tm.tm_sec);
+    memcpy(buf + 25, " GMT", 4);
+}
+
+const char *date_header(int &len)
+{
+    // "Date: " + 日期 + "\r\n"
+    static thread_local char header[6 + HTTP_DATE_LEN + 2] = {'D', 'a', 't', 'e', ':', ' '};
+    static thread_local time_t last = 0;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec != last)
+    {
+        last = ts.tv_sec;
+        format_http_date(last, header + 6);
+        header[6 + HTTP_DATE_LEN] = '\r';
+        header[6 + HTTP_DATE_LEN + 1] = '\n';
+    }
+
+    len = sizeof(header);
+    return header;
+}
@@ -0,0 +1,23 @@
+#ifndef HTTP_DATE_H
+#define HTTP_DATE_H
+
+#include <time.h>
+
+// HTTP日期的长度，格式为 IMF-fixdate，例如 Sun, 06 Nov 1994 08:49:37 GMT
+const int HTTP_DATE_LEN = 29;
+
+// 解析HTTP日期，len 为字符串的长度，格式不对返回false。除了 IMF-fixdate，
+// 还接受过时的 RFC 850(Sunday, 06-Nov-94 08:49:37 GMT)和 asctime(Sun Nov  6 08:49:37 1994)格式
+bool parse_http_date(const char *s, int len, time_t &t);
+
+// 把时间格式化成HTTP日期，不受locale影响，buf至少要有 HTTP_DATE_LEN 个字节，不写'\0'
+void format_http_date(time_t t, char *buf);
+
+/*
+    当前时间的 "Date: ...\r\n" 响应头，len为它的长度
+    每个线程缓存一份，用不产生系统调用的粗粒度时钟判断，跨过一秒才重新格式化，
+    返回的内存属于调用的线程，下一秒会被改写，要发送的话先拷贝出去
+*/
+const char *date_header(int &len);
+
+#endif
@@ -0,0 +1,122 @@
+#include "http_header.h"
+#include <strings.h>
+
+// 哈希表的大小，必须是2的幂
+static const unsigned HEADER_HASH_SIZE = 32;
+
+/*
+    请求头名字的哈希，只看长度、第一个和最后一个字符，'|0x20'把字母转成小写。
+    已知的请求头在这个哈希下没有冲突，classify 中按哈希值 switch，
+    case 的值在编译时计算，新加的请求头如果冲突了会因为 case 重复而编译失败
+*/
+static constexpr unsigned header_hash(const char *name, int len)
+{
+    return (len + (name[0] | 0x20) + (name[len - 1] | 0x20) * 7) & (HEADER_HASH_SIZE - 1);
+}
+
+template <int N>
+static constexpr unsigned header_hash_of(const char (&name)[N])
+{
+    return header_hash(name, N - 1);
+}
+
+// 已知请求头的小写名字，按 HEADER_NAME 的顺序
+static const struct
+{
+    const char *name;
+    int len;
+} known_headers[HEADER_NAME_NUMBER] = {
+    {"", 0},
+    {"host", 4},
+    {"connection", 10},
+    {"content-length", 14},
+    {"transfer-encoding", 17},
+    {"accept-encoding", 15},
+    {"if-none-match", 13},
+    {"if-modified-since", 17},
+    {"range", 5},
+    {"if-range", 8},
+    {"upgrade", 7},
+    {"http2-settings", 14},
+    {"expect", 6},
+};
+
+HEADER_NAME HeaderTable::classify(const char *name, int len)
+{
+    if (len <= 0)
+    {
+        return HEADER_UNKNOWN;
+    }
+
+    // 哈希只能选出候选，还要比较一次名字
+    HEADER_NAME id;
+    switch (header_hash(name, len))
+    {
+    case header_hash_of("host"):
+        id = HEADER_HOST;
+        break;
+    case header_hash_of("connection"):
+        id = HEADER_CONNECTION;
+        break;
+    case header_hash_of("content-length"):
+        id = HEADER_CONTENT_LENGTH;
+        break;
+    case header_hash_of("transfer-encoding"):
+        id = HEADER_TRANSFER_ENCODING;
+        break;
+    case header_hash_of("accept-encoding"):
+        id = HEADER_ACCEPT_ENCODING;
+        break;
+    case header_hash_of("if-none-match"):
+        id = HEADER_IF_NONE_MATCH;
+        break;
+    case header_hash_of("if-modified-since"):
+        id = HEADER_IF_MODIFIED_SINCE;
+        break;
+    case header_hash_of("range"):
+        id = HEADER_RANGE;
+        break;
+    case header_hash_of("if-range"):
+        id = HEADER_IF_RANGE;
+        break;
+    case header_hash_of("upgrade"):
+        id = HEADER_UPGRADE;
+        break;
+    case header_hash_of("http2-settings"):
+        id = HEADER_HTTP2_SETTINGS;
+        break;
+    case header_hash_of("expect"):
+        id = HEADER_EXPECT;
+        break;
+    default:
+        return HEADER_UNKNOWN;
+    }
+
+    if (known_headers[id].len != len || strncasecmp(name, known_headers[id].name, len) != 0)
+    {
+        return HEADER_UNKNOWN;
+    }
+    return id;
+}
+
+bool HeaderTable::add(const char *name, int name_len, const char *value, int value_len, HEADER_NAME &id)
+{
+    if (m_count == MAX_HEADERS)
+    {
+        return false;
+    }
+
+    Entry &entry = m_entries[m_count];
+    entry.name_off = name - m_base;
+    entry.name_len = name_len;
+    entry.value_off = value - m_base;
+    entry.value_len = value_len;
+    m_count++;
+
+    id = classify(name, name_len);
+    if (id != HEADER_UNKNOWN)
+    {
+        m_known[id] = m_count;
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+#include <stdint.h>
+
+// 需要处理的请求头，其他的请求头都是 HEADER_UNKNOWN
+enum HEADER_NAME
+{
+    HEADER_UNKNOWN = 0,
+    HEADER_HOST,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_RANGE,
+    HEADER_IF_RANGE,
+    HEADER_UPGRADE,
+    HEADER_HTTP2_SETTINGS,
+    HEADER_EXPECT,
+    HEADER_NAME_NUMBER
+};
+
+// 指向读缓存区中的一段字符，不拷贝，不以'\0'结尾
+struct HeaderView
+{
+    const char *data;
+    int len;
+
+    bool empty() const { return len == 0; }
+};
+
+/*
+    一个请求的所有请求头
+    只记录名字和值在读缓存区中的偏移和长度，缓存区扩容搬家之后调用 rebase 即可。
+    已知的请求头在加入时用完美哈希分类，之后按 HEADER_NAME 直接取出，
+    未知的请求头也保留下来，可以按下标遍历。
+*/
+class HeaderTable
+{
+public:
+    static const int MAX_HEADERS = 32; // 一个请求最多的请求头数量
+
+    HeaderTable() { reset(nullptr); }
+
+    // 开始一个新的请求，base 为读缓存区
+    void reset(const char *base)
+    {
+        m_base = base;
+        m_count = 0;
+        for (int i = 0; i < HEADER_NAME_NUMBER; i++)
+        {
+            m_known[i] = 0;
+        }
+    }
+
+    // 读缓存区换了地址，偏移不变
+    void rebase(const char *base) { m_base = base; }
+
+    // 读缓存区中的数据整体往前移动了delta个字节
+    void shift(int delta)
+    {
+        for (int i = 0; i < m_count; i++)
+        {
+            m_entries[i].name_off -= delta;
+            m_entries[i].value_off -= delta;
+        }
+    }
+
+    // 加入一个请求头，name 和 value 都在读缓存区中，value 已经去掉了前后的空白。
+    // 请求头太多时返回false
+    bool add(const char *name, int name_len, const char *value, int value_len, HEADER_NAME &id);
+
+    int size() const { return m_count; }
+    HeaderView name(int i) const { return view(m_entries[i].name_off, m_entries[i].name_len); }
+    HeaderView value(int i) const { return view(m_entries[i].value_off, m_entries[i].value_len); }
+
+    // 已知请求头的值，同名的请求头出现多次时取最后一个，没有时 data 为nullptr
+    HeaderView get(HEADER_NAME id) const
+    {
+        if (m_known[id] == 0)
+        {
+            HeaderView none = {nullptr, 0};
+            return none;
+        }
+        return value(m_known[id] - 1);
+    }
+
+    bool has(HEADER_NAME id) const { return m_known[id] != 0; }
+
+    // 请求头名字的分类，不区分大小写
+    static HEADER_NAME classify(const char *name, int len);
+
+private:
+    struct Entry
+    {
+        uint16_t name_off;
+        uint16_t name_len;
+        uint16_t value_off;
+        uint16_t value_len;
+    };
+
+    HeaderView view(uint16_t off, uint16_t len) const
+    {
+        HeaderView v = {m_base + off, len};
+        return v;
+    }
+
+private:
+    const char *m_base;                       // 读缓存区
+    int m_count;                              // 请求头的数量
+    uint8_t m_known[HEADER_NAME_NUMBER];      // 已知请求头在 m_entries 中的下标加一，0表示没有
+    Entry m_entries[MAX_HEADERS];
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "http_scan.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+// 逐字节比较，也用来处理SIMD实现最后不满一个块的部分
+static const char *scan_line_scalar(const char *begin, const char *end, const char **colon)
+{
+    for (const char *p = begin; p < end; p++)
+    {
+        char c = *p;
+        if (c == '\r' || c == '\n')
+        {
+            return p;
+        }
+        if (c == ':' && !*colon)
+        {
+            *colon = p;
+        }
+    }
+    return end;
+}
+
+#ifdef HTTP_SCAN_X86
+
+// 用 pcmpestri 在16个字节中找第一个属于某个字符集合的字节
+__attribute__((target("sse4.2")))
+static const char *scan_line_sse42(const char *begin, const char *end, const char **colon)
+{
+    const __m128i crlf = _mm_setr_epi8('\r', '\n', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i colon_set = _mm_setr_epi8(':', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT;
+
+    const char *p = begin;
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        int eol = _mm_cmpestri(crlf, 2, block, 16, mode);
+        if (!*colon)
+        {
+            int pos = _mm_cmpestri(colon_set, 1, block, 16, mode);
+            if (pos < eol)
+            {
+                *colon = p + pos;
+            }
+        }
+        if (eol < 16)
+        {
+            return p + eol;
+        }
+    }
+    return scan_line_scalar(p, end, colon);
+}
+
+// 一次比较32个字节，比较的结果压成位掩码，最低位的1就是第一个匹配的位置
+__attribute__((target("avx2")))
+static const char *scan_line_avx2(const char *begin, const char *end, const char **colon)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i co = _mm256_set1_epi8(':');
+
+    const char *p = begin;
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)p);
+        unsigned eol_mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, cr), _mm256_cmpeq_epi8(block, lf)));
+        if (!*colon)
+        {
+            unsigned colon_mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, co));
+            // 只要行尾之前的':'
+            if (eol_mask)
+            {
+                colon_mask &= (eol_mask & -eol_mask) - 1;
+            }
+            if (colon_mask)
+            {
+                *colon = p + __builtin_ctz(colon_mask);
+            }
+        }
+        if (eol_mask)
+        {
+            return p + __builtin_ctz(eol_mask);
+        }
+    }
+    return scan_line_scalar(p, end, colon);
+}
+
+#endif
+
+struct ScanImpl
+{
+    scan_func func;
+    const char *name;
+};
+
+// 根据CPU支持的指令集选择实现
+static ScanImpl select_impl()
+{
+    ScanImpl impl = {scan_line_scalar, "scalar"};
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        impl.func = scan_line_avx2;
+        impl.name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse4.2"))
+    {
+        impl.func = scan_line_sse42;
+        impl.name = "sse4.2";
+    }
+#endif
+    return impl;
+}
+
+// 静态初始化时选择一次，之后每次调用只是一次间接跳转
+static const ScanImpl g_scan_impl = select_impl();
+
+const char *scan_line(const char *begin, const char *end, const char **colon)
+{
+    return g_scan_impl.func(begin, end, colon);
+}
+
+const char *scan_impl_name()
+{
+    return g_scan_impl.name;
+}
+
+scan_func scan_impl_by_name(const char *name)
+{
+    if (strcmp(name, "scalar") == 0)
+    {
+        return scan_line_scalar;
+    }
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        return scan_line_avx2;
+    }
+    if (strcmp(name, "sse4.2") == 0 && __builtin_cpu_supports("sse4.2"))
+    {
+        return scan_line_sse42;
+    }
+#endif
+    return nullptr;
+}
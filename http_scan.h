@@ -0,0 +1,24 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+/*
+    HTTP请求的行扫描
+    一次扫描同时找到行尾(\r或者\n)和行中第一个':'，请求头的名字和值不需要再扫描一遍。
+    支持AVX2时一次比较32个字节，支持SSE4.2时一次比较16个字节，都不支持时逐字节比较，
+    在第一次使用前根据CPU自动选择。
+*/
+
+// 在 [begin, end) 中找到第一个'\r'或者'\n'，没有找到返回 end。
+// *colon 为空时，如果在行尾之前有':'，把第一个':'的位置写到 *colon 中
+const char *scan_line(const char *begin, const char *end, const char **colon);
+
+// 当前使用的实现的名字，"avx2"、"sse4.2" 或者 "scalar"
+const char *scan_impl_name();
+
+typedef const char *(*scan_func)(const char *begin, const char *end, const char **colon);
+
+// 按名字取得一种实现，和 scan_line 的用法相同，没有这种实现或者CPU不支持时返回nullptr。
+// 测试用它把每一种SIMD实现和 "scalar" 对比
+scan_func scan_impl_by_name(const char *name);
+
+#endif
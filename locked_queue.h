@@ -0,0 +1,98 @@
+#ifndef LOCKED_QUEUE_H
+#define LOCKED_QUEUE_H
+
+#include <atomic>
+#include <exception>
+#include "locker.h"
+
+/*
+    加锁的有界环形队列，和 MpmcQueue 的接口相同，可以作为线程池的另一种队列
+    容量严格等于要求的大小，不会向上取整
+*/
+template <class T>
+class LockedQueue
+{
+public:
+    explicit LockedQueue(long capacity);
+    ~LockedQueue() { delete[] m_items; }
+
+    // 满了返回false
+    bool push(T *item);
+
+    // 一次加锁放入多个元素，返回放入的个数，空间不够时只放入前面的一部分
+    long push_batch(T **items, long count);
+
+    // 空了返回nullptr
+    T *pop();
+
+    // 元素数量，不加锁
+    long size() const { return m_size.load(std::memory_order_relaxed); }
+
+private:
+    T **m_items;
+    long m_capacity;
+    long m_head;
+    long m_tail;
+    std::atomic<long> m_size;
+    Locker m_locker;
+};
+
+template <class T>
+LockedQueue<T>::LockedQueue(long capacity) : m_capacity(capacity), m_head(0), m_tail(0), m_size(0)
+{
+    if (capacity <= 0)
+    {
+        throw std::exception();
+    }
+    m_items = new T *[capacity];
+}
+
+template <class T>
+bool LockedQueue<T>::push(T *item)
+{
+    m_locker.lock();
+    if (m_tail - m_head >= m_capacity)
+    {
+        m_locker.unlock();
+        return false;
+    }
+    m_items[m_tail % m_capacity] = item;
+    m_tail++;
+    m_size.store(m_tail - m_head, std::memory_order_relaxed);
+    m_locker.unlock();
+    return true;
+}
+
+template <class T>
+long LockedQueue<T>::push_batch(T **items, long count)
+{
+    m_locker.lock();
+    long room = m_capacity - (m_tail - m_head);
+    long n = count < room ? count : room;
+    for (long i = 0; i < n; i++)
+    {
+        m_items[m_tail % m_capacity] = items[i];
+        m_tail++;
+    }
+    m_size.store(m_tail - m_head, std::memory_order_relaxed);
+    m_locker.unlock();
+    return n;
+}
+
+template <class T>
+T *LockedQueue<T>::pop()
+{
+    m_locker.lock();
+    if (m_tail == m_head)
+    {
+        m_locker.unlock();
+        return nullptr;
+    }
+    T *item = m_items[m_head % m_capacity];
+    m_head++;
+    m_size.store(m_tail - m_head, std::memory_order_relaxed);
+    m_locker.unlock();
+    return item;
+}
+
+#endif
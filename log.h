@@ -25,6 +25,7 @@ public:
     static void * flush_log_thread(void * arg)
     {
         Log::get_instance()->async_write_log();
+        return nullptr;
     }
 
     //将输出内容按照标准格式整理
@@ -0,0 +1,201 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstdlib>
+#include <stdint.h>
+#include <exception>
+
+/*
+    Vyukov 的有界多生产者多消费者环形队列，无锁
+    每个槽有一个序号，生产者看到序号等于自己抢到的位置才写入，写完把序号加一交给消费者；
+    消费者读完把序号加上容量，留给绕一圈之后的生产者。
+    生产者和消费者各自只CAS自己的位置，两个位置之间隔开一个缓存行，互不干扰。
+    容量取不小于要求的2的幂，下标用与运算回绕
+*/
+template <class T>
+class MpmcQueue
+{
+public:
+    explicit MpmcQueue(long capacity);
+    ~MpmcQueue() { free(m_cells); }
+
+    // 满了返回false
+    bool push(T *item);
+
+    // 一次CAS占住连续的一段空槽放入多个元素，返回放入的个数，
+    // 空间不够或者后面的槽还没有被消费者读完时只放入前面的一部分
+    long push_batch(T **items, long count);
+
+    // 空了返回nullptr
+    T *pop();
+
+    // 大概的元素数量，不加任何同步
+    long size() const
+    {
+        long size = (long)(m_enqueue_pos.load(std::memory_order_relaxed) - m_dequeue_pos.load(std::memory_order_relaxed));
+        return size > 0 ? size : 0;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T *data;
+    };
+
+    // 用填充隔开而不用 alignas，嵌在别的对象里时不要求对象按缓存行对齐
+    Cell *m_cells;
+    size_t m_mask;
+    char m_pad0[64];
+    std::atomic<size_t> m_enqueue_pos;
+    char m_pad1[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_dequeue_pos;
+    char m_pad2[64 - sizeof(std::atomic<size_t>)];
+};
+
+template <class T>
+MpmcQueue<T>::MpmcQueue(long capacity) : m_enqueue_pos(0), m_dequeue_pos(0)
+{
+    size_t size = 2;
+    while ((long)size < capacity)
+    {
+        size <<= 1;
+    }
+
+    void *cells = nullptr;
+    if (posix_memalign(&cells, 64, sizeof(Cell) * size) != 0)
+    {
+        throw std::exception();
+    }
+    m_cells = (Cell *)cells;
+    m_mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+    {
+        m_cells[i].seq.store(i, std::memory_order_relaxed);
+        m_cells[i].data = nullptr;
+    }
+}
+
+template <class T>
+bool MpmcQueue<T>::push(T *item)
+{
+    Cell *cell;
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    while (true)
+    {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            // 槽是空的，抢这个位置
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // 绕了一圈，槽里的元素还没有被取走
+            return false;
+        }
+        else
+        {
+            // 被别的生产者抢先了
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->data = item;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template <class T>
+long MpmcQueue<T>::push_batch(T **items, long count)
+{
+    // 一个都不放时下面的循环会把它当成被别的生产者抢先，一直重试
+    if (count <= 0)
+    {
+        return 0;
+    }
+
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    long n;
+    while (true)
+    {
+        // 和 push 一样看槽的序号，只占住从 pos 开始连续的空槽。
+        // 消费者占住了位置还没有读完的槽不算空的，不在这里等它，reactor 线程不会被一个消费者卡住
+        intptr_t diff = 0;
+        for (n = 0; n < count; n++)
+        {
+            size_t seq = m_cells[(pos + n) & m_mask].seq.load(std::memory_order_acquire);
+            diff = (intptr_t)seq - (intptr_t)(pos + n);
+            if (diff != 0)
+            {
+                break;
+            }
+        }
+
+        if (n == 0 && diff < 0)
+        {
+            // 第一个槽里的元素还没有被取走
+            return 0;
+        }
+        if (n == 0)
+        {
+            // 被别的生产者抢先了
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (m_enqueue_pos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+        {
+            break;
+        }
+    }
+
+    // 占住的槽都是空的，没有别的线程会再改它们的序号
+    for (long i = 0; i < n; i++)
+    {
+        Cell *cell = &m_cells[(pos + i) & m_mask];
+        cell->data = items[i];
+        cell->seq.store(pos + i + 1, std::memory_order_release);
+    }
+    return n;
+}
+
+template <class T>
+T *MpmcQueue<T>::pop()
+{
+    Cell *cell;
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    while (true)
+    {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0)
+        {
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // 槽还没有被写入，队列是空的
+            return nullptr;
+        }
+        else
+        {
+            pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    T *item = cell->data;
+    cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+    return item;
+}
+
+#endif
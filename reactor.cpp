@@ -0,0 +1,451 @@
+#include "reactor.h"
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/timerfd.h>
+#include "log.h"
+
+int open_listenfd(int port, bool reuseport, int backlog)
+{
+    // 创建监听的socketfd
+    int listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenfd == -1)
+    {
+        perror("socket failed");
+        return -1;
+    }
+
+    // 设置端口复用
+    int reuse = 1;
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (reuseport && setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1)
+    {
+        perror("setsockopt SO_REUSEPORT failed");
+        close(listenfd);
+        return -1;
+    }
+
+    // 绑定端口
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (bind(listenfd, (sockaddr *)&address, sizeof(address)) == -1)
+    {
+        perror("bind failed");
+        close(listenfd);
+        return -1;
+    }
+
+    // 设置监听，全连接队列的长度会被内核限制在 net.core.somaxconn 以内
+    if (listen(listenfd, backlog) == -1)
+    {
+        perror("listen failed");
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
+
+bool drop_pending_connect(int listenfd, int &idlefd)
+{
+    close(idlefd);
+    int connfd = accept(listenfd, nullptr, nullptr);
+    if (connfd != -1)
+    {
+        close(connfd);
+    }
+    idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return connfd != -1;
+}
+
+void bind_cpu(int id)
+{
+    long cpu_number = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_number > 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(id % cpu_number, &cpuset);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    }
+}
+
+Reactor::Reactor(int id, int port, bool reuseport, int backlog, int idle_timeout, int request_timeout,
+                 Http_Connect *users, ThreadPool<Http_Connect> *pool, bool inline_mode)
+    : m_timer_wheel(TIMER_TICK_MS)
+{
+    m_id = id;
+    m_idle_timeout = idle_timeout;
+    m_request_timeout = request_timeout;
+    m_timer_expire = -1;
+    m_now = TimerWheel::now_ms();
+    m_users = users;
+    m_pool = pool;
+    m_stop = false;
+    m_ready_count = 0;
+    m_inline_mode = inline_mode;
+    m_inline_ns = 0;
+    m_inline_skip = 0;
+    m_inline_count = 0;
+    m_offload_count = 0;
+    m_stats_ms = m_now;
+
+    m_listenfd = open_listenfd(port, reuseport, backlog);
+    if (m_listenfd == -1)
+    {
+        throw std::exception();
+    }
+    m_idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    // 创建reactor自己的epoll
+    m_epollfd = epoll_create(5);
+    if (m_epollfd == -1)
+    {
+        perror("epoll_create failed");
+        close(m_idlefd);
+        close(m_listenfd);
+        throw std::exception();
+    }
+    // 监听socket使用边缘触发，每次通知都把队列中的连接全部取出
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = m_listenfd;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_listenfd, &event);
+
+    // 定时器使用单调时钟，不受系统时间调整的影响
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timerfd == -1)
+    {
+        perror("timerfd_create failed");
+        close(m_epollfd);
+        close(m_idlefd);
+        close(m_listenfd);
+        throw std::exception();
+    }
+    event.events = EPOLLIN;
+    event.data.fd = m_timerfd;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_timerfd, &event);
+}
+
+Reactor::~Reactor()
+{
+    close(m_timerfd);
+    close(m_epollfd);
+    close(m_idlefd);
+    close(m_listenfd);
+}
+
+void Reactor::start()
+{
+    if (pthread_create(&m_thread, nullptr, worker, this) != 0)
+    {
+        throw std::exception();
+    }
+    pthread_detach(m_thread);
+}
+
+void *Reactor::worker(void *arg)
+{
+    Reactor *reactor = (Reactor *)arg;
+    reactor->loop();
+    return reactor;
+}
+
+void Reactor::deal_accept()
+{
+    // 边缘触发只通知一次，要一直accept直到队列为空
+    while (true)
+    {
+        // 获取客户端的文件描述符，用于进行通信，直接创建为非阻塞的，不用再调用fcntl
+        sockaddr_in client_address;
+        socklen_t client_addrlength = sizeof(client_address);
+        int connfd = accept4(m_listenfd, (sockaddr *)&client_address, &client_addrlength,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connfd == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // 队列已经取空了
+                break;
+            }
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE)
+            {
+                // 文件描述符用完了，丢弃一个连接，否则它会一直留在队列中
+                if (drop_pending_connect(m_listenfd, m_idlefd))
+                {
+                    continue;
+                }
+                break;
+            }
+            printf("accept failed, errno: %d\n", errno);
+            break;
+        }
+
+        // 判断服务器服务的用户是否已经爆满
+        if (connfd >= MAX_FD || Http_Connect::m_uesr_count >= MAX_FD)
+        {
+            close(connfd); // 关闭通信的客户端文件描述符
+            continue;
+        }
+
+        // 连接注册到当前reactor的epoll中，之后一直由这个reactor负责
+        m_users[connfd].init(connfd, client_address, m_epollfd);
+        // 半连接或者一直不发请求的连接也会超时关闭
+        m_timer_wheel.add_timer(m_users[connfd].get_timer(), m_idle_timeout, m_now);
+    }
+}
+
+void Reactor::close_conn(int sockfd)
+{
+    m_timer_wheel.del_timer(m_users[sockfd].get_timer());
+    m_users[sockfd].close_connect();
+}
+
+void Reactor::dispatch(int sockfd)
+{
+    // 每个连接是 EPOLLONESHOT 的，一轮中最多出现一次，数组不会溢出
+    m_users[sockfd].set_busy(true);
+    if (m_inline_mode)
+    {
+        m_users[sockfd].set_dispatch_time(TimerWheel::now_ns());
+    }
+    m_ready[m_ready_count++] = &m_users[sockfd];
+    m_offload_count++;
+}
+
+void Reactor::flush_ready()
+{
+    int pushed = m_pool->append_batch(m_ready, m_ready_count);
+    for (int i = pushed; i < m_ready_count; i++)
+    {
+        // 请求队列满了，连接在数组中的下标就是文件描述符
+        int sockfd = m_ready[i] - m_users;
+        m_users[sockfd].set_busy(false);
+        close_conn(sockfd);
+    }
+    m_ready_count = 0;
+}
+
+bool Reactor::worth_inline()
+{
+    // 还没有统计到交接的代价时平均代价都是0，先直接处理
+    if (m_inline_ns <= Http_Connect::handoff_ns() || ++m_inline_skip >= INLINE_PROBE)
+    {
+        m_inline_skip = 0;
+        return true;
+    }
+    return false;
+}
+
+void Reactor::deal_inline(int sockfd)
+{
+    unsigned long long start = TimerWheel::now_ns();
+    Http_Connect::PROCESS_STATE state = m_users[sockfd].process_inline();
+    unsigned long long cost = TimerWheel::now_ns() - start;
+
+    if (state == Http_Connect::PROCESS_OFFLOAD)
+    {
+        // 白白花了时间，交接的代价也没有省下
+        cost += Http_Connect::handoff_ns();
+        dispatch(sockfd);
+    }
+    else
+    {
+        m_inline_count++;
+    }
+    if (cost > 1000000000ULL)
+    {
+        cost = 1000000000ULL;
+    }
+    m_inline_ns = m_inline_ns - m_inline_ns / 8 + (unsigned)cost / 8;
+
+    if (state == Http_Connect::PROCESS_CLOSE)
+    {
+        close_conn(sockfd);
+    }
+    else if (state == Http_Connect::PROCESS_WRITE)
+    {
+        // 响应已经生成好了，不用注册EPOLLOUT再等一轮，直接发送
+        deal_write(sockfd);
+    }
+}
+
+void Reactor::deal_write(int sockfd)
+{
+    if (m_users[sockfd].write() == false)
+    {
+        // 关闭连接
+        close_conn(sockfd);
+        return;
+    }
+
+    // 发送有进展，或者发送完等待下一个请求，都按空闲时间计算，
+    // 超过了限速时定时器用来在令牌攒够之后重新注册EPOLLOUT
+    int delay = m_users[sockfd].throttle_delay();
+    m_timer_wheel.adjust_timer(m_users[sockfd].get_timer(), delay > 0 ? delay : m_idle_timeout, m_now);
+
+    // 流水线上还有请求已经在读缓存区中了，不用等读事件，直接交给工作线程
+    if (m_users[sockfd].has_pending())
+    {
+        dispatch(sockfd);
+    }
+}
+
+void Reactor::on_timeout(TimerNode *timer, void *arg)
+{
+    Reactor *reactor = (Reactor *)arg;
+    reactor->deal_timeout(timer);
+}
+
+void Reactor::deal_timeout(TimerNode *timer)
+{
+    Http_Connect *conn = (Http_Connect *)timer->user_data;
+    if (conn->is_busy())
+    {
+        // 工作线程还在处理，推迟关闭
+        m_timer_wheel.add_timer(timer, m_idle_timeout, m_now);
+        return;
+    }
+    if (conn->resume_write())
+    {
+        // 限速的等待结束了，已经重新注册了EPOLLOUT，之后还是按空闲时间计算
+        m_timer_wheel.add_timer(timer, m_idle_timeout, m_now);
+        return;
+    }
+    if (conn->take_sent_direct())
+    {
+        // 定时器还是收到请求时设置的，之后工作线程直接发送了响应，空闲时间从最后一次发送开始计算
+        unsigned long long idle = m_now > conn->last_send() ? m_now - conn->last_send() : 0;
+        if (idle < (unsigned long long)m_idle_timeout)
+        {
+            m_timer_wheel.add_timer(timer, m_idle_timeout - (int)idle, m_now);
+            return;
+        }
+    }
+    conn->close_connect();
+}
+
+void Reactor::update_timerfd()
+{
+    long long expire = m_timer_wheel.next_expire();
+    if (expire == m_timer_expire)
+    {
+        return;
+    }
+    m_timer_expire = expire;
+
+    // 使用绝对时间，it_value 全为0表示取消定时
+    itimerspec value;
+    memset(&value, 0, sizeof(value));
+    if (expire >= 0)
+    {
+        value.it_value.tv_sec = expire / 1000;
+        value.it_value.tv_nsec = (expire % 1000) * 1000000 + 1;
+    }
+    timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &value, nullptr);
+}
+
+void Reactor::loop()
+{
+    // 每个reactor绑定到一个CPU上，减少线程在核之间的迁移
+    bind_cpu(m_id);
+
+    while (!m_stop)
+    {
+        // 阻塞判断数据缓存是否有变化，定时器到期时timerfd可读
+        int number = epoll_wait(m_epollfd, m_events, MAX_EVENT_NUMBER, -1);
+        // 这一轮事件处理都使用同一个时间，不用每次都调用clock_gettime
+        m_now = TimerWheel::now_ms();
+
+        // 如果不是被信号中断的错误
+        if ((number == -1) && (errno != EINTR))
+        {
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < number; i++)
+        {
+            int sockfd = m_events[i].data.fd;
+            if (sockfd == m_listenfd)
+            {
+                deal_accept();
+            }
+            else if (sockfd == m_timerfd)
+            {
+                // 读出到期次数，到期的定时器在这一轮的最后处理
+                uint64_t expirations;
+                if (::read(m_timerfd, &expirations, sizeof(expirations)) > 0)
+                {
+                    m_timer_expire = -1;
+                }
+            }
+            else if (m_events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+            {
+                // EPOLLRDHUP 表示对端的写操作已经关闭
+                // EPOLLHUP 表示对端异常关闭连接、套接字错误、或者套接字被重置
+                close_conn(sockfd);
+            }
+            else if (m_events[i].events & EPOLLIN)
+            {
+                // 检测到读事件，一次性读
+                bool new_request = !m_users[sockfd].in_request();
+                if (m_users[sockfd].read())
+                {
+                    // 收到新请求的第一个字节，之后要在请求超时时间内收完整个请求，
+                    // 请求没有收完之前再来的数据不会延后超时时间
+                    if (new_request)
+                    {
+                        // 之前的响应发送过了也不能延长这个请求的超时时间
+                        m_users[sockfd].take_sent_direct();
+                        m_timer_wheel.adjust_timer(m_users[sockfd].get_timer(), m_request_timeout, m_now);
+                    }
+                    else if (m_users[sockfd].in_body())
+                    {
+                        // 请求体可能很大，收到数据就按空闲时间重新计算
+                        m_timer_wheel.adjust_timer(m_users[sockfd].get_timer(), m_idle_timeout, m_now);
+                    }
+                    // 便宜的请求直接处理，其余的加入事件处理，这一轮结束时一起交给工作线程
+                    if (m_inline_mode && worth_inline())
+                    {
+                        deal_inline(sockfd);
+                    }
+                    else
+                    {
+                        dispatch(sockfd);
+                    }
+                }
+                else
+                {
+                    // 关闭连接
+                    close_conn(sockfd);
+                }
+            }
+            else if (m_events[i].events & EPOLLOUT)
+            {
+                deal_write(sockfd);
+            }
+        }
+
+        // 一轮中所有就绪的连接只入队一次，唤醒的线程数也有上限
+        flush_ready();
+
+        if (m_inline_mode && m_now - m_stats_ms >= (unsigned long long)STATS_INTERVAL_MS)
+        {
+            m_stats_ms = m_now;
+            Log::get_instance()->write_log(1, "reactor %d inline %llu offload %llu, inline cost %u ns, handoff %u ns", m_id,
+                           m_inline_count, m_offload_count, m_inline_ns, Http_Connect::handoff_ns());
+        }
+
+        // 最后处理定时事件，I/O事件的优先级更高
+        m_timer_wheel.tick(m_now, on_timeout, this);
+        update_timerfd();
+    }
+}
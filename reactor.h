@@ -0,0 +1,123 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include "http_connect.h"
+#include "threadpool.h"
+#include "timer_wheel.h"
+
+const int MAX_FD = 65535;           // 文件描述符的最大数量
+const int MAX_EVENT_NUMBER = 10000; // 监听的最大事件个数
+const int TIMER_TICK_MS = 1;        // 时间轮每一格的毫秒数
+const int INLINE_PROBE = 64;        // 直接处理不划算时，每隔多少个请求还是试一次，让估计跟上负载的变化
+const int STATS_INTERVAL_MS = 10000; // 多久往日志中输出一次直接处理和交给工作线程的请求数
+
+// 创建绑定到port的非阻塞监听socket，reuseport为true时设置SO_REUSEPORT，失败返回-1
+int open_listenfd(int port, bool reuseport, int backlog);
+
+/*
+    文件描述符用完(EMFILE/ENFILE)时，连接会一直留在全连接队列中，监听socket一直可读，
+    事件循环就会空转。所以预先打开一个空闲的文件描述符，用完时先关闭它，
+    腾出位置接受一个连接后立即关闭，再重新打开空闲的文件描述符。
+    成功丢弃一个连接返回true，队列已经空了返回false
+*/
+bool drop_pending_connect(int listenfd, int &idlefd);
+
+// 把当前线程绑定到第 id % CPU数量 个CPU上
+void bind_cpu(int id);
+
+/*
+    一个reactor就是一个事件循环，拥有自己的epoll实例和自己的监听socket。
+    定时器由时间轮管理，最近的到期时刻设置到timerfd上，timerfd和连接一起在epoll中监听，
+    不需要信号和管道，精度为毫秒。
+    多个reactor通过SO_REUSEPORT绑定同一个端口，由内核把新连接分发到各个监听socket上，
+    连接在整个生命周期内都只属于接受它的那个reactor。
+*/
+class Reactor
+{
+private:
+    int m_id;                         // reactor的编号，也用来绑定CPU
+    int m_listenfd;                   // 自己的监听socket，边缘触发
+    int m_idlefd;                     // 预留的空闲文件描述符，文件描述符用完时使用
+    int m_epollfd;                    // 自己的epoll实例
+    Http_Connect *m_users;            // 所有连接的数组，按文件描述符索引，所有reactor共享
+    ThreadPool<Http_Connect> *m_pool; // 工作线程池，所有reactor共享
+    pthread_t m_thread;               // 事件循环所在的线程
+    bool m_stop;                      // 是否结束事件循环
+    TimerWheel m_timer_wheel;         // 连接的超时定时器，只在事件循环线程中使用
+    int m_timerfd;                    // 单调时钟的timerfd，定时器到期时epoll可读
+    long long m_timer_expire;         // timerfd设置的到期时刻，单位毫秒，-1表示没有设置
+    unsigned long long m_now;         // 每轮事件循环缓存一次的单调时钟，单位毫秒
+    int m_idle_timeout;               // 连接空闲多少毫秒之后关闭
+    int m_request_timeout;            // 收到请求的第一个字节之后，多少毫秒内必须收完整个请求
+
+    epoll_event m_events[MAX_EVENT_NUMBER]; // 存储epoll查询事件的数组
+    Http_Connect *m_ready[MAX_EVENT_NUMBER]; // 这一轮要交给工作线程的连接
+    int m_ready_count;                       // m_ready 中连接的个数
+
+    /*
+        直接处理模式：缓存命中、错误、304这样便宜的请求在reactor中直接处理并发送，
+        不经过线程池，也不用等EPOLLOUT；需要打开文件、有请求体等可能阻塞的请求中途交给工作线程。
+        直接处理一个请求的平均代价(中途交出去的还要加上交接的代价)比交接的平均代价小时才直接处理
+    */
+    bool m_inline_mode;                 // 是否开启直接处理模式
+    unsigned m_inline_ns;               // 直接处理一个请求的平均代价，单位纳秒
+    int m_inline_skip;                  // 因为不划算而没有直接处理的连续请求数
+    unsigned long long m_inline_count;  // 在reactor中处理完的次数
+    unsigned long long m_offload_count; // 交给工作线程的次数
+    unsigned long long m_stats_ms;      // 上一次输出计数的时刻
+
+public:
+    // reuseport为true时，监听socket设置SO_REUSEPORT，允许多个reactor绑定同一个端口
+    // inline_mode为true时开启直接处理模式
+    Reactor(int id, int port, bool reuseport, int backlog, int idle_timeout, int request_timeout,
+            Http_Connect *users, ThreadPool<Http_Connect> *pool, bool inline_mode);
+    ~Reactor();
+
+    // 创建新线程运行事件循环
+    void start();
+
+    // 在当前线程运行事件循环
+    void loop();
+
+    // 在reactor中处理完的次数和交给工作线程的次数
+    unsigned long long inline_count() const { return m_inline_count; }
+    unsigned long long offload_count() const { return m_offload_count; }
+
+private:
+    // 创建线程之后的运行函数
+    static void *worker(void *arg);
+
+    // 接受全连接队列中所有的新连接
+    void deal_accept();
+
+    // 关闭连接并删除它的定时器
+    void close_conn(int sockfd);
+
+    // 标记连接正在处理，先放进这一轮的待处理数组
+    void dispatch(int sockfd);
+
+    // 把这一轮收集到的连接一次交给线程池，放不下的连接关闭
+    void flush_ready();
+
+    // 现在直接处理是否划算
+    bool worth_inline();
+
+    // 在reactor中直接处理连接上的请求，能发送就直接发送
+    void deal_inline(int sockfd);
+
+    // 连接可写，继续发送响应
+    void deal_write(int sockfd);
+
+    // 定时器到期的回调函数，arg为reactor
+    static void on_timeout(TimerNode *timer, void *arg);
+
+    // 关闭超时的连接
+    void deal_timeout(TimerNode *timer);
+
+    // 把timerfd设置为时间轮中最近一个定时器的到期时刻
+    void update_timerfd();
+};
+
+#endif
@@ -0,0 +1,5 @@
+#include "log.h"
+
+// main.cpp 里定义的全局变量，测试程序不链接 main.cpp，在这里给出定义。
+// 用到 Http_Connect 的测试要先用临时目录调用 Log::get_instance()->init
+Log * log = Log::get_instance();
@@ -0,0 +1,50 @@
+#!/bin/bash
+# 编译并运行 test 目录下的所有测试：除 main.cpp 之外的源文件编译一次，每个 test_*.cpp 链接成一个程序
+# 用法: test/run_tests.sh [测试名...]，例如 test/run_tests.sh test_hpack，不带参数时运行全部
+cd "$(dirname "$0")/.." || exit 1
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-std=c++11 -O2 -g -Wall"}
+OUT=${TEST_BUILD_DIR:-/tmp/webserver_test}
+mkdir -p "$OUT/obj" || exit 1
+
+objs=""
+for src in *.cpp; do
+    if [ "$src" = "main.cpp" ]; then
+        continue
+    fi
+    obj="$OUT/obj/${src%.cpp}.o"
+    if [ ! -f "$obj" ] || [ "$src" -nt "$obj" ] || [ -n "$(find . -maxdepth 1 -name '*.h' -newer "$obj")" ]; then
+        $CXX $CXXFLAGS -c "$src" -o "$obj" || exit 1
+    fi
+    objs="$objs $obj"
+done
+# main.cpp 里定义的全局变量
+if [ ! -f "$OUT/obj/globals.o" ] || [ test/globals.cpp -nt "$OUT/obj/globals.o" ]; then
+    $CXX $CXXFLAGS -I. -c test/globals.cpp -o "$OUT/obj/globals.o" || exit 1
+fi
+objs="$objs $OUT/obj/globals.o"
+
+if [ $# -gt 0 ]; then
+    tests="$*"
+else
+    tests=$(ls test/test_*.cpp | xargs -n1 basename | sed 's/\.cpp$//')
+fi
+
+failed=0
+for t in $tests; do
+    if ! $CXX $CXXFLAGS -I. "test/$t.cpp" $objs -o "$OUT/$t" -pthread -lz; then
+        echo "$t: build failed"
+        failed=$((failed + 1))
+        continue
+    fi
+    if ! "$OUT/$t"; then
+        failed=$((failed + 1))
+    fi
+done
+
+if [ $failed -ne 0 ]; then
+    echo "$failed test(s) failed"
+    exit 1
+fi
+echo "all tests passed"
@@ -0,0 +1,49 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <cstdio>
+#include <unistd.h>
+
+/*
+    测试用的检查宏，失败时打印位置和表达式，继续执行后面的检查，
+    main 最后返回 test_result()，有失败时进程的退出码不为0。
+    多线程的压力测试用 alarm 限制运行时间，卡住(例如漏掉了唤醒)时进程被信号结束，同样算失败
+*/
+static int test_failures = 0;
+
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);      \
+            test_failures++;                                                     \
+        }                                                                        \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                           \
+    do                                                                           \
+    {                                                                            \
+        long long check_a = (long long)(a);                                      \
+        long long check_b = (long long)(b);                                      \
+        if (check_a != check_b)                                                  \
+        {                                                                        \
+            printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__,   \
+                   __LINE__, #a, #b, check_a, check_b);                          \
+            test_failures++;                                                     \
+        }                                                                        \
+    } while (0)
+
+// 打印结果，返回进程的退出码
+static inline int test_result(const char *name)
+{
+    if (test_failures)
+    {
+        printf("%s: %d check(s) failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif
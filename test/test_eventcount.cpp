@@ -0,0 +1,236 @@
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+#include "eventcount.h"
+#include "locked_queue.h"
+#include "test.h"
+
+/*
+    EventCount 漏掉唤醒的压力测试
+    等待的一方按 prepare_wait、检查条件、cancel_wait 或 commit_wait 的顺序等待，
+    通知的一方先让条件成立再 notify。漏掉一次唤醒等待的线程就会一直睡下去，
+    测试被 alarm 结束
+*/
+
+// 一问一答：生产者放入一个之后等它被取走再放下一个，任何一次漏掉的唤醒都会卡住
+struct PingPong
+{
+    EventCount event;
+    std::atomic<int> available; // 放入还没取走的数量，只有0和1
+    std::atomic<int> consumed;
+    std::atomic<long> sleeps;   // 等待的线程真正睡眠的次数
+    int rounds;
+};
+
+static void *ping_pong_waiter(void *arg)
+{
+    PingPong *ctx = (PingPong *)arg;
+    for (int r = 0; r < ctx->rounds; r++)
+    {
+        for (;;)
+        {
+            int expected = 1;
+            if (ctx->available.compare_exchange_strong(expected, 0))
+            {
+                break;
+            }
+            int key = ctx->event.prepare_wait();
+            if (ctx->available.load() > 0)
+            {
+                ctx->event.cancel_wait();
+                continue;
+            }
+            ctx->event.commit_wait(key);
+            ctx->sleeps.fetch_add(1, std::memory_order_relaxed);
+        }
+        ctx->consumed.fetch_add(1, std::memory_order_release);
+    }
+    return nullptr;
+}
+
+static void test_ping_pong()
+{
+    PingPong ctx;
+    ctx.available.store(0);
+    ctx.consumed.store(0);
+    ctx.sleeps.store(0);
+    ctx.rounds = 50000;
+
+    pthread_t waiter;
+    pthread_create(&waiter, nullptr, ping_pong_waiter, &ctx);
+    for (int r = 0; r < ctx.rounds; r++)
+    {
+        ctx.available.store(1);
+        ctx.event.notify_one();
+        while (ctx.consumed.load(std::memory_order_acquire) <= r)
+        {
+            sched_yield();
+        }
+    }
+    pthread_join(waiter, nullptr);
+    CHECK_EQ(ctx.consumed.load(), ctx.rounds);
+    CHECK_EQ(ctx.available.load(), 0);
+    printf("ping pong: waiter slept %ld times in %d rounds\n", ctx.sleeps.load(), ctx.rounds);
+}
+
+// 多个生产者和等待者共享一个 LockedQueue，和线程池的注入队列用法相同
+struct Item
+{
+    std::atomic<int> taken;
+};
+
+static const int PRODUCERS = 3;
+static const int WAITERS = 4;
+static const int PER_PRODUCER = 40000;
+
+struct Shared
+{
+    LockedQueue<Item> queue;
+    EventCount event;
+    Item *items;
+    std::atomic<int> produced_by[PRODUCERS];
+    std::atomic<int> consumed;
+    std::atomic<bool> stop;
+
+    Shared() : queue(64) {}
+};
+
+struct ProducerArg
+{
+    Shared *shared;
+    int id;
+};
+
+static void *producer(void *arg)
+{
+    ProducerArg *p = (ProducerArg *)arg;
+    Shared *shared = p->shared;
+    Item *items = shared->items + p->id * PER_PRODUCER;
+    for (int i = 0; i < PER_PRODUCER; i++)
+    {
+        while (!shared->queue.push(&items[i]))
+        {
+            sched_yield();
+        }
+        // 三种通知方式轮流用
+        switch (i % 3)
+        {
+        case 0:
+            shared->event.notify_one();
+            break;
+        case 1:
+            shared->event.notify(2);
+            break;
+        default:
+            shared->event.notify_all();
+            break;
+        }
+    }
+    return nullptr;
+}
+
+static void *waiter(void *arg)
+{
+    Shared *shared = (Shared *)arg;
+    for (;;)
+    {
+        Item *item = shared->queue.pop();
+        if (item)
+        {
+            item->taken.fetch_add(1, std::memory_order_relaxed);
+            shared->consumed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        int key = shared->event.prepare_wait();
+        if (shared->queue.size() > 0 || shared->stop.load())
+        {
+            shared->event.cancel_wait();
+            if (shared->stop.load() && shared->queue.size() == 0)
+            {
+                return nullptr;
+            }
+            continue;
+        }
+        shared->event.commit_wait(key);
+    }
+}
+
+static void test_producers_and_waiters()
+{
+    Shared shared;
+    const int total = PRODUCERS * PER_PRODUCER;
+    shared.items = new Item[total];
+    for (int i = 0; i < total; i++)
+    {
+        shared.items[i].taken.store(0, std::memory_order_relaxed);
+    }
+    shared.consumed.store(0);
+    shared.stop.store(false);
+
+    pthread_t waiters[WAITERS];
+    for (int i = 0; i < WAITERS; i++)
+    {
+        pthread_create(&waiters[i], nullptr, waiter, &shared);
+    }
+    pthread_t producers[PRODUCERS];
+    ProducerArg args[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        args[i].shared = &shared;
+        args[i].id = i;
+        pthread_create(&producers[i], nullptr, producer, &args[i]);
+    }
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        pthread_join(producers[i], nullptr);
+    }
+    // 不靠结束时的 notify_all 把任务取完：漏掉的唤醒会让剩下的任务没有线程来取
+    while (shared.consumed.load() < total)
+    {
+        sched_yield();
+    }
+    shared.stop.store(true);
+    shared.event.notify_all();
+    for (int i = 0; i < WAITERS; i++)
+    {
+        pthread_join(waiters[i], nullptr);
+    }
+
+    CHECK_EQ(shared.consumed.load(), total);
+    int wrong = 0;
+    for (int i = 0; i < total; i++)
+    {
+        if (shared.items[i].taken.load() != 1)
+        {
+            wrong++;
+        }
+    }
+    CHECK_EQ(wrong, 0);
+    delete[] shared.items;
+}
+
+// 没有等待者时通知不改变序号，登记之后的通知让 commit_wait 立即返回
+static void test_single_thread()
+{
+    EventCount event;
+    event.notify_one();
+    event.notify(4);
+    event.notify_all();
+
+    int key = event.prepare_wait();
+    event.cancel_wait();
+    CHECK_EQ(event.prepare_wait(), key);
+    event.notify_one();
+    event.commit_wait(key); // 序号已经变了，不会睡眠
+    CHECK(event.prepare_wait() != key);
+    event.cancel_wait();
+}
+
+int main()
+{
+    alarm(120);
+    test_single_thread();
+    test_ping_pong();
+    test_producers_and_waiters();
+    return test_result("test_eventcount");
+}
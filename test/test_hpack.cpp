@@ -0,0 +1,438 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include "hpack.h"
+#include "test.h"
+
+/*
+    HPACK 的测试：RFC 7541 附录C的例子(C.3/C.5 不用Huffman，C.4/C.6 用Huffman，
+    C.5/C.6 的动态表只有256字节，会淘汰旧的条目)，HpackTable 的大小计算和淘汰，
+    编码器和解码器的往返，以及各种格式错误的头部块被拒绝
+*/
+
+typedef std::vector<std::pair<std::string, std::string> > Headers;
+
+static bool collect(void *arg, const char *name, int name_len, const char *value, int value_len)
+{
+    Headers *headers = (Headers *)arg;
+    headers->push_back(std::make_pair(std::string(name, name_len), std::string(value, value_len)));
+    return true;
+}
+
+static std::vector<uint8_t> from_hex(const char *hex)
+{
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2)
+    {
+        char byte[3] = {hex[i], hex[i + 1], 0};
+        bytes.push_back((uint8_t)strtol(byte, nullptr, 16));
+    }
+    return bytes;
+}
+
+static bool decode(HpackDecoder &decoder, const std::vector<uint8_t> &block, Headers &headers)
+{
+    headers.clear();
+    return decoder.decode(block.empty() ? nullptr : &block[0], block.size(), collect, &headers);
+}
+
+// 解码一个头部块，和期望的头部逐个比较，expected 是 名字、值 交替的数组，以nullptr结束
+static void expect_block(HpackDecoder &decoder, const std::vector<uint8_t> &block, const char *const *expected,
+                         const char *label)
+{
+    Headers headers;
+    CHECK(decode(decoder, block, headers));
+    size_t count = 0;
+    while (expected[count * 2])
+    {
+        count++;
+    }
+    if (headers.size() != count)
+    {
+        printf("%s: %d headers, expected %d\n", label, (int)headers.size(), (int)count);
+        CHECK_EQ(headers.size(), count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (headers[i].first != expected[i * 2] || headers[i].second != expected[i * 2 + 1])
+        {
+            printf("%s: header %d is \"%s: %s\"\n", label, (int)i, headers[i].first.c_str(), headers[i].second.c_str());
+            CHECK(!"header mismatch");
+        }
+    }
+}
+
+// 用索引的头部(62、63...)依次取出动态表的条目和期望的比较，再多一个下标要被拒绝
+static void expect_table(HpackDecoder &decoder, const char *const *expected, const char *label)
+{
+    int count = 0;
+    while (expected[count * 2])
+    {
+        count++;
+    }
+    std::vector<uint8_t> block;
+    for (int i = 0; i < count; i++)
+    {
+        block.push_back(0x80 | (HpackTable::STATIC_NUMBER + 1 + i));
+    }
+    char label_table[64];
+    snprintf(label_table, sizeof(label_table), "%s table", label);
+    expect_block(decoder, block, expected, label_table);
+
+    Headers headers;
+    std::vector<uint8_t> beyond(1, 0x80 | (HpackTable::STATIC_NUMBER + 1 + count));
+    CHECK(!decode(decoder, beyond, headers));
+}
+
+// C.3 和 C.4 的三个请求，第二个和第三个引用前面加入动态表的条目
+static const char *const request1[] = {":method", "GET", ":scheme", "http", ":path", "/",
+                                       ":authority", "www.example.com", nullptr};
+static const char *const request2[] = {":method", "GET", ":scheme", "http", ":path", "/",
+                                       ":authority", "www.example.com", "cache-control", "no-cache", nullptr};
+static const char *const request3[] = {":method", "GET", ":scheme", "https", ":path", "/index.html",
+                                       ":authority", "www.example.com", "custom-key", "custom-value", nullptr};
+static const char *const request_table1[] = {":authority", "www.example.com", nullptr};
+static const char *const request_table2[] = {"cache-control", "no-cache", ":authority", "www.example.com", nullptr};
+static const char *const request_table3[] = {"custom-key", "custom-value", "cache-control", "no-cache",
+                                             ":authority", "www.example.com", nullptr};
+
+static void test_requests(const char *const *hex, const char *label)
+{
+    HpackDecoder decoder;
+    const char *const *expected[] = {request1, request2, request3};
+    const char *const *tables[] = {request_table1, request_table2, request_table3};
+    for (int i = 0; i < 3; i++)
+    {
+        expect_block(decoder, from_hex(hex[i]), expected[i], label);
+        expect_table(decoder, tables[i], label);
+    }
+}
+
+static void test_c3_c4()
+{
+    const char *c3[] = {
+        "828684410f7777772e6578616d706c652e636f6d",
+        "828684be58086e6f2d6361636865",
+        "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565",
+    };
+    const char *c4[] = {
+        "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+        "828684be5886a8eb10649cbf",
+        "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+    };
+    test_requests(c3, "C.3");
+    test_requests(c4, "C.4");
+}
+
+// C.5 和 C.6 的三个响应，动态表上限256字节，第二个响应淘汰 :status 302，第三个淘汰三个条目
+static const char *const response1[] = {":status", "302", "cache-control", "private",
+                                        "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+                                        "location", "https://www.example.com", nullptr};
+static const char *const response2[] = {":status", "307", "cache-control", "private",
+                                        "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+                                        "location", "https://www.example.com", nullptr};
+static const char *const response3[] = {":status", "200", "cache-control", "private",
+                                        "date", "Mon, 21 Oct 2013 20:13:22 GMT",
+                                        "location", "https://www.example.com", "content-encoding", "gzip",
+                                        "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1",
+                                        nullptr};
+static const char *const response_table1[] = {"location", "https://www.example.com",
+                                              "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+                                              "cache-control", "private", ":status", "302", nullptr};
+static const char *const response_table2[] = {":status", "307", "location", "https://www.example.com",
+                                              "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+                                              "cache-control", "private", nullptr};
+static const char *const response_table3[] = {"set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1",
+                                              "content-encoding", "gzip",
+                                              "date", "Mon, 21 Oct 2013 20:13:22 GMT", nullptr};
+
+static void test_responses(const char *const *hex, const char *label)
+{
+    HpackDecoder decoder;
+    const char *const *expected[] = {response1, response2, response3};
+    const char *const *tables[] = {response_table1, response_table2, response_table3};
+    for (int i = 0; i < 3; i++)
+    {
+        // 例子假定 SETTINGS_HEADER_TABLE_SIZE 是256，这里在第一个头部块前面加上动态表大小更新
+        std::string block = i == 0 ? std::string("3fe101") + hex[i] : std::string(hex[i]);
+        expect_block(decoder, from_hex(block.c_str()), expected[i], label);
+        expect_table(decoder, tables[i], label);
+    }
+}
+
+static void test_c5_c6()
+{
+    const char *c5[] = {
+        "4803333032580770726976617465611d4d6f6e2c203231204f637420323031332032303a31333a323120474d54"
+        "6e1768747470733a2f2f7777772e6578616d706c652e636f6d",
+        "4803333037c1c0bf",
+        "88c1611d4d6f6e2c203231204f637420323031332032303a31333a323220474d54c05a04677a697077"
+        "38666f6f3d4153444a4b48514b425a584f5157454f50495541585157454f49553b206d61782d6167653d"
+        "333630303b2076657273696f6e3d31",
+    };
+    const char *c6[] = {
+        "488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1bff6e919d29ad171863c7"
+        "8f0b97c8e9ae82ae43d3",
+        "4883640effc1c0bf",
+        "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad94e7821dd7f2e6c7b3"
+        "35dfdfcd5b3960d5af27087f3672c1ab270fb5291f9587316065c003ed4ee5b1063d5007",
+    };
+    test_responses(c5, "C.5");
+    test_responses(c6, "C.6");
+}
+
+// HpackTable 的大小按名字、值的长度加32计算，放不下时淘汰最旧的
+static void test_table()
+{
+    HpackTable table;
+    const char *name, *value;
+    int name_len, value_len;
+
+    CHECK(table.get(2, name, name_len, value, value_len));
+    CHECK(std::string(name, name_len) == ":method" && std::string(value, value_len) == "GET");
+    CHECK(table.get(61, name, name_len, value, value_len));
+    CHECK(std::string(name, name_len) == "www-authenticate");
+    CHECK(!table.get(0, name, name_len, value, value_len));
+    CHECK(!table.get(62, name, name_len, value, value_len));
+
+    table.set_max_size(100);
+    table.add("aaaa", 4, "1111", 4); // 40
+    table.add("bbbb", 4, "2222", 4); // 80
+    CHECK_EQ(table.find("aaaa", 4, "1111", 4), 63);
+    CHECK_EQ(table.find("bbbb", 4, "2222", 4), 62);
+    table.add("cccc", 4, "3333", 4); // 120 > 100，淘汰 aaaa
+    CHECK_EQ(table.find("aaaa", 4, "1111", 4), 0);
+    CHECK_EQ(table.find("cccc", 4, "3333", 4), 62);
+    CHECK(table.get(63, name, name_len, value, value_len));
+    CHECK(std::string(name, name_len) == "bbbb");
+    CHECK(!table.get(64, name, name_len, value, value_len));
+
+    // 新条目的名字就是要被淘汰的条目的名字
+    CHECK(table.get(63, name, name_len, value, value_len));
+    table.add(name, name_len, "4444", 4);
+    CHECK_EQ(table.find("bbbb", 4, "4444", 4), 62);
+    CHECK_EQ(table.find("cccc", 4, "3333", 4), 63);
+    CHECK_EQ(table.find("bbbb", 4, "2222", 4), 0);
+
+    // 比整个表还大的条目清空动态表
+    std::string big(80, 'x');
+    table.add(big.data(), big.size(), "", 0);
+    CHECK(!table.get(62, name, name_len, value, value_len));
+
+    // 缩小上限时淘汰
+    table.set_max_size(4096);
+    table.add("aaaa", 4, "1111", 4);
+    table.add("bbbb", 4, "2222", 4);
+    table.set_max_size(40);
+    CHECK_EQ(table.find("bbbb", 4, "2222", 4), 62);
+    CHECK_EQ(table.find("aaaa", 4, "1111", 4), 0);
+    table.set_max_size(0);
+    CHECK(!table.get(62, name, name_len, value, value_len));
+
+    // 名字和值都为空的条目正好32字节，条目数达到上限，环形数组绕很多圈
+    table.set_max_size(HpackTable::DEFAULT_SIZE);
+    for (int i = 0; i < 1000; i++)
+    {
+        table.add("", 0, "", 0);
+    }
+    CHECK(table.get(61 + HpackTable::MAX_ENTRIES, name, name_len, value, value_len));
+    CHECK(!table.get(62 + HpackTable::MAX_ENTRIES, name, name_len, value, value_len));
+    table.add("", 0, "z", 1); // 33字节，淘汰两个
+    CHECK(table.get(62, name, name_len, value, value_len));
+    CHECK(std::string(value, value_len) == "z");
+    CHECK(table.get(60 + HpackTable::MAX_ENTRIES, name, name_len, value, value_len));
+    CHECK(!table.get(61 + HpackTable::MAX_ENTRIES, name, name_len, value, value_len));
+}
+
+// 编码器的输出能被解码器解出来，第二次编码同样的头部只用一个字节
+static void test_encoder_round_trip()
+{
+    HpackEncoder encoder;
+    HpackDecoder decoder;
+    uint8_t buf[256];
+    Headers headers;
+
+    encoder.set_max_size(256);
+    for (int round = 0; round < 3; round++)
+    {
+        encoder.begin(buf, sizeof(buf));
+        encoder.indexed(8);                       // :status: 200
+        encoder.field(54, "webserver", 9, true);  // server
+        encoder.field(28, "1234", 4, false);      // content-length
+        int len = encoder.end();
+        CHECK(len > 0);
+        headers.clear();
+        CHECK(decoder.decode(buf, len, collect, &headers));
+        CHECK_EQ(headers.size(), 3);
+        if (headers.size() == 3)
+        {
+            CHECK(headers[0].first == ":status" && headers[0].second == "200");
+            CHECK(headers[1].first == "server" && headers[1].second == "webserver");
+            CHECK(headers[2].first == "content-length" && headers[2].second == "1234");
+        }
+        if (round == 0)
+        {
+            // 第一次带着动态表大小更新
+            CHECK_EQ(buf[0] & 0xe0, 0x20);
+        }
+        else
+        {
+            // :status 和已经在动态表中的 server 各一个字节，content-length 不加入动态表，
+            // 名字的下标两个字节，值的长度一个字节
+            CHECK_EQ(len, 1 + 1 + 2 + 1 + 4);
+        }
+    }
+
+    // 空间不够
+    encoder.begin(buf, 4);
+    encoder.field(54, "webserver", 9, false);
+    CHECK_EQ(encoder.end(), -1);
+}
+
+// count个'a'的Huffman编码，后面跟着pad_bits位的填充，用来构造格式错误的输入
+static std::vector<uint8_t> huffman_a(int count, int pad_bits, bool pad_ones)
+{
+    // 'a' 的码字是 00011，5位
+    std::vector<uint8_t> out;
+    unsigned long long acc = 0;
+    int nbits = 0;
+    for (int i = 0; i < count; i++)
+    {
+        acc = (acc << 5) | 0x3;
+        nbits += 5;
+        while (nbits >= 8)
+        {
+            out.push_back((uint8_t)(acc >> (nbits - 8)));
+            nbits -= 8;
+        }
+    }
+    for (int i = 0; i < pad_bits; i++)
+    {
+        acc = (acc << 1) | (pad_ones ? 1 : 0);
+        nbits++;
+        if (nbits == 8)
+        {
+            out.push_back((uint8_t)acc);
+            nbits = 0;
+        }
+    }
+    if (nbits)
+    {
+        CHECK(!"huffman_a: pad_bits must fill the last byte");
+    }
+    return out;
+}
+
+// 不加入动态表、名字是字符串的头部：0x00，Huffman编码的名字，值 "v"
+static std::vector<uint8_t> literal_with_huffman_name(const std::vector<uint8_t> &name)
+{
+    std::vector<uint8_t> block;
+    block.push_back(0x00);
+    if (name.size() < 127)
+    {
+        block.push_back(0x80 | name.size());
+    }
+    else
+    {
+        // 长度超过7位前缀，按整数编码
+        block.push_back(0xff);
+        unsigned rest = name.size() - 127;
+        while (rest >= 128)
+        {
+            block.push_back(0x80 | (rest & 0x7f));
+            rest >>= 7;
+        }
+        block.push_back(rest);
+    }
+    block.insert(block.end(), name.begin(), name.end());
+    block.push_back(0x01);
+    block.push_back('v');
+    return block;
+}
+
+static bool accepts(const std::vector<uint8_t> &block)
+{
+    HpackDecoder decoder;
+    Headers headers;
+    return decode(decoder, block, headers);
+}
+
+static void test_huffman_rejects()
+{
+    // 合法：8个'a'正好5个字节；3个'a'加1位填充
+    CHECK(accepts(literal_with_huffman_name(huffman_a(8, 0, true))));
+    CHECK(accepts(literal_with_huffman_name(huffman_a(3, 1, true))));
+    CHECK(accepts(literal_with_huffman_name(huffman_a(1, 3, true))));
+
+    // 填充超过7位：一个'a'之后是11个1
+    CHECK(!accepts(literal_with_huffman_name(huffman_a(1, 11, true))));
+    // 一整个字节的填充
+    CHECK(!accepts(literal_with_huffman_name(huffman_a(8, 8, true))));
+    // 填充不是1
+    CHECK(!accepts(literal_with_huffman_name(huffman_a(1, 3, false))));
+
+    // 字符串中出现EOS(30个1)
+    CHECK(!accepts(from_hex("0084ffffffff0176")));
+    CHECK(!accepts(from_hex("00851fffffffff0176")));
+
+    // 解码后超过 MAX_STRING
+    CHECK(accepts(literal_with_huffman_name(huffman_a(HpackDecoder::MAX_STRING - 8, 0, true))));
+    CHECK(!accepts(literal_with_huffman_name(huffman_a(HpackDecoder::MAX_STRING + 8, 0, true))));
+}
+
+static void test_integer_rejects()
+{
+    // 动态表大小更新是5位前缀的整数，正好等于 DEFAULT_SIZE 可以接受；
+    // 后续字节超过4个、截断的整数、比剩下的数据还长的字符串都被拒绝
+    CHECK(accepts(from_hex("3fe11f")));        // 动态表大小 31+97+3968 = 4096
+    CHECK(!accepts(from_hex("3fe21f")));       // 4097，超过声明的大小
+    CHECK(!accepts(from_hex("3fe1ffffff0f"))); // 很大的数
+    CHECK(!accepts(from_hex("ff8080808001"))); // 后续字节超过4个
+    CHECK(!accepts(from_hex("ff80808080808001")));
+    CHECK(!accepts(from_hex("ffffffffffffffffff7f"))); // 溢出
+    CHECK(!accepts(from_hex("ff")));                   // 截断的整数
+    CHECK(!accepts(from_hex("ff80")));
+    CHECK(!accepts(from_hex("007fffffff0f")));         // 字符串长度远超过剩下的数据
+    CHECK(!accepts(from_hex("000361")));               // 字符串截断
+    CHECK(!accepts(from_hex("00")));
+    CHECK(!accepts(from_hex("40")));
+}
+
+static void test_index_rejects()
+{
+    CHECK(!accepts(from_hex("80")));     // 下标0
+    CHECK(!accepts(from_hex("be")));     // 动态表是空的
+    CHECK(!accepts(from_hex("7e0176"))); // 加入动态表的头部，名字的下标62不存在
+    CHECK(accepts(from_hex("bd")));      // 61 是静态表的最后一个
+    CHECK(accepts(from_hex("")));
+}
+
+// 回调返回false时停止解码
+static bool stop_after_one(void *arg, const char *, int, const char *, int)
+{
+    int *count = (int *)arg;
+    return ++*count < 1;
+}
+
+static void test_callback_stop()
+{
+    HpackDecoder decoder;
+    std::vector<uint8_t> block = from_hex("828684");
+    int count = 0;
+    CHECK(!decoder.decode(&block[0], block.size(), stop_after_one, &count));
+    CHECK_EQ(count, 1);
+}
+
+int main()
+{
+    test_c3_c4();
+    test_c5_c6();
+    test_table();
+    test_encoder_round_trip();
+    test_huffman_rejects();
+    test_integer_rejects();
+    test_index_rejects();
+    test_callback_stop();
+    return test_result("test_hpack");
+}
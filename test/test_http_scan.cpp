@@ -0,0 +1,177 @@
+#include <cstring>
+#include <string>
+#include "http_scan.h"
+#include "test.h"
+
+/*
+    scan_line 的每一种SIMD实现和逐字节的实现对比：
+    行尾('\r'或者'\n')和':'落在16、32字节块的边界两侧，只有'\n'的行，
+    起始地址不对齐，调用前 *colon 已经有值，以及随机的输入
+*/
+
+static scan_func scalar;
+static const char *impl_names[] = {"sse4.2", "avx2"};
+
+struct Result
+{
+    const char *eol;
+    const char *colon;
+};
+
+static Result run(scan_func func, const char *begin, const char *end, const char *colon)
+{
+    Result result;
+    result.colon = colon;
+    result.eol = func(begin, end, &result.colon);
+    return result;
+}
+
+// 和逐字节的实现比较，不一致时打印输入的位置
+static void compare(scan_func func, const char *name, const char *begin, const char *end, const char *colon)
+{
+    Result expected = run(scalar, begin, end, colon);
+    Result got = run(func, begin, end, colon);
+    if (got.eol != expected.eol || got.colon != expected.colon)
+    {
+        printf("%s: len %d: eol %ld/%ld colon %ld/%ld\n", name, (int)(end - begin), (long)(got.eol - begin),
+               (long)(expected.eol - begin), got.colon ? (long)(got.colon - begin) : -1L,
+               expected.colon ? (long)(expected.colon - begin) : -1L);
+        CHECK(!"simd and scalar disagree");
+    }
+}
+
+// 逐字节的实现本身的结果
+static void test_scalar()
+{
+    const char line[] = "Host: example.com\r\nAccept: */*\r\n";
+    const char *end = line + sizeof(line) - 1;
+    Result r = run(scalar, line, end, nullptr);
+    CHECK_EQ(r.eol - line, 17);
+    CHECK_EQ(r.colon - line, 4);
+
+    // ':' 在行尾之后不算
+    const char request[] = "GET /a:b HTTP/1.1\nHost: x\n";
+    r = run(scalar, request, request + 5, nullptr);
+    CHECK(r.eol == request + 5);
+    CHECK(r.colon == nullptr);
+    r = run(scalar, request + 8, request + sizeof(request) - 1, nullptr);
+    CHECK_EQ(r.eol - request, 17);
+    CHECK(r.colon == nullptr);
+
+    // 已经有值的 *colon 不会被改写
+    r = run(scalar, line, end, line + 1);
+    CHECK(r.colon == line + 1);
+
+    r = run(scalar, line, line, nullptr);
+    CHECK(r.eol == line);
+}
+
+// 行尾和':'放在每一个块边界附近的位置，起始地址偏移0到3个字节
+static void test_boundaries(scan_func func, const char *name)
+{
+    const int positions[] = {0, 1, 2, 14, 15, 16, 17, 30, 31, 32, 33, 46, 47, 48, 62, 63, 64, 65, 95, 96};
+    const int npos = sizeof(positions) / sizeof(positions[0]);
+    const char eols[] = {'\r', '\n'};
+    char buf[160];
+
+    for (int shift = 0; shift < 4; shift++)
+    {
+        for (int len = 0; len <= 100; len++)
+        {
+            for (int e = -1; e < npos; e++)
+            {
+                for (int c = -1; c < npos; c++)
+                {
+                    for (int kind = 0; kind < 2; kind++)
+                    {
+                        char *begin = buf + shift;
+                        memset(buf, 'a', sizeof(buf));
+                        if (c >= 0 && positions[c] < len)
+                        {
+                            begin[positions[c]] = ':';
+                        }
+                        if (e >= 0 && positions[e] < len)
+                        {
+                            begin[positions[e]] = eols[kind];
+                        }
+                        // 结尾之后紧跟着行尾，不能被读到结果里
+                        begin[len] = '\n';
+                        compare(func, name, begin, begin + len, nullptr);
+                        compare(func, name, begin, begin + len, begin);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// 只用'\n'分隔的请求，逐行扫描
+static void test_bare_lf(scan_func func, const char *name)
+{
+    std::string request = "GET /index.html HTTP/1.1\nHost: localhost:9006\n"
+                          "User-Agent: a-very-long-user-agent-string/1.0 (with: colons)\n"
+                          "X-Empty:\n\nAccept: text/html\r\n\r\n";
+    for (int round = 0; round < 40; round++)
+    {
+        const char *p = request.data();
+        const char *end = p + request.size();
+        int lines = 0;
+        while (p < end)
+        {
+            compare(func, name, p, end, nullptr);
+            Result r = run(func, p, end, nullptr);
+            p = r.eol < end ? r.eol + 1 : end;
+            lines++;
+        }
+        CHECK(lines >= 7);
+        // 每一轮在前面多加一个字节，行尾在块中的位置都不同
+        request.insert(request.begin() + 5, 'x');
+    }
+}
+
+// 随机输入，字符集中 '\r'、'\n'、':' 的比例较高，也有'\0'和大于127的字节
+static void test_random(scan_func func, const char *name)
+{
+    const char alphabet[] = {'a', 'Z', ' ', ':', '\r', '\n', '\0', (char)0x80, (char)0xff, (char)0x8d, (char)0x8a};
+    char buf[200];
+    unsigned seed = 7;
+    for (int round = 0; round < 200000; round++)
+    {
+        seed = seed * 1103515245 + 12345;
+        int len = (seed >> 8) % 130;
+        int rare = 1 + (seed >> 20) % 64; // 控制特殊字符的密度，让行尾落在不同的块里
+        int shift = round % 8;
+        for (int i = 0; i < shift + len; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            unsigned r = seed >> 16;
+            buf[i] = (r % rare == 0) ? alphabet[3 + (r / rare) % 8] : alphabet[(r / rare) % 3];
+        }
+        compare(func, name, buf + shift, buf + shift + len, nullptr);
+    }
+}
+
+int main()
+{
+    scalar = scan_impl_by_name("scalar");
+    CHECK(scalar != nullptr);
+    CHECK(scan_impl_by_name("unknown") == nullptr);
+    test_scalar();
+
+    // scan_line 用的是其中一种实现
+    CHECK(scan_impl_by_name(scan_impl_name()) != nullptr);
+
+    for (unsigned i = 0; i < sizeof(impl_names) / sizeof(impl_names[0]); i++)
+    {
+        scan_func func = scan_impl_by_name(impl_names[i]);
+        if (!func)
+        {
+            printf("%s: not supported by this CPU, skipped\n", impl_names[i]);
+            continue;
+        }
+        test_boundaries(func, impl_names[i]);
+        test_bare_lf(func, impl_names[i]);
+        test_random(func, impl_names[i]);
+    }
+    return test_result("test_http_scan");
+}
@@ -0,0 +1,85 @@
+#include "locked_queue.h"
+#include "test.h"
+
+// LockedQueue 的测试：容量不取整、满和空、push_batch 只放入一部分、下标绕圈
+
+struct Item
+{
+    int id;
+};
+
+static void test_capacity()
+{
+    LockedQueue<Item> queue(5);
+    Item items[8];
+    CHECK(queue.pop() == nullptr);
+    for (int i = 0; i < 5; i++)
+    {
+        CHECK(queue.push(&items[i]));
+    }
+    CHECK(!queue.push(&items[5]));
+    CHECK_EQ(queue.size(), 5);
+    for (int i = 0; i < 5; i++)
+    {
+        CHECK(queue.pop() == &items[i]);
+    }
+    CHECK(queue.pop() == nullptr);
+    CHECK_EQ(queue.size(), 0);
+
+    bool thrown = false;
+    try
+    {
+        LockedQueue<Item> bad(0);
+    }
+    catch (const std::exception &)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+static void test_push_batch()
+{
+    LockedQueue<Item> queue(5);
+    Item items[8];
+    Item *batch[8];
+    for (int i = 0; i < 8; i++)
+    {
+        batch[i] = &items[i];
+    }
+    CHECK(queue.push(&items[7]));
+    // 只剩4个位置，放入前4个
+    CHECK_EQ(queue.push_batch(batch, 8), 4);
+    CHECK_EQ(queue.push_batch(batch, 8), 0);
+    CHECK(queue.pop() == &items[7]);
+    for (int i = 0; i < 4; i++)
+    {
+        CHECK(queue.pop() == &items[i]);
+    }
+    CHECK(queue.pop() == nullptr);
+    CHECK_EQ(queue.push_batch(batch, 0), 0);
+}
+
+static void test_wrap_around()
+{
+    LockedQueue<Item> queue(3);
+    Item items[3];
+    for (int round = 0; round < 1000; round++)
+    {
+        CHECK(queue.push(&items[0]));
+        CHECK(queue.push(&items[1]));
+        CHECK(queue.pop() == &items[0]);
+        CHECK(queue.push(&items[2]));
+        CHECK(queue.pop() == &items[1]);
+        CHECK(queue.pop() == &items[2]);
+    }
+    CHECK_EQ(queue.size(), 0);
+}
+
+int main()
+{
+    test_capacity();
+    test_push_batch();
+    test_wrap_around();
+    return test_result("test_locked_queue");
+}
@@ -0,0 +1,253 @@
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+#include "mpmc_queue.h"
+#include "test.h"
+
+// MpmcQueue 的测试：容量取整、满和空、下标绕圈、push_batch 只放入一部分，以及多生产者多消费者的压力测试
+
+struct Item
+{
+    int producer;
+    int seq;
+    std::atomic<int> taken;
+};
+
+static void test_capacity()
+{
+    Item items[16];
+    // 容量取不小于要求的2的幂，最小是2
+    long requested[] = {1, 2, 5, 8};
+    long expected[] = {2, 2, 8, 8};
+    for (int c = 0; c < 4; c++)
+    {
+        MpmcQueue<Item> queue(requested[c]);
+        CHECK(queue.pop() == nullptr);
+        long pushed = 0;
+        while (pushed < 16 && queue.push(&items[pushed]))
+        {
+            pushed++;
+        }
+        CHECK_EQ(pushed, expected[c]);
+        CHECK_EQ(queue.size(), expected[c]);
+        for (long i = 0; i < pushed; i++)
+        {
+            CHECK(queue.pop() == &items[i]);
+        }
+        CHECK(queue.pop() == nullptr);
+        CHECK_EQ(queue.size(), 0);
+    }
+}
+
+static void test_wrap_around()
+{
+    MpmcQueue<Item> queue(4);
+    Item items[4];
+    // 每一圈放入取出的个数和容量互质，序号走很多圈之后每个位置都被用过
+    for (int round = 0; round < 1000; round++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            CHECK(queue.push(&items[i]));
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            CHECK(queue.pop() == &items[i]);
+        }
+        CHECK(queue.pop() == nullptr);
+    }
+    // 绕圈之后满的判断仍然正确
+    for (int i = 0; i < 4; i++)
+    {
+        CHECK(queue.push(&items[i]));
+    }
+    CHECK(!queue.push(&items[0]));
+    CHECK(queue.pop() == &items[0]);
+    CHECK(queue.push(&items[0]));
+    CHECK(!queue.push(&items[1]));
+}
+
+static void test_push_batch()
+{
+    MpmcQueue<Item> queue(8);
+    Item items[16];
+    Item *batch[16];
+    for (int i = 0; i < 16; i++)
+    {
+        batch[i] = &items[i];
+    }
+
+    CHECK_EQ(queue.push_batch(batch, 0), 0);
+    CHECK_EQ(queue.push_batch(batch, 5), 5);
+    // 只剩3个空槽
+    CHECK_EQ(queue.push_batch(batch + 5, 11), 3);
+    CHECK_EQ(queue.push_batch(batch, 1), 0);
+    CHECK(!queue.push(&items[0]));
+
+    // 取走2个之后放入的一批跨过数组的末尾
+    CHECK(queue.pop() == &items[0]);
+    CHECK(queue.pop() == &items[1]);
+    CHECK_EQ(queue.push_batch(batch + 8, 4), 2);
+    for (int i = 2; i < 10; i++)
+    {
+        CHECK(queue.pop() == &items[i]);
+    }
+    CHECK(queue.pop() == nullptr);
+
+    // 多圈之后一批占满整个队列
+    for (int round = 0; round < 100; round++)
+    {
+        CHECK_EQ(queue.push_batch(batch + (round % 8), 8), 8);
+        for (int i = 0; i < 8; i++)
+        {
+            CHECK(queue.pop() == batch[round % 8 + i]);
+        }
+    }
+}
+
+// 压力测试：一半生产者用 push，一半用 push_batch，消费者检查每个生产者的元素按放入的顺序取出
+static const int PRODUCERS = 4;
+static const int CONSUMERS = 3;
+static const int PER_PRODUCER = 100000;
+static const int BATCH = 7;
+
+struct Shared
+{
+    MpmcQueue<Item> queue;
+    Item *items;
+    std::atomic<int> consumed;
+    std::atomic<int> out_of_order;
+
+    Shared() : queue(64) {}
+};
+
+struct ProducerArg
+{
+    Shared *shared;
+    int id;
+};
+
+static void *producer(void *arg)
+{
+    ProducerArg *p = (ProducerArg *)arg;
+    Item *items = p->shared->items + p->id * PER_PRODUCER;
+    int next = 0;
+    while (next < PER_PRODUCER)
+    {
+        if (p->id % 2 == 0)
+        {
+            if (p->shared->queue.push(&items[next]))
+            {
+                next++;
+                continue;
+            }
+        }
+        else
+        {
+            Item *batch[BATCH];
+            long count = PER_PRODUCER - next < BATCH ? PER_PRODUCER - next : BATCH;
+            for (long i = 0; i < count; i++)
+            {
+                batch[i] = &items[next + i];
+            }
+            long pushed = p->shared->queue.push_batch(batch, count);
+            if (pushed > 0)
+            {
+                next += pushed;
+                continue;
+            }
+        }
+        sched_yield();
+    }
+    return nullptr;
+}
+
+static void *consumer(void *arg)
+{
+    Shared *shared = (Shared *)arg;
+    const int total = PRODUCERS * PER_PRODUCER;
+    int last[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        last[i] = -1;
+    }
+    while (shared->consumed.load(std::memory_order_relaxed) < total)
+    {
+        Item *item = shared->queue.pop();
+        if (!item)
+        {
+            sched_yield();
+            continue;
+        }
+        // 同一个消费者看到的同一个生产者的元素一定按放入的顺序
+        if (item->seq <= last[item->producer])
+        {
+            shared->out_of_order.fetch_add(1, std::memory_order_relaxed);
+        }
+        last[item->producer] = item->seq;
+        item->taken.fetch_add(1, std::memory_order_relaxed);
+        shared->consumed.fetch_add(1, std::memory_order_relaxed);
+    }
+    return nullptr;
+}
+
+static void test_stress()
+{
+    Shared shared;
+    const int total = PRODUCERS * PER_PRODUCER;
+    shared.items = new Item[total];
+    for (int i = 0; i < total; i++)
+    {
+        shared.items[i].producer = i / PER_PRODUCER;
+        shared.items[i].seq = i % PER_PRODUCER;
+        shared.items[i].taken.store(0, std::memory_order_relaxed);
+    }
+    shared.consumed.store(0);
+    shared.out_of_order.store(0);
+
+    pthread_t consumers[CONSUMERS];
+    for (int i = 0; i < CONSUMERS; i++)
+    {
+        pthread_create(&consumers[i], nullptr, consumer, &shared);
+    }
+    pthread_t producers[PRODUCERS];
+    ProducerArg args[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        args[i].shared = &shared;
+        args[i].id = i;
+        pthread_create(&producers[i], nullptr, producer, &args[i]);
+    }
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        pthread_join(producers[i], nullptr);
+    }
+    for (int i = 0; i < CONSUMERS; i++)
+    {
+        pthread_join(consumers[i], nullptr);
+    }
+
+    CHECK_EQ(shared.consumed.load(), total);
+    CHECK_EQ(shared.out_of_order.load(), 0);
+    CHECK(shared.queue.pop() == nullptr);
+    int wrong = 0;
+    for (int i = 0; i < total; i++)
+    {
+        if (shared.items[i].taken.load() != 1)
+        {
+            wrong++;
+        }
+    }
+    CHECK_EQ(wrong, 0);
+    delete[] shared.items;
+}
+
+int main()
+{
+    alarm(120);
+    test_capacity();
+    test_wrap_around();
+    test_push_batch();
+    test_stress();
+    return test_result("test_mpmc_queue");
+}
@@ -0,0 +1,313 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "http_connect.h"
+#include "test.h"
+
+/*
+    Range请求的测试，走和io_uring后端一样的路径：把请求交给 feed，process_request 生成响应，
+    再按 get_iov/get_file/update_iov 把响应(包括文件的部分)拼出来，检查状态码、
+    Content-Range、Content-Length和实际发送的字节数，多个区间时逐个检查每一段
+*/
+
+extern const char *doc_root;
+
+static const off_t FILE_SIZE = 1000;
+static std::string file_data;
+
+// 按发送的顺序拼出完整的响应
+static std::string collect(Http_Connect &conn)
+{
+    std::string out;
+    for (;;)
+    {
+        int count = 0;
+        struct iovec *iov = conn.get_iov(count);
+        off_t bytes = 0;
+        for (int i = 0; i < count; i++)
+        {
+            out.append((const char *)iov[i].iov_base, iov[i].iov_len);
+            bytes += iov[i].iov_len;
+        }
+        off_t offset = 0, len = 0;
+        int fd = conn.get_file(offset, len);
+        if (fd >= 0)
+        {
+            std::string part(len, '\0');
+            CHECK_EQ(pread(fd, &part[0], len, offset), len);
+            out += part;
+            bytes += len;
+        }
+        if (conn.update_iov(bytes))
+        {
+            return out;
+        }
+        if (bytes == 0)
+        {
+            CHECK(!"no progress");
+            return out;
+        }
+    }
+}
+
+static std::string request(const std::string &url, const std::string &headers)
+{
+    static Http_Connect conn;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    conn.init(100, addr, -1);
+    std::string req = "GET " + url + " HTTP/1.1\r\nHost: test\r\n" + headers + "\r\n";
+    std::string out;
+    if (conn.feed(req.data(), req.size()) && conn.process_request() == Http_Connect::PROCESS_WRITE)
+    {
+        out = collect(conn);
+    }
+    conn.close_connect(false);
+    return out;
+}
+
+struct Response
+{
+    int status;
+    std::string headers; // 含最后的空行
+    std::string body;
+};
+
+static std::string header(const Response &response, const char *name)
+{
+    std::string key = std::string("\r\n") + name + ": ";
+    size_t pos = response.headers.find(key);
+    if (pos == std::string::npos)
+    {
+        return "";
+    }
+    pos += key.size();
+    return response.headers.substr(pos, response.headers.find("\r\n", pos) - pos);
+}
+
+static Response parse(const std::string &raw)
+{
+    Response response;
+    response.status = 0;
+    size_t end = raw.find("\r\n\r\n");
+    if (raw.compare(0, 9, "HTTP/1.1 ") != 0 || end == std::string::npos)
+    {
+        return response;
+    }
+    response.status = atoi(raw.c_str() + 9);
+    response.headers = raw.substr(0, end + 4);
+    response.body = raw.substr(end + 4);
+    return response;
+}
+
+struct Range
+{
+    long first;
+    long last;
+};
+
+static std::string content_range(long first, long last)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "bytes %ld-%ld/%ld", first, last, (long)FILE_SIZE);
+    return buf;
+}
+
+// 多个区间的响应体：每一段是分隔线、Content-Type、Content-Range、空行和内容，最后是结束的分隔线
+static void check_multipart(const Response &response, const std::vector<Range> &ranges, const char *spec)
+{
+    std::string type = header(response, "Content-Type");
+    const char *prefix = "multipart/byteranges; boundary=";
+    CHECK(type.compare(0, strlen(prefix), prefix) == 0);
+    std::string boundary = type.substr(strlen(prefix));
+
+    std::string expected;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        expected += "\r\n--" + boundary + "\r\nContent-Type: text/html\r\nContent-Range: " +
+                    content_range(ranges[i].first, ranges[i].last) + "\r\n\r\n" +
+                    file_data.substr(ranges[i].first, ranges[i].last - ranges[i].first + 1);
+    }
+    expected += "\r\n--" + boundary + "--\r\n";
+    if (response.body != expected)
+    {
+        printf("multipart body mismatch for %s\n", spec);
+        CHECK(response.body == expected);
+    }
+}
+
+struct RangeCase
+{
+    const char *spec;   // Range请求头的值
+    int status;         // 200表示忽略Range发送整个文件
+    Range ranges[8];    // 期望的区间
+    int count;
+};
+
+static const RangeCase cases[] = {
+    {"bytes=0-99", 206, {{0, 99}}, 1},
+    {"bytes=0-0", 206, {{0, 0}}, 1},
+    {"bytes=999-999", 206, {{999, 999}}, 1},
+    {"bytes=900-", 206, {{900, 999}}, 1},                  // 开放的结尾
+    {"bytes=990-5000", 206, {{990, 999}}, 1},              // 结尾截到文件末尾
+    {"bytes=-100", 206, {{900, 999}}, 1},                  // 最后100个字节
+    {"bytes=-1000", 206, {{0, 999}}, 1},
+    {"bytes=-5000", 206, {{0, 999}}, 1},                   // 后缀比文件长
+    {"BYTES=10-19", 206, {{10, 19}}, 1},                   // 单位不区分大小写
+    {"bytes=1000-", 416, {}, 0},                           // 从文件末尾开始
+    {"bytes=1000-1100, 2000-", 416, {}, 0},
+    {"bytes=-0", 416, {}, 0},                              // 空的后缀
+    {"bytes=0-9,20-29", 206, {{0, 9}, {20, 29}}, 2},
+    {"bytes=0-99, 50-149", 206, {{0, 99}, {50, 149}}, 2},  // 重叠的区间原样发送
+    {"bytes=500-599,0-9", 206, {{500, 599}, {0, 9}}, 2},   // 按请求的顺序
+    {"bytes=-10, 0-4, 1000-", 206, {{990, 999}, {0, 4}}, 2}, // 不能满足的区间跳过
+    {"bytes=1000-, 5-5", 206, {{5, 5}}, 1},                // 只剩一个区间时不用multipart
+    {"bytes = 0-1", 200, {}, 0},
+    {"bytes=0-1,2-3,4-5,6-7,8-9,10-11,12-13,14-15", 206,
+     {{0, 1}, {2, 3}, {4, 5}, {6, 7}, {8, 9}, {10, 11}, {12, 13}, {14, 15}}, 8},
+    {"bytes=0-1,2-3,4-5,6-7,8-9,10-11,12-13,14-15,16-17", 200, {}, 0}, // 超过 MAX_RANGES
+    {"bytes=5-3", 200, {}, 0},                             // 结尾在开头之前
+    {"bytes=abc", 200, {}, 0},
+    {"bytes=", 200, {}, 0},
+    {"bytes=-", 200, {}, 0},
+    {"bytes=0-1;x", 200, {}, 0},
+    {"items=0-1", 200, {}, 0},
+};
+
+static void test_ranges()
+{
+    for (unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        const RangeCase &rc = cases[c];
+        Response response = parse(request("/range.txt", std::string("Range: ") + rc.spec + "\r\n"));
+        if (response.status != rc.status)
+        {
+            printf("Range: %s\n", rc.spec);
+        }
+        CHECK_EQ(response.status, rc.status);
+        // 实际发送的响应体和Content-Length一致
+        CHECK_EQ(atol(header(response, "Content-Length").c_str()), response.body.size());
+
+        if (rc.status == 200)
+        {
+            CHECK(response.body == file_data);
+            CHECK(header(response, "Content-Range").empty());
+        }
+        else if (rc.status == 416)
+        {
+            CHECK(response.body.empty());
+            CHECK(header(response, "Content-Range") == "bytes */1000");
+        }
+        else if (rc.count == 1)
+        {
+            CHECK(header(response, "Content-Range") == content_range(rc.ranges[0].first, rc.ranges[0].last));
+            CHECK(response.body == file_data.substr(rc.ranges[0].first, rc.ranges[0].last - rc.ranges[0].first + 1));
+        }
+        else
+        {
+            CHECK(header(response, "Content-Range").empty());
+            check_multipart(response, std::vector<Range>(rc.ranges, rc.ranges + rc.count), rc.spec);
+        }
+    }
+}
+
+// 流水线上第二个多区间的请求在响应队列中放不下，改为发送整个文件
+static void test_queue_full()
+{
+    static Http_Connect conn;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    conn.init(100, addr, -1);
+    std::string one = "GET /range.txt HTTP/1.1\r\nHost: test\r\n"
+                      "Range: bytes=0-1,2-3,4-5,6-7,8-9,10-11,12-13,14-15\r\n\r\n";
+    std::string both = one + one;
+    CHECK(conn.feed(both.data(), both.size()));
+    CHECK_EQ(conn.process_request(), Http_Connect::PROCESS_WRITE);
+    std::string raw = collect(conn);
+    conn.close_connect(false);
+
+    Response first = parse(raw);
+    CHECK_EQ(first.status, 206);
+    long length = atol(header(first, "Content-Length").c_str());
+    CHECK(length > 0 && (size_t)length < first.body.size());
+    Response second = parse(first.body.substr(length));
+    first.body.resize(length);
+    std::vector<Range> ranges;
+    for (int i = 0; i < 8; i++)
+    {
+        Range range = {i * 2, i * 2 + 1};
+        ranges.push_back(range);
+    }
+    check_multipart(first, ranges, "first pipelined request");
+    CHECK_EQ(second.status, 200);
+    CHECK(second.body == file_data);
+}
+
+// 空文件没有能满足的区间
+static void test_empty_file()
+{
+    const char *specs[] = {"bytes=0-", "bytes=-5", "bytes=0-0"};
+    for (int i = 0; i < 3; i++)
+    {
+        Response response = parse(request("/empty.txt", std::string("Range: ") + specs[i] + "\r\n"));
+        CHECK_EQ(response.status, 416);
+        CHECK(header(response, "Content-Range") == "bytes */0");
+        CHECK(response.body.empty());
+    }
+}
+
+// If-Range 和文件现在的 ETag 一样才发送一部分
+static void test_if_range()
+{
+    Response full = parse(request("/range.txt", ""));
+    CHECK_EQ(full.status, 200);
+    std::string etag = header(full, "ETag");
+    CHECK(!etag.empty());
+
+    Response match = parse(request("/range.txt", "Range: bytes=0-9\r\nIf-Range: " + etag + "\r\n"));
+    CHECK_EQ(match.status, 206);
+    CHECK(match.body == file_data.substr(0, 10));
+
+    Response stale = parse(request("/range.txt", "Range: bytes=0-9\r\nIf-Range: \"stale\"\r\n"));
+    CHECK_EQ(stale.status, 200);
+    CHECK(stale.body == file_data);
+}
+
+static bool write_file(const std::string &path, const std::string &data)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (!fp)
+    {
+        return false;
+    }
+    fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    return true;
+}
+
+int main()
+{
+    char dir[] = "/tmp/webserver_range_XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        return 1;
+    }
+    Log::get_instance()->init((std::string(dir) + "/log").c_str(), 2000, 800000, 0);
+    doc_root = dir;
+
+    for (off_t i = 0; i < FILE_SIZE; i++)
+    {
+        file_data += (char)('a' + (i * 7 + i / 26) % 26);
+    }
+    CHECK(write_file(std::string(dir) + "/range.txt", file_data));
+    CHECK(write_file(std::string(dir) + "/empty.txt", ""));
+
+    test_ranges();
+    test_queue_full();
+    test_empty_file();
+    test_if_range();
+
+    std::string cleanup = std::string("rm -rf ") + dir;
+    CHECK_EQ(system(cleanup.c_str()), 0);
+    return test_result("test_range");
+}
@@ -0,0 +1,161 @@
+#include <atomic>
+#include <sched.h>
+#include "threadpool.h"
+#include "test.h"
+
+/*
+    工作窃取线程池的测试：从外面提交的任务进注入队列，工作线程提交的任务进自己的本地队列，
+    被别的线程偷走执行，每个任务都要正好执行一次。注入队列是 MpmcQueue 和 LockedQueue 各测一遍
+*/
+
+template <template <class> class Queue>
+struct Job
+{
+    typedef ThreadPool<Job, Queue<Job> > Pool;
+
+    std::atomic<int> runs;       // 执行的次数
+    Job *children;               // 执行时由工作线程提交的任务，没有为nullptr
+    int child_count;
+    Pool *pool;
+    std::atomic<int> *finished;  // 所有任务共享的完成计数
+
+    void process()
+    {
+        runs.fetch_add(1, std::memory_order_relaxed);
+        for (int i = 0; i < child_count; i++)
+        {
+            // 工作线程自己提交的任务放进本地队列，本地队列满了才进注入队列
+            while (!pool->append(&children[i]))
+            {
+                sched_yield();
+            }
+        }
+        finished->fetch_add(1, std::memory_order_release);
+    }
+};
+
+template <template <class> class Queue>
+static void init_job(Job<Queue> &job, typename Job<Queue>::Pool *pool, std::atomic<int> *finished)
+{
+    job.runs.store(0, std::memory_order_relaxed);
+    job.children = nullptr;
+    job.child_count = 0;
+    job.pool = pool;
+    job.finished = finished;
+}
+
+static void wait_finished(std::atomic<int> &finished, int total)
+{
+    while (finished.load(std::memory_order_acquire) < total)
+    {
+        sched_yield();
+    }
+}
+
+template <template <class> class Queue>
+static int count_wrong(Job<Queue> *jobs, int count)
+{
+    int wrong = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (jobs[i].runs.load() != 1)
+        {
+            wrong++;
+        }
+    }
+    return wrong;
+}
+
+// 从外面一个一个提交，每个任务再由工作线程提交几个子任务
+template <template <class> class Queue>
+static void test_append_and_steal()
+{
+    typedef Job<Queue> TestJob;
+    const int PARENTS = 2000;
+    const int CHILDREN = 20;
+    std::atomic<int> finished(0);
+    TestJob *parents = new TestJob[PARENTS];
+    TestJob *children = new TestJob[PARENTS * CHILDREN];
+    {
+        typename TestJob::Pool pool(4, 64);
+        for (int i = 0; i < PARENTS; i++)
+        {
+            init_job(parents[i], &pool, &finished);
+            parents[i].children = &children[i * CHILDREN];
+            parents[i].child_count = CHILDREN;
+        }
+        for (int i = 0; i < PARENTS * CHILDREN; i++)
+        {
+            init_job(children[i], &pool, &finished);
+        }
+
+        for (int i = 0; i < PARENTS; i++)
+        {
+            // 注入队列满了就等工作线程取走一些
+            while (!pool.append(&parents[i]))
+            {
+                sched_yield();
+            }
+        }
+        wait_finished(finished, PARENTS * (CHILDREN + 1));
+    }
+    CHECK_EQ(finished.load(), PARENTS * (CHILDREN + 1));
+    CHECK_EQ(count_wrong(parents, PARENTS), 0);
+    CHECK_EQ(count_wrong(children, PARENTS * CHILDREN), 0);
+    delete[] parents;
+    delete[] children;
+}
+
+// 从外面一次提交一批，注入队列放不下时剩下的下次再提交
+template <template <class> class Queue>
+static void test_append_batch()
+{
+    typedef Job<Queue> TestJob;
+    const int JOBS = 50000;
+    const int BATCH = 13;
+    std::atomic<int> finished(0);
+    TestJob *jobs = new TestJob[JOBS];
+    TestJob *batch[BATCH];
+    long partial = 0; // 只放入了一部分的次数
+    {
+        typename TestJob::Pool pool(4, 64);
+        for (int i = 0; i < JOBS; i++)
+        {
+            init_job(jobs[i], &pool, &finished);
+        }
+        CHECK_EQ(pool.append_batch(batch, 0), 0);
+
+        int next = 0;
+        while (next < JOBS)
+        {
+            int count = JOBS - next < BATCH ? JOBS - next : BATCH;
+            for (int i = 0; i < count; i++)
+            {
+                batch[i] = &jobs[next + i];
+            }
+            int pushed = pool.append_batch(batch, count);
+            CHECK(pushed >= 0 && pushed <= count);
+            if (pushed < count)
+            {
+                partial++;
+                sched_yield();
+            }
+            next += pushed;
+        }
+        wait_finished(finished, JOBS);
+    }
+    CHECK_EQ(finished.load(), JOBS);
+    CHECK_EQ(count_wrong(jobs, JOBS), 0);
+    printf("append_batch: %ld partial batches\n", partial);
+    delete[] jobs;
+}
+
+int main()
+{
+    alarm(120);
+    test_append_and_steal<MpmcQueue>();
+    test_append_and_steal<LockedQueue>();
+    test_append_batch<MpmcQueue>();
+    test_append_batch<LockedQueue>();
+    return test_result("test_threadpool");
+}
@@ -0,0 +1,319 @@
+#include "timer_wheel.h"
+#include "test.h"
+
+/*
+    TimerWheel 的测试，全部用传入的时间驱动，不依赖真实的时钟
+    每格1毫秒，定时器的延迟跨过每一层的边界(64、4096、262144、16777216格)，
+    时间轮当前的格分别对齐和不对齐高层的边界，检查定时器正好在到期的那一格触发，
+    以及按 next_timeout 睡眠不会错过定时器
+*/
+
+struct TestTimer
+{
+    TimerNode node;
+    unsigned long long expire; // 期望到期的时刻
+    int fired;                 // 触发的次数
+    unsigned long long fired_at;
+};
+
+struct Clock
+{
+    unsigned long long now;  // 本次 tick 传入的时刻
+    unsigned long long prev; // 上一次 tick 传入的时刻
+    int fired;
+    int early;               // 提前触发的次数
+    int late;                // 没有在第一次 now >= expire 的 tick 中触发的次数
+};
+
+static void on_timer(TimerNode *node, void *arg)
+{
+    Clock *clock = (Clock *)arg;
+    TestTimer *timer = (TestTimer *)node->user_data;
+    timer->fired++;
+    timer->fired_at = clock->now;
+    clock->fired++;
+    if (clock->now < timer->expire)
+    {
+        clock->early++;
+    }
+    if (clock->prev >= timer->expire)
+    {
+        clock->late++;
+    }
+}
+
+static void init_clock(Clock &clock, unsigned long long now)
+{
+    clock.now = now;
+    clock.prev = now;
+    clock.fired = 0;
+    clock.early = 0;
+    clock.late = 0;
+}
+
+static void advance(TimerWheel &wheel, Clock &clock, unsigned long long now)
+{
+    clock.prev = clock.now;
+    clock.now = now;
+    wheel.tick(now, on_timer, &clock);
+}
+
+static void add(TimerWheel &wheel, Clock &clock, TestTimer &timer, int timeout)
+{
+    timer.node.user_data = &timer;
+    timer.expire = clock.now + timeout;
+    timer.fired = 0;
+    timer.fired_at = 0;
+    wheel.add_timer(&timer.node, timeout, clock.now);
+}
+
+// 一个远在真实时钟之后、对齐到最高层边界的时刻，空的时间轮直接跳过去
+static unsigned long long aligned_base()
+{
+    return ((TimerWheel::now_ms() >> 30) + 2) << 30;
+}
+
+// 每一层边界附近的延迟，当前格对齐和不对齐高层边界时都正好在到期的那一格触发
+static void test_level_boundaries()
+{
+    const int delays[] = {1, 2, 63, 64, 65, 127, 128, 4095, 4096, 4097, 262143, 262144, 262145,
+                          16777215, 16777216, 16777217, 3 * 16777216 + 5};
+    const unsigned long long offsets[] = {0, 1, 63, 64, 4095, 4096 + 17, 262144 - 1, 16777216 - 3};
+
+    for (unsigned o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++)
+    {
+        for (unsigned d = 0; d < sizeof(delays) / sizeof(delays[0]); d++)
+        {
+            TimerWheel wheel(1);
+            Clock clock;
+            // 空的时间轮 tick 到 start-1，下一个要处理的格就是 start
+            unsigned long long start = aligned_base() + offsets[o];
+            init_clock(clock, start - 1);
+            wheel.tick(start - 1, on_timer, &clock);
+
+            TestTimer timer;
+            add(wheel, clock, timer, delays[d]);
+            advance(wheel, clock, timer.expire - 1);
+            CHECK_EQ(timer.fired, 0);
+            advance(wheel, clock, timer.expire);
+            CHECK_EQ(timer.fired, 1);
+            CHECK_EQ(wheel.next_timeout(clock.now), -1);
+            if (timer.fired != 1)
+            {
+                printf("  offset %llu delay %d\n", offsets[o], delays[d]);
+            }
+        }
+    }
+}
+
+// 按 next_timeout 睡眠：每次醒来的时刻都不晚于最近的定时器，总的唤醒次数不超过层数的两倍
+static void test_next_timeout()
+{
+    const int delays[] = {1, 64, 100, 4096, 5000, 262144, 300000, 16777216, 20000000};
+    for (unsigned d = 0; d < sizeof(delays) / sizeof(delays[0]); d++)
+    {
+        TimerWheel wheel(1);
+        Clock clock;
+        unsigned long long start = aligned_base() + 12345;
+        init_clock(clock, start - 1);
+        wheel.tick(start - 1, on_timer, &clock);
+
+        TestTimer timer;
+        add(wheel, clock, timer, delays[d]);
+        int wakeups = 0;
+        while (!timer.fired && wakeups < 100)
+        {
+            int timeout = wheel.next_timeout(clock.now);
+            CHECK(timeout >= 0);
+            CHECK(clock.now + timeout <= timer.expire);
+            advance(wheel, clock, clock.now + timeout);
+            wakeups++;
+        }
+        CHECK_EQ(timer.fired, 1);
+        CHECK_EQ(timer.fired_at, timer.expire);
+        CHECK(wakeups <= 10);
+    }
+}
+
+// 大量定时器，随机的延迟和随机的 tick 步长，每个定时器正好触发一次，不提前也不拖后
+static void test_random()
+{
+    const int COUNT = 5000;
+    TestTimer *timers = new TestTimer[COUNT];
+    TimerWheel wheel(1);
+    Clock clock;
+    unsigned long long start = aligned_base() - 777;
+    init_clock(clock, start - 1);
+    wheel.tick(start - 1, on_timer, &clock);
+
+    unsigned seed = 2024;
+    for (int i = 0; i < COUNT; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        int delay = 1 + (seed >> 8) % (1 << (6 + (i % 4) * 5)); // 四档范围，落在不同的层
+        add(wheel, clock, timers[i], delay);
+    }
+    while (clock.fired < COUNT && clock.now < start + (1 << 22))
+    {
+        seed = seed * 1103515245 + 12345;
+        advance(wheel, clock, clock.now + 1 + (seed >> 8) % 3000);
+    }
+    CHECK_EQ(clock.fired, COUNT);
+    CHECK_EQ(clock.early, 0);
+    CHECK_EQ(clock.late, 0);
+    int wrong = 0;
+    for (int i = 0; i < COUNT; i++)
+    {
+        if (timers[i].fired != 1)
+        {
+            wrong++;
+        }
+    }
+    CHECK_EQ(wrong, 0);
+    CHECK_EQ(wheel.next_timeout(clock.now), -1);
+    delete[] timers;
+}
+
+// adjust_timer：在原来的层里提前、推后，以及已经从高层分配到低层之后再调整
+static void test_adjust()
+{
+    TimerWheel wheel(1);
+    Clock clock;
+    unsigned long long start = aligned_base() + 100;
+    init_clock(clock, start - 1);
+    wheel.tick(start - 1, on_timer, &clock);
+
+    TestTimer shorter, longer, cascaded, neighbour;
+    add(wheel, clock, shorter, 5000);
+    add(wheel, clock, longer, 70);
+    add(wheel, clock, cascaded, 300000);
+    add(wheel, clock, neighbour, 300000); // 和 cascaded 在同一个槽里
+
+    // 提前：从第2层挪到第1层
+    wheel.adjust_timer(&shorter.node, 100, clock.now);
+    shorter.expire = clock.now + 100;
+    // 推后：从第1层挪到第3层
+    wheel.adjust_timer(&longer.node, 300000, clock.now);
+    longer.expire = clock.now + 300000;
+
+    advance(wheel, clock, start + 98);
+    CHECK_EQ(shorter.fired, 0);
+    advance(wheel, clock, start + 99);
+    CHECK_EQ(shorter.fired, 1);
+    advance(wheel, clock, start + 5000);
+    CHECK_EQ(shorter.fired, 1);
+    CHECK_EQ(longer.fired, 0);
+
+    // cascaded 到期前不久已经被分配到第0层，这时再推后
+    advance(wheel, clock, cascaded.expire - 10);
+    CHECK_EQ(cascaded.fired, 0);
+    wheel.adjust_timer(&cascaded.node, 5000, clock.now);
+    cascaded.expire = clock.now + 5000;
+    advance(wheel, clock, neighbour.expire);
+    CHECK_EQ(neighbour.fired, 1);
+    CHECK_EQ(longer.fired, 1);
+    CHECK_EQ(cascaded.fired, 0);
+    advance(wheel, clock, cascaded.expire - 1);
+    CHECK_EQ(cascaded.fired, 0);
+    advance(wheel, clock, cascaded.expire);
+    CHECK_EQ(cascaded.fired, 1);
+
+    CHECK_EQ(clock.fired, 4);
+    CHECK_EQ(clock.early, 0);
+    CHECK_EQ(clock.late, 0);
+    CHECK_EQ(wheel.next_timeout(clock.now), -1);
+}
+
+// del_timer：删除已经从高层分配下来的定时器，同一个槽里的其他定时器不受影响
+static void test_del_cascaded()
+{
+    TimerWheel wheel(1);
+    Clock clock;
+    unsigned long long start = aligned_base() + 4000;
+    init_clock(clock, start - 1);
+    wheel.tick(start - 1, on_timer, &clock);
+
+    TestTimer timers[5];
+    for (int i = 0; i < 5; i++)
+    {
+        add(wheel, clock, timers[i], 262144 + 64 * 3 + i);
+    }
+    // 两次分配之后都落在第0层的同一圈里
+    advance(wheel, clock, timers[0].expire - 20);
+    CHECK_EQ(clock.fired, 0);
+    wheel.del_timer(&timers[0].node);
+    wheel.del_timer(&timers[2].node);
+    wheel.del_timer(&timers[2].node); // 删除两次没有影响
+    wheel.del_timer(&timers[4].node);
+    advance(wheel, clock, timers[4].expire + 1000);
+    CHECK_EQ(timers[0].fired, 0);
+    CHECK_EQ(timers[1].fired, 1);
+    CHECK_EQ(timers[2].fired, 0);
+    CHECK_EQ(timers[3].fired, 1);
+    CHECK_EQ(timers[4].fired, 0);
+    CHECK_EQ(clock.late, 0);
+
+    // 还在高层的槽里时删除
+    TestTimer high, low;
+    add(wheel, clock, high, 20000000);
+    add(wheel, clock, low, 20000000);
+    wheel.del_timer(&high.node);
+    advance(wheel, clock, low.expire);
+    CHECK_EQ(high.fired, 0);
+    CHECK_EQ(low.fired, 1);
+    CHECK_EQ(wheel.next_timeout(clock.now), -1);
+
+    // 删除之后可以再添加
+    add(wheel, clock, high, 64);
+    advance(wheel, clock, high.expire);
+    CHECK_EQ(high.fired, 1);
+}
+
+// 回调里重新添加同一个定时器，下一次 tick 才再触发，不会在同一次 tick 中循环
+static int readd_calls = 0;
+
+static void readd_timer(TimerNode *node, void *arg)
+{
+    TimerWheel *wheel = (TimerWheel *)arg;
+    TestTimer *timer = (TestTimer *)node->user_data;
+    timer->fired++;
+    readd_calls++;
+    if (timer->fired < 3)
+    {
+        wheel->add_timer(node, 0, timer->expire);
+    }
+}
+
+static void test_readd_in_callback()
+{
+    TimerWheel wheel(1);
+    unsigned long long start = aligned_base();
+    Clock clock;
+    init_clock(clock, start - 1);
+    wheel.tick(start - 1, on_timer, &clock);
+
+    TestTimer timer;
+    timer.node.user_data = &timer;
+    timer.fired = 0;
+    timer.expire = start + 10;
+    wheel.add_timer(&timer.node, 11, start - 1);
+    wheel.tick(start + 10, readd_timer, &wheel);
+    CHECK_EQ(readd_calls, 1);
+    wheel.tick(start + 11, readd_timer, &wheel);
+    CHECK_EQ(readd_calls, 2);
+    wheel.tick(start + 12, readd_timer, &wheel);
+    CHECK_EQ(readd_calls, 3);
+    wheel.tick(start + 100, readd_timer, &wheel);
+    CHECK_EQ(readd_calls, 3);
+}
+
+int main()
+{
+    test_level_boundaries();
+    test_next_timeout();
+    test_random();
+    test_adjust();
+    test_del_cascaded();
+    test_readd_in_callback();
+    return test_result("test_timer_wheel");
+}
@@ -0,0 +1,186 @@
+#include <cstring>
+#include <time.h>
+#include "cache_policy.h"
+#include "http_date.h"
+#include "test.h"
+
+// 条件请求用到的验证器：match_etag 的强弱比较和列表，parse_http_date 的三种格式和格式错误的输入
+
+static bool match(const char *list, const char *suffix, bool weak)
+{
+    HeaderView view = {list, (int)strlen(list)};
+    return match_etag(view, "5f-3e8-1a2b", 11, suffix, weak);
+}
+
+struct EtagCase
+{
+    const char *list;
+    const char *suffix;
+    bool weak_result;   // 弱比较(If-None-Match)的结果
+    bool strong_result; // 强比较(If-Range)的结果
+};
+
+static const EtagCase etag_cases[] = {
+    {"\"5f-3e8-1a2b\"", "", true, true},
+    {"W/\"5f-3e8-1a2b\"", "", true, false},           // 弱标签只在弱比较时匹配
+    {"\"other\", \"5f-3e8-1a2b\"", "", true, true},   // 列表中的第二个
+    {"\"other\",W/\"5f-3e8-1a2b\"", "", true, false},
+    {"  \"other\" ,\t\"5f-3e8-1a2b\" ", "", true, true},
+    {"\"other\", W/\"x\"", "", false, false},
+    {"*", "", true, true},
+    {"\"other\", *", "", true, true},
+    {"\"5f-3e8-1a2b-gz\"", "-gz", true, true},        // gzip的内容带后缀
+    {"\"5f-3e8-1a2b-gz\"", "", false, false},
+    {"\"5f-3e8-1a2b\"", "-gz", false, false},
+    {"\"5f-3e8-1a2\"", "", false, false},             // 前缀不算
+    {"\"5f-3e8-1a2bc\"", "", false, false},
+    {"\"\"", "", false, false},
+    {"", "", false, false},
+    {" , ,", "", false, false},
+    // 格式错误
+    {"5f-3e8-1a2b", "", false, false},                // 没有引号
+    {"\"5f-3e8-1a2b", "", false, false},              // 没有结束的引号
+    {"W/5f-3e8-1a2b", "", false, false},
+    {"w/\"5f-3e8-1a2b\"", "", false, false},          // W 区分大小写
+    {"\"other\" junk, \"5f-3e8-1a2b\"", "", false, false},
+};
+
+static void test_match_etag()
+{
+    for (unsigned i = 0; i < sizeof(etag_cases) / sizeof(etag_cases[0]); i++)
+    {
+        const EtagCase &c = etag_cases[i];
+        if (match(c.list, c.suffix, true) != c.weak_result || match(c.list, c.suffix, false) != c.strong_result)
+        {
+            printf("match_etag(%s, suffix \"%s\")\n", c.list, c.suffix);
+        }
+        CHECK(match(c.list, c.suffix, true) == c.weak_result);
+        CHECK(match(c.list, c.suffix, false) == c.strong_result);
+    }
+
+    // 长度由 HeaderView 决定，不依赖'\0'
+    const char *list = "\"5f-3e8-1a2b\"";
+    HeaderView cut = {list, 12};
+    CHECK(!match_etag(cut, "5f-3e8-1a2b", 11, "", true));
+}
+
+static bool parse(const char *s, time_t &t)
+{
+    return parse_http_date(s, strlen(s), t);
+}
+
+// Sun, 06 Nov 1994 08:49:37 GMT
+static const time_t EXAMPLE = 784111777;
+
+static void test_formats()
+{
+    const char *dates[] = {
+        "Sun, 06 Nov 1994 08:49:37 GMT",  // IMF-fixdate
+        "Sunday, 06-Nov-94 08:49:37 GMT", // RFC 850
+        "Sun Nov  6 08:49:37 1994",       // asctime
+    };
+    for (int i = 0; i < 3; i++)
+    {
+        time_t t = 0;
+        CHECK(parse(dates[i], t));
+        CHECK_EQ(t, EXAMPLE);
+    }
+
+    time_t t = 0;
+    CHECK(parse("Thu Feb 29 23:59:59 2024", t));
+    CHECK_EQ(t, 1709251199);
+    CHECK(parse("Saturday, 31-Dec-16 23:59:60 GMT", t)); // 闰秒
+    CHECK_EQ(t, 1483228800);
+
+    // 格式化之后再解析得到同一个时间
+    time_t samples[] = {0, EXAMPLE, 951782400, 1709251199, 2147483647, 4102444800LL};
+    for (unsigned i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+    {
+        char buf[HTTP_DATE_LEN];
+        format_http_date(samples[i], buf);
+        time_t parsed = -1;
+        CHECK(parse_http_date(buf, HTTP_DATE_LEN, parsed));
+        CHECK_EQ(parsed, samples[i]);
+    }
+}
+
+// RFC 850 的两位年份：离现在超过50年以后的算作上一个世纪
+static void test_two_digit_year()
+{
+    time_t now = time(nullptr);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    int current = tm.tm_year + 1900;
+
+    int years[] = {current - 49, current, current + 1, current + 50, current + 51};
+    int expected[] = {current - 49, current, current + 1, current + 50, current - 49};
+    for (int i = 0; i < 5; i++)
+    {
+        char date[64];
+        snprintf(date, sizeof(date), "Monday, 01-Jan-%02d 00:00:00 GMT", years[i] % 100);
+        time_t t = 0;
+        CHECK(parse(date, t));
+        struct tm parsed;
+        gmtime_r(&t, &parsed);
+        CHECK_EQ(parsed.tm_year + 1900, expected[i]);
+    }
+}
+
+static void test_malformed()
+{
+    const char *bad[] = {
+        "",
+        "Sun, 06 Nov 1994 08:49:37",
+        "Sun, 06 Nov 1994 08:49:37 UTC",
+        "Sun, 06 Nov 1994 08:49:37 GMT ",
+        "Sun,  6 Nov 1994 08:49:37 GMT",  // IMF-fixdate 的日期是两位数字
+        "Sun, 00 Nov 1994 08:49:37 GMT",
+        "Sun, 32 Nov 1994 08:49:37 GMT",
+        "Sun, 06 Foo 1994 08:49:37 GMT",
+        "Sun, 06 nov 1994 08:49:37 GMT",  // 月份区分大小写
+        "Sun, 06 Nov 19a4 08:49:37 GMT",
+        "Sun, 06 Nov 1994 24:00:00 GMT",
+        "Sun, 06 Nov 1994 08:60:37 GMT",
+        "Sun, 06 Nov 1994 08:49:61 GMT",
+        "Sun, 06 Nov 1994 08-49-37 GMT",
+        "Xyz, 06 Nov 1994 08:49:37 GMT",
+        "Sun 06 Nov 1994 08:49:37 GMT",
+        "Sun, 06-Nov-94 08:49:37 GMT",    // RFC 850 的星期是全名
+        "Funday, 06-Nov-94 08:49:37 GMT",
+        "Sunday, 06 Nov 94 08:49:37 GMT",
+        "Sunday, 06-Nov-94 08:49:37 UTC",
+        "Sunday, 06-Nov-1994 08:49:37 GMT",
+        "Sunday,06-Nov-94 08:49:37 GMT ",
+        "Sun Nov 6 08:49:37 1994",        // asctime 一位数的日期前面补空格
+        "Sun Nov  0 08:49:37 1994",
+        "Sun Nov  6 08:49:37 94  ",
+        "Sun Nov  6 08:49:37  994",
+        "Sun Nov  6 25:49:37 1994",
+        "Sun, Nov  6 08:49:37 1994",
+    };
+    for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        time_t t = 0;
+        if (parse(bad[i], t))
+        {
+            printf("accepted \"%s\"\n", bad[i]);
+            CHECK(!"malformed date accepted");
+        }
+    }
+
+    // 长度由参数决定，不依赖'\0'
+    const char *date = "Sun, 06 Nov 1994 08:49:37 GMTX";
+    time_t t = 0;
+    CHECK(parse_http_date(date, HTTP_DATE_LEN, t));
+    CHECK(!parse_http_date(date, HTTP_DATE_LEN + 1, t));
+    CHECK(!parse_http_date(date, HTTP_DATE_LEN - 1, t));
+}
+
+int main()
+{
+    test_match_etag();
+    test_formats();
+    test_two_digit_year();
+    test_malformed();
+    return test_result("test_validators");
+}
@@ -0,0 +1,263 @@
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+#include "ws_deque.h"
+#include "test.h"
+
+/*
+    WorkStealingDeque 的测试：单线程的顺序和边界，
+    一个所属线程放入取出、多个线程偷时每个任务正好被取到一次，
+    以及只剩一个任务时所属线程的 pop 和偷的线程的 steal 的争抢
+*/
+
+struct Task
+{
+    std::atomic<int> runs; // 被取到的次数
+};
+
+static const int THIEVES = 3;
+
+static void test_single_thread()
+{
+    WorkStealingDeque<Task> deque;
+    static Task tasks[WorkStealingDeque<Task>::CAPACITY + 1];
+
+    CHECK(deque.pop() == nullptr);
+    CHECK(deque.steal() == nullptr);
+
+    // 所属线程后进先出，偷的是最旧的
+    CHECK(deque.push(&tasks[0]));
+    CHECK(deque.push(&tasks[1]));
+    CHECK(deque.push(&tasks[2]));
+    CHECK_EQ(deque.size(), 3);
+    CHECK(deque.pop() == &tasks[2]);
+    CHECK(deque.steal() == &tasks[0]);
+    CHECK(deque.pop() == &tasks[1]);
+    CHECK(deque.pop() == nullptr);
+    CHECK(deque.steal() == nullptr);
+    CHECK_EQ(deque.size(), 0);
+
+    // 固定容量，满了返回false，取走一个之后又能放入
+    for (long i = 0; i < WorkStealingDeque<Task>::CAPACITY; i++)
+    {
+        CHECK(deque.push(&tasks[i]));
+    }
+    CHECK(!deque.push(&tasks[WorkStealingDeque<Task>::CAPACITY]));
+    CHECK(deque.steal() == &tasks[0]);
+    CHECK(deque.push(&tasks[WorkStealingDeque<Task>::CAPACITY]));
+    long count = 0;
+    while (deque.pop())
+    {
+        count++;
+    }
+    CHECK_EQ(count, WorkStealingDeque<Task>::CAPACITY);
+
+    // 下标绕过容量很多圈之后仍然正确
+    for (int round = 0; round < 1000; round++)
+    {
+        CHECK(deque.push(&tasks[round % 7]));
+        CHECK(deque.push(&tasks[round % 5]));
+        CHECK(deque.steal() == &tasks[round % 7]);
+        CHECK(deque.pop() == &tasks[round % 5]);
+    }
+    CHECK(deque.pop() == nullptr);
+}
+
+// 压力测试：所属线程不停放入，时不时从底部取出，其他线程从顶部偷
+struct StressContext
+{
+    WorkStealingDeque<Task> deque;
+    Task *tasks;
+    int count;
+    std::atomic<bool> done;
+    std::atomic<long> taken;
+};
+
+static void take(StressContext *ctx, Task *task)
+{
+    task->runs.fetch_add(1, std::memory_order_relaxed);
+    ctx->taken.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void *stress_thief(void *arg)
+{
+    StressContext *ctx = (StressContext *)arg;
+    while (!ctx->done.load(std::memory_order_acquire) || ctx->deque.size() > 0)
+    {
+        Task *task = ctx->deque.steal();
+        if (task)
+        {
+            take(ctx, task);
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    return nullptr;
+}
+
+static void test_owner_and_thieves()
+{
+    StressContext ctx;
+    ctx.count = 300000;
+    ctx.tasks = new Task[ctx.count];
+    for (int i = 0; i < ctx.count; i++)
+    {
+        ctx.tasks[i].runs.store(0, std::memory_order_relaxed);
+    }
+    ctx.done.store(false);
+    ctx.taken.store(0);
+
+    pthread_t thieves[THIEVES];
+    for (int i = 0; i < THIEVES; i++)
+    {
+        pthread_create(&thieves[i], nullptr, stress_thief, &ctx);
+    }
+
+    unsigned seed = 12345;
+    int next = 0;
+    while (next < ctx.count)
+    {
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % 3 == 0)
+        {
+            Task *task = ctx.deque.pop();
+            if (task)
+            {
+                take(&ctx, task);
+            }
+        }
+        else if (ctx.deque.push(&ctx.tasks[next]))
+        {
+            next++;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    // 剩下的和偷的线程抢
+    Task *task;
+    while ((task = ctx.deque.pop()) != nullptr)
+    {
+        take(&ctx, task);
+    }
+    ctx.done.store(true, std::memory_order_release);
+    for (int i = 0; i < THIEVES; i++)
+    {
+        pthread_join(thieves[i], nullptr);
+    }
+
+    CHECK_EQ(ctx.taken.load(), ctx.count);
+    int wrong = 0;
+    for (int i = 0; i < ctx.count; i++)
+    {
+        if (ctx.tasks[i].runs.load() != 1)
+        {
+            wrong++;
+        }
+    }
+    CHECK_EQ(wrong, 0);
+    delete[] ctx.tasks;
+}
+
+// 只有一个任务时的争抢：每一轮所属线程放入一个任务，和所有偷的线程同时去取，只能有一个取到
+struct RaceContext
+{
+    WorkStealingDeque<Task> deque;
+    Task *tasks;
+    int rounds;
+    std::atomic<int> round;    // 当前是第几轮，偷的线程看到它变了就去偷
+    std::atomic<int> finished; // 这一轮已经偷过的线程数
+};
+
+static void *race_thief(void *arg)
+{
+    RaceContext *ctx = (RaceContext *)arg;
+    for (int r = 1; r <= ctx->rounds; r++)
+    {
+        while (ctx->round.load(std::memory_order_acquire) < r)
+        {
+            sched_yield();
+        }
+        Task *task = ctx->deque.steal();
+        if (task)
+        {
+            task->runs.fetch_add(1, std::memory_order_relaxed);
+        }
+        ctx->finished.fetch_add(1, std::memory_order_acq_rel);
+    }
+    return nullptr;
+}
+
+static void test_last_item_race()
+{
+    RaceContext ctx;
+    ctx.rounds = 20000;
+    ctx.tasks = new Task[ctx.rounds];
+    for (int i = 0; i < ctx.rounds; i++)
+    {
+        ctx.tasks[i].runs.store(0, std::memory_order_relaxed);
+    }
+    ctx.round.store(0);
+    ctx.finished.store(0);
+
+    pthread_t thieves[THIEVES];
+    for (int i = 0; i < THIEVES; i++)
+    {
+        pthread_create(&thieves[i], nullptr, race_thief, &ctx);
+    }
+
+    int owner_won = 0;
+    for (int r = 1; r <= ctx.rounds; r++)
+    {
+        Task *task = &ctx.tasks[r - 1];
+        CHECK(ctx.deque.push(task));
+        ctx.round.store(r, std::memory_order_release);
+        // 轮流让所属线程先取或者先让出CPU，两种顺序都要覆盖
+        if (r & 1)
+        {
+            sched_yield();
+        }
+        Task *got = ctx.deque.pop();
+        if (got)
+        {
+            CHECK(got == task);
+            got->runs.fetch_add(1, std::memory_order_relaxed);
+            owner_won++;
+        }
+        // 等所有偷的线程这一轮都试过，队列一定是空的
+        while (ctx.finished.load(std::memory_order_acquire) < r * THIEVES)
+        {
+            sched_yield();
+        }
+        CHECK_EQ(ctx.deque.size(), 0);
+        CHECK(ctx.deque.pop() == nullptr);
+    }
+    for (int i = 0; i < THIEVES; i++)
+    {
+        pthread_join(thieves[i], nullptr);
+    }
+
+    int wrong = 0;
+    for (int i = 0; i < ctx.rounds; i++)
+    {
+        if (ctx.tasks[i].runs.load() != 1)
+        {
+            wrong++;
+        }
+    }
+    CHECK_EQ(wrong, 0);
+    printf("last item race: owner took %d of %d\n", owner_won, ctx.rounds);
+    delete[] ctx.tasks;
+}
+
+int main()
+{
+    alarm(120);
+    test_single_thread();
+    test_owner_and_thieves();
+    test_last_item_race();
+    return test_result("test_ws_deque");
+}
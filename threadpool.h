@@ -1,64 +1,111 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <list>
-#include "locker.h"
-#include "sem.h"
-#include "cond.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "eventcount.h"
+#include "mpmc_queue.h"
+#include "locked_queue.h"
+#include "ws_deque.h"
 #include <iostream>
 #include <pthread.h>
 
-// 线程池
-template <class T>
+/*
+    工作窃取线程池
+    reactor 提交的任务先放进全局的注入队列，工作线程一次取走一批放进自己的本地队列，
+    之后只在本地队列的底部存取，不和别的线程竞争；本地队列空了再去注入队列取，
+    还没有就从别的线程的本地队列顶部偷。工作线程自己提交的任务直接放进自己的本地队列。
+    都没有任务时在事件计数上睡眠，提交任务时只有确实有线程在睡眠才发起唤醒的系统调用。
+    注入队列默认是无锁的 MpmcQueue，也可以换成加锁的 LockedQueue，两者接口相同
+*/
+template <class T, class Queue = MpmcQueue<T> >
 class ThreadPool
 {
-
 private:
+    // 一个工作线程，本地队列按缓存行对齐，不同线程的队列不会伪共享
+    struct alignas(64) Worker
+    {
+        ThreadPool *pool;
+        int id;
+        WorkStealingDeque<T> deque;
+    };
+
     // 线程的数量
     int m_thread_number;
 
     // 线程数组，大小为m_thread_number
     pthread_t *m_threads;
 
-    // 允许等待的最大数量
-    int m_max_requests;
+    // 工作线程数组，大小为m_thread_number
+    Worker *m_workers;
 
-    // 请求队列，需要处理的任务
-    std::list<T *> m_workqueue;
+    // 允许等待的最大数量，只限制注入队列
+    int m_max_requests;
 
-    // 请求队列的互斥锁
-    Locker m_queuelocker;
+    // 注入队列，所有线程共享
+    Queue m_queue;
 
-    // 是否有任务需要处理，信号量的数量
-    Sem m_queuestat;
+    // 空闲线程在上面睡眠
+    EventCount m_event;
 
     // 是否结束进程
-    bool m_stop;
+    std::atomic<bool> m_stop;
+
+    // 当前线程所属的工作线程，不是工作线程为nullptr
+    static thread_local Worker *m_current;
+
+    // 从注入队列一次最多取走的任务数
+    static const int GRAB_BATCH = 32;
 
 public:
     // thread_number是线程池中线程的数量
     // max_requests是请求队列中最多允许的、等待处理的请求的数量
     ThreadPool(int thraed_number = 8, int max_requests = 10000);
 
-    // 析构函数，销毁线程的数据
+    // 析构函数，结束并等待所有的工作线程
     ~ThreadPool();
 
     // 增加任务进工作队列中
     bool append(T *);
 
+    // 一次放入多个任务，返回放入的个数，队列满了时只放入前面的一部分，
+    // 最多唤醒线程数个睡眠的线程，剩下的由取到一批任务的线程继续唤醒
+    int append_batch(T **requests, int count);
+
 private:
     // 创建线程之后的运行函数
     static void *worker(void *arg);
 
     // 取出队列中任务，不断的运行线程处理任务
-    void run();
+    void run(Worker *self);
+
+    // 依次从本地队列、注入队列、别的线程的本地队列中取一个任务，没有返回nullptr
+    T *find_task(Worker *self);
+
+    // 从注入队列取走一批任务放进本地队列，返回其中的一个
+    T *grab(Worker *self);
+
+    // 从别的线程的本地队列偷一个任务
+    T *steal(Worker *self);
+
+    // 还有没有任务可以取
+    bool has_task() const;
+
+    // 没有任务时睡眠，直到有新的任务
+    void park();
+
+    // 有线程在睡眠时唤醒一个
+    void notify();
 };
 
-#endif
+template <class T, class Queue>
+thread_local typename ThreadPool<T, Queue>::Worker *ThreadPool<T, Queue>::m_current = nullptr;
 
-// 线程池的构造函数
-template <class T>
-ThreadPool<T>::ThreadPool(int thread_number, int max_requests)
+// 线程池的构造函数，队列的构造函数会检查 max_requests
+template <class T, class Queue>
+ThreadPool<T, Queue>::ThreadPool(int thread_number, int max_requests)
+    : m_queue(max_requests), m_stop(false)
 {
 
     // 传入错误的参数
@@ -70,34 +117,40 @@ ThreadPool<T>::ThreadPool(int thread_number, int max_requests)
     // 属性赋值
     m_thread_number = thread_number;
     m_max_requests = max_requests;
-    m_stop = false;
-    m_queuelocker = Locker();
-    m_queuestat = Sem();
-    m_workqueue.clear();
 
     // 创建线程数组
     m_threads = new pthread_t[m_thread_number];
 
-    if (m_threads == nullptr)
+    // 工作线程按缓存行对齐，C++17之前 new[] 不保证这样的对齐，自己分配
+    void *workers = nullptr;
+    if (posix_memalign(&workers, alignof(Worker), sizeof(Worker) * m_thread_number) != 0)
     {
+        delete[] m_threads;
         throw std::exception();
     }
+    m_workers = (Worker *)workers;
+    for (int i = 0; i < m_thread_number; i++)
+    {
+        new (&m_workers[i]) Worker();
+        m_workers[i].pool = this;
+        m_workers[i].id = i;
+    }
 
     // 创建线程
     for (int i = 0; i < m_thread_number; i++)
     {
         printf("create the %dth thread\n", i);
 
-        // 如果创建失败返回
-        if (pthread_create(&m_threads[i], nullptr, worker, this) != 0)
-        {
-            delete[] m_threads;
-            throw std::exception();
-        }
-
-        // 创建线程分离
-        if (pthread_detach(m_threads[i]) != 0)
+        // 如果创建失败，结束已经创建的线程再返回
+        if (pthread_create(&m_threads[i], nullptr, worker, &m_workers[i]) != 0)
         {
+            m_stop = true;
+            m_event.notify_all();
+            for (int j = 0; j < i; j++)
+            {
+                pthread_join(m_threads[j], nullptr);
+            }
+            free(m_workers);
             delete[] m_threads;
             throw std::exception();
         }
@@ -105,66 +158,195 @@ ThreadPool<T>::ThreadPool(int thread_number, int max_requests)
 }
 
 // 线程池的析构函数，销毁一些变量
-template <class T>
-ThreadPool<T>::~ThreadPool()
+template <class T, class Queue>
+ThreadPool<T, Queue>::~ThreadPool()
 {
-    delete[] m_threads;
+    // 工作线程访问本地队列，要等它们都退出之后才能释放
     m_stop = true;
-    m_workqueue.clear();
+    m_event.notify_all();
+    for (int i = 0; i < m_thread_number; i++)
+    {
+        pthread_join(m_threads[i], nullptr);
+    }
+    free(m_workers);
+    delete[] m_threads;
 }
 
-template <class T>
-bool ThreadPool<T>::append(T *requests)
+template <class T, class Queue>
+bool ThreadPool<T, Queue>::append(T *requests)
 {
+    // 工作线程自己提交的任务放进自己的本地队列，不用加锁
+    Worker *self = m_current;
+    if (self && self->pool == this && self->deque.push(requests))
+    {
+        notify();
+        return true;
+    }
 
-    // 操作工作队列时一定要加锁，因为它被所有线程共享。
-    m_queuelocker.lock();
-    if (m_workqueue.size() >= m_max_requests)
+    // 注入队列满了就拒绝
+    if (!m_queue.push(requests))
     {
-        m_queuelocker.unlock();
         return false;
     }
-
-    m_workqueue.push_back(requests);
-    m_queuelocker.unlock();
-    m_queuestat.post();
+    notify();
     return true;
 }
 
+template <class T, class Queue>
+int ThreadPool<T, Queue>::append_batch(T **requests, int count)
+{
+    if (count <= 0)
+    {
+        return 0;
+    }
+
+    int pushed = (int)m_queue.push_batch(requests, count);
+    if (pushed > 0)
+    {
+        m_event.notify(pushed < m_thread_number ? pushed : m_thread_number);
+    }
+    return pushed;
+}
+
 // 创建的线程需要运行的函数
-template <class T>
-void *ThreadPool<T>::worker(void *arg)
+template <class T, class Queue>
+void *ThreadPool<T, Queue>::worker(void *arg)
 {
 
-    ThreadPool *p = (ThreadPool *)arg;
-    p->run();
+    Worker *self = (Worker *)arg;
+    m_current = self;
+    self->pool->run(self);
 
-    return p;
+    return self;
 }
 
 // 线程池处理函数
-template <class T>
-void ThreadPool<T>::run()
+template <class T, class Queue>
+void ThreadPool<T, Queue>::run(Worker *self)
 {
-    while (!m_stop)
+    while (!m_stop.load(std::memory_order_relaxed))
     {
-        // 信号量不为0，可以运行
-        m_queuestat.wait();
-        m_queuelocker.lock();
-
-        // 获取队列第一个请求
-        T *requests = m_workqueue.front();
-        // 第一个请求已经取出执行，可以pop掉
-        m_workqueue.pop_front();
-
-        // 解锁
-        m_queuelocker.unlock();
+        T *requests = find_task(self);
         if (requests == nullptr)
         {
+            park();
             continue;
         }
 
         // 请求的处理
         requests->process();
     }
-}
\ No newline at end of file
+}
+
+template <class T, class Queue>
+T *ThreadPool<T, Queue>::find_task(Worker *self)
+{
+    T *task = self->deque.pop();
+    if (task)
+    {
+        return task;
+    }
+    if (m_queue.size() > 0 && (task = grab(self)))
+    {
+        return task;
+    }
+    return steal(self);
+}
+
+template <class T, class Queue>
+T *ThreadPool<T, Queue>::grab(Worker *self)
+{
+    T *task = m_queue.pop();
+    if (task == nullptr)
+    {
+        return nullptr;
+    }
+
+    // 按线程数平分，一个线程不会把注入队列都拿走，其他线程来不及偷也能取到；
+    // 不超过本地队列剩下的空间，取出来的任务一定放得进去
+    long count = m_queue.size() / m_thread_number;
+    long room = WorkStealingDeque<T>::CAPACITY - self->deque.size();
+    if (count > GRAB_BATCH - 1)
+    {
+        count = GRAB_BATCH - 1;
+    }
+    if (count > room)
+    {
+        count = room;
+    }
+    for (long i = 0; i < count; i++)
+    {
+        T *next = m_queue.pop();
+        if (next == nullptr)
+        {
+            break;
+        }
+        self->deque.push(next);
+    }
+
+    // 本地队列中多出来的任务可以被偷，叫醒一个睡眠的线程
+    if (self->deque.size() > 0)
+    {
+        notify();
+    }
+    return task;
+}
+
+template <class T, class Queue>
+T *ThreadPool<T, Queue>::steal(Worker *self)
+{
+    // 从下一个线程开始轮一圈，不总是从同一个线程偷
+    for (int i = 1; i < m_thread_number; i++)
+    {
+        Worker &victim = m_workers[(self->id + i) % m_thread_number];
+        if (victim.deque.size() == 0)
+        {
+            continue;
+        }
+        T *task = victim.deque.steal();
+        if (task)
+        {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+template <class T, class Queue>
+bool ThreadPool<T, Queue>::has_task() const
+{
+    if (m_queue.size() > 0)
+    {
+        return true;
+    }
+    for (int i = 0; i < m_thread_number; i++)
+    {
+        if (m_workers[i].deque.size() > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class T, class Queue>
+void ThreadPool<T, Queue>::park()
+{
+    // 先登记再检查一次任务：之后提交的任务一定能看到这个登记，不会漏掉唤醒
+    int key = m_event.prepare_wait();
+    if (has_task() || m_stop.load(std::memory_order_seq_cst))
+    {
+        m_event.cancel_wait();
+        return;
+    }
+    m_event.commit_wait(key);
+}
+
+template <class T, class Queue>
+void ThreadPool<T, Queue>::notify()
+{
+    // 任务已经放好了，没有线程在睡眠时不需要系统调用
+    m_event.notify_one();
+}
+
+#endif
@@ -0,0 +1,232 @@
+#include "timer_wheel.h"
+#include <time.h>
+#include <climits>
+
+TimerWheel::TimerWheel(int tick_ms)
+{
+    m_tick_ms = tick_ms > 0 ? tick_ms : 1;
+    m_current = now_ms() / m_tick_ms;
+    m_count = 0;
+
+    // 每个槽的头结点指向自己，表示链表为空
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        for (int i = 0; i < WHEEL_SIZE; i++)
+        {
+            m_slots[level][i].prev = &m_slots[level][i];
+            m_slots[level][i].next = &m_slots[level][i];
+        }
+    }
+}
+
+unsigned long long TimerWheel::now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+unsigned long long TimerWheel::now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void TimerWheel::insert(TimerNode *timer)
+{
+    TimerNode *head = nullptr;
+    long long delta = (long long)(timer->expire - m_current);
+
+    if (delta < 0)
+    {
+        // 已经过期了，放到下一个要处理的槽中
+        head = &m_slots[0][m_current & WHEEL_MASK];
+    }
+    else
+    {
+        // 找到能容纳 delta 的最低一层
+        int level = 0;
+        while (level < WHEEL_LEVELS - 1 && delta >= (1LL << ((level + 1) * WHEEL_BITS)))
+        {
+            level++;
+        }
+
+        // 超过时间轮能表示的最大范围，放在最远的地方
+        long long max_delta = (1LL << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+        if (delta > max_delta)
+        {
+            timer->expire = m_current + max_delta;
+        }
+
+        int index = (timer->expire >> (level * WHEEL_BITS)) & WHEEL_MASK;
+        head = &m_slots[level][index];
+    }
+
+    // 插入到链表尾部
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void TimerWheel::add_timer(TimerNode *timer, int timeout_ms, unsigned long long now_ms)
+{
+    if (!timer)
+    {
+        return;
+    }
+    if (timer->prev)
+    {
+        del_timer(timer);
+    }
+
+    // 向上取整，保证不会提前到期
+    timer->expire = (now_ms + timeout_ms + m_tick_ms - 1) / m_tick_ms;
+    insert(timer);
+    m_count++;
+}
+
+void TimerWheel::adjust_timer(TimerNode *timer, int timeout_ms, unsigned long long now_ms)
+{
+    // 从原来的槽中取下来再放进新的槽，不需要像链表那样遍历
+    add_timer(timer, timeout_ms, now_ms);
+}
+
+void TimerWheel::del_timer(TimerNode *timer)
+{
+    if (!timer || !timer->prev)
+    {
+        return;
+    }
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = nullptr;
+    timer->next = nullptr;
+    m_count--;
+}
+
+void TimerWheel::cascade(int level, int index)
+{
+    TimerNode *head = &m_slots[level][index];
+    // 先把整个链表摘下来，再逐个重新插入，重新插入的定时器会落到更低的层
+    TimerNode *timer = head->next;
+    head->prev = head;
+    head->next = head;
+
+    while (timer != head)
+    {
+        TimerNode *next = timer->next;
+        insert(timer);
+        timer = next;
+    }
+}
+
+void TimerWheel::tick(unsigned long long now_ms, timer_cb cb, void *arg)
+{
+    unsigned long long target = now_ms / m_tick_ms;
+
+    // 没有定时器，直接跳到当前时间
+    if (m_count == 0)
+    {
+        if (m_current <= target)
+        {
+            m_current = target + 1;
+        }
+        return;
+    }
+
+    while (m_current <= target)
+    {
+        int index = m_current & WHEEL_MASK;
+
+        // 第0层转完一圈，从第1层开始逐层把对应槽中的定时器分配下来
+        if (index == 0)
+        {
+            for (int level = 1; level < WHEEL_LEVELS; level++)
+            {
+                int level_index = (m_current >> (level * WHEEL_BITS)) & WHEEL_MASK;
+                cascade(level, level_index);
+                if (level_index != 0)
+                {
+                    break;
+                }
+            }
+        }
+        m_current++;
+
+        // 执行这个槽中所有到期的定时器
+        TimerNode *head = &m_slots[0][index];
+        while (head->next != head)
+        {
+            TimerNode *timer = head->next;
+            del_timer(timer);
+            cb(timer, arg);
+        }
+    }
+}
+
+long long TimerWheel::next_expire()
+{
+    if (m_count == 0)
+    {
+        return -1;
+    }
+
+    // 第0层最近一个非空的槽
+    unsigned long long target = ~0ULL;
+    for (int i = 0; i < WHEEL_SIZE; i++)
+    {
+        unsigned long long t = m_current + i;
+        TimerNode *head = &m_slots[0][t & WHEEL_MASK];
+        if (head->next != head)
+        {
+            target = t;
+            break;
+        }
+    }
+
+    // 高层的槽要在低层转完一圈时分配下来，找每一层最近一个非空槽被分配的时刻
+    for (int level = 1; level < WHEEL_LEVELS; level++)
+    {
+        int shift = level * WHEEL_BITS;
+        unsigned long long boundary = ((m_current + (1ULL << shift) - 1) >> shift) << shift;
+        for (int i = 0; i < WHEEL_SIZE; i++)
+        {
+            unsigned long long t = boundary + ((unsigned long long)i << shift);
+            if (t >= target)
+            {
+                break;
+            }
+            TimerNode *head = &m_slots[level][(t >> shift) & WHEEL_MASK];
+            if (head->next != head)
+            {
+                target = t;
+                break;
+            }
+        }
+    }
+    if (target == ~0ULL)
+    {
+        // 正常情况下不会走到这里，过一圈再检查
+        target = m_current + WHEEL_SIZE;
+    }
+    return (long long)(target * m_tick_ms);
+}
+
+int TimerWheel::next_timeout(unsigned long long now_ms)
+{
+    long long expire = next_expire();
+    if (expire < 0)
+    {
+        return -1;
+    }
+
+    unsigned long long wake_ms = expire;
+    if (wake_ms <= now_ms)
+    {
+        return 0;
+    }
+    unsigned long long timeout = wake_ms - now_ms;
+    return timeout > INT_MAX ? INT_MAX : (int)timeout;
+}
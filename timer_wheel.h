@@ -0,0 +1,77 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// 定时器节点，直接嵌入到需要定时的对象中，添加和删除都不需要分配内存
+struct TimerNode
+{
+    TimerNode() : prev(nullptr), next(nullptr), expire(0), user_data(nullptr) {}
+
+    TimerNode *prev;           // 指向槽中前一个定时器，为空表示没有在时间轮中
+    TimerNode *next;           // 指向槽中后一个定时器
+    unsigned long long expire; // 到期的时间，单位是时间轮的一格(tick)
+    void *user_data;           // 定时器所属的对象
+};
+
+// 定时器到期时的回调函数，arg 是调用 tick 时传入的参数
+typedef void (*timer_cb)(TimerNode *timer, void *arg);
+
+/*
+    分层时间轮，和Linux内核以前的定时器实现一样
+    一共 WHEEL_LEVELS 层，每层 WHEEL_SIZE 个槽，每个槽是一个双向链表。
+    第0层每个槽代表一格，第1层每个槽代表 WHEEL_SIZE 格，以此类推。
+    低一层转完一圈时，把高一层对应槽中的定时器重新分配到低层中。
+    添加、删除、调整定时器都是O(1)的，不像升序链表那样需要遍历。
+    时间轮不是线程安全的，每个reactor拥有自己的时间轮。
+*/
+class TimerWheel
+{
+private:
+    static const int WHEEL_BITS = 6;
+    static const int WHEEL_SIZE = 1 << WHEEL_BITS; // 每层的槽数
+    static const int WHEEL_MASK = WHEEL_SIZE - 1;
+    static const int WHEEL_LEVELS = 5;             // 层数，最多能表示 2^30 格
+
+    int m_tick_ms;                 // 每一格的毫秒数
+    unsigned long long m_current;  // 下一个要处理的格
+    int m_count;                   // 时间轮中定时器的数量
+
+    // 每个槽是一个带头结点的双向循环链表
+    TimerNode m_slots[WHEEL_LEVELS][WHEEL_SIZE];
+
+public:
+    TimerWheel(int tick_ms);
+    ~TimerWheel() {}
+
+    // 添加定时器，timeout_ms 毫秒之后到期
+    void add_timer(TimerNode *timer, int timeout_ms, unsigned long long now_ms);
+
+    // 重新设置定时器的到期时间
+    void adjust_timer(TimerNode *timer, int timeout_ms, unsigned long long now_ms);
+
+    // 删除定时器，不在时间轮中也可以调用
+    void del_timer(TimerNode *timer);
+
+    // 处理到 now_ms 为止所有到期的定时器，到期的定时器先从时间轮中删除再调用 cb
+    void tick(unsigned long long now_ms, timer_cb cb, void *arg);
+
+    // 下一次需要调用 tick 的时刻，单位毫秒，没有定时器返回-1
+    long long next_expire();
+
+    // 距离下一次需要调用 tick 的毫秒数，没有定时器返回-1，可以直接作为 epoll_wait 的超时时间
+    int next_timeout(unsigned long long now_ms);
+
+    // 单调时钟的当前时间，单位毫秒
+    static unsigned long long now_ms();
+
+    // 单调时钟的当前时间，单位纳秒，用来统计很短的耗时
+    static unsigned long long now_ns();
+
+private:
+    // 按到期时间把定时器放进对应层的槽中
+    void insert(TimerNode *timer);
+
+    // 把高层的一个槽中的定时器重新分配
+    void cascade(int level, int index);
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include "uring.h"
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdio>
+#include <exception>
+
+static int io_uring_setup(unsigned entries, io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                          io_uring_getevents_arg *arg)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                        arg, arg ? sizeof(*arg) : 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+Uring::Uring(unsigned entries)
+{
+    m_sq_ptr = MAP_FAILED;
+    m_cq_ptr = MAP_FAILED;
+    m_sqes = (io_uring_sqe *)MAP_FAILED;
+    m_buf_ring = nullptr;
+    m_bufs = nullptr;
+    m_sqe_head = 0;
+    m_sqe_tail = 0;
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // CQ 设置为 SQ 的4倍，multishot 请求一个 sqe 会产生很多 cqe
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = entries * 4;
+
+    m_ring_fd = io_uring_setup(entries, &params);
+    if (m_ring_fd < 0)
+    {
+        perror("io_uring_setup failed");
+        throw std::exception();
+    }
+
+    // 映射 SQ 和 CQ，新内核中它们可以共用一次 mmap
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && m_cq_size > m_sq_size)
+    {
+        m_sq_size = m_cq_size;
+    }
+
+    m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED)
+    {
+        perror("mmap sq ring failed");
+        close(m_ring_fd);
+        throw std::exception();
+    }
+
+    if (single_mmap)
+    {
+        m_cq_ptr = m_sq_ptr;
+    }
+    else
+    {
+        m_cq_ptr = mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_ring_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED)
+        {
+            perror("mmap cq ring failed");
+            munmap(m_sq_ptr, m_sq_size);
+            close(m_ring_fd);
+            throw std::exception();
+        }
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe *)mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  m_ring_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+    {
+        perror("mmap sqes failed");
+        if (!single_mmap)
+        {
+            munmap(m_cq_ptr, m_cq_size);
+        }
+        munmap(m_sq_ptr, m_sq_size);
+        close(m_ring_fd);
+        throw std::exception();
+    }
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + params.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    m_sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(sq + params.sq_off.array);
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + params.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+}
+
+Uring::~Uring()
+{
+    if (m_buf_ring)
+    {
+        munmap(m_buf_ring, m_buf_ring_size);
+        delete[] m_bufs;
+    }
+    munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != m_sq_ptr)
+    {
+        munmap(m_cq_ptr, m_cq_size);
+    }
+    munmap(m_sq_ptr, m_sq_size);
+    close(m_ring_fd);
+}
+
+io_uring_sqe *Uring::get_sqe()
+{
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    // SQ 已经满了，先把已有的提交给内核
+    if (m_sqe_tail - head > *m_sq_mask)
+    {
+        submit_and_wait(0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head > *m_sq_mask)
+        {
+            return nullptr;
+        }
+    }
+
+    io_uring_sqe *sqe = &m_sqes[m_sqe_tail & *m_sq_mask];
+    m_sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned Uring::flush_sq()
+{
+    unsigned tail = *m_sq_tail;
+    unsigned mask = *m_sq_mask;
+    while (m_sqe_head != m_sqe_tail)
+    {
+        m_sq_array[tail & mask] = m_sqe_head & mask;
+        tail++;
+        m_sqe_head++;
+    }
+    // 内核会用 acquire 读取 tail，这里用 release 保证 sqe 的内容先写好
+    __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+    return tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+}
+
+int Uring::submit_and_wait(unsigned wait_nr, int timeout_ms)
+{
+    unsigned to_submit = flush_sq();
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    if (to_submit == 0 && wait_nr == 0)
+    {
+        return 0;
+    }
+
+    // 带超时的等待，超时的时候返回 -1，errno 为 ETIME
+    struct __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    io_uring_getevents_arg *parg = nullptr;
+    if (wait_nr > 0 && timeout_ms >= 0)
+    {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (unsigned long)&ts;
+        parg = &arg;
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    int ret;
+    do
+    {
+        ret = io_uring_enter(m_ring_fd, to_submit, wait_nr, flags, parg);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
+
+io_uring_cqe *Uring::peek_cqe()
+{
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return nullptr;
+    }
+    return &m_cqes[head & *m_cq_mask];
+}
+
+void Uring::cqe_seen()
+{
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+bool Uring::setup_buf_ring(unsigned short bgid, unsigned entries, unsigned buf_size)
+{
+    m_buf_entries = entries;
+    m_buf_size = buf_size;
+    m_buf_tail = 0;
+
+    // 缓存环要求页对齐，用 mmap 分配
+    m_buf_ring_size = entries * sizeof(io_uring_buf);
+    void *ring = mmap(nullptr, m_buf_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        perror("mmap buf ring failed");
+        return false;
+    }
+    m_buf_ring = (io_uring_buf_ring *)ring;
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)ring;
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+    if (io_uring_register(m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        perror("io_uring register buf ring failed");
+        munmap(ring, m_buf_ring_size);
+        m_buf_ring = nullptr;
+        return false;
+    }
+
+    // 把所有缓存都放进环中
+    m_bufs = new char[(size_t)entries * buf_size];
+    for (unsigned i = 0; i < entries; i++)
+    {
+        recycle_buf((unsigned short)i);
+    }
+    return true;
+}
+
+void Uring::recycle_buf(unsigned short bid)
+{
+    // 头文件中的 bufs 是柔性数组，在C++中展开后偏移不对，直接按下标计算地址
+    io_uring_buf *buf = (io_uring_buf *)m_buf_ring + (m_buf_tail & (m_buf_entries - 1));
+    buf->addr = (unsigned long)get_buf(bid);
+    buf->len = m_buf_size;
+    buf->bid = bid;
+    m_buf_tail++;
+    // 缓存环的 tail 和第一个 io_uring_buf 的 resv 共用
+    __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+}
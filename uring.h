@@ -0,0 +1,79 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <cstddef>
+
+/*
+    对io_uring系统调用的简单封装，不依赖liburing
+    提交队列(SQ)和完成队列(CQ)都是和内核共享的环形缓冲区，
+    用户态往SQ里填写请求，一次io_uring_enter批量提交，并从CQ里取出完成的结果。
+    另外支持注册一个提供缓存的环(provided buffer ring)，
+    multishot recv会从中自己挑选缓存，不需要每次读都提交新的请求。
+*/
+class Uring
+{
+private:
+    int m_ring_fd; // io_uring 的文件描述符
+
+    // 提交队列
+    void *m_sq_ptr;       // SQ 的映射地址
+    size_t m_sq_size;     // SQ 映射的大小
+    unsigned *m_sq_head;  // 内核消费到的位置
+    unsigned *m_sq_tail;  // 用户提交到的位置
+    unsigned *m_sq_mask;  // 环的掩码
+    unsigned *m_sq_array; // SQ 中存放 sqe 下标的数组
+    io_uring_sqe *m_sqes; // sqe 数组
+    size_t m_sqes_size;   // sqe 数组映射的大小
+    unsigned m_sqe_head;  // 已经刷新到 SQ 的 sqe
+    unsigned m_sqe_tail;  // 已经取出还没有提交的 sqe
+
+    // 完成队列
+    void *m_cq_ptr;       // CQ 的映射地址，内核支持时和 SQ 是同一块
+    size_t m_cq_size;     // CQ 映射的大小
+    unsigned *m_cq_head;  // 用户消费到的位置
+    unsigned *m_cq_tail;  // 内核写入到的位置
+    unsigned *m_cq_mask;  // 环的掩码
+    io_uring_cqe *m_cqes; // cqe 数组
+
+    // 提供给内核挑选的缓存环
+    io_uring_buf_ring *m_buf_ring; // 缓存环
+    size_t m_buf_ring_size;        // 缓存环映射的大小
+    char *m_bufs;                  // 所有缓存的起始地址
+    unsigned m_buf_entries;        // 缓存的个数
+    unsigned m_buf_size;           // 每一块缓存的大小
+    unsigned short m_buf_tail;     // 缓存环的尾部
+
+public:
+    // entries 为提交队列的长度，失败抛出异常
+    Uring(unsigned entries);
+    ~Uring();
+
+    // 取得一个空闲的 sqe，SQ 满了会先提交一次
+    io_uring_sqe *get_sqe();
+
+    // 提交所有的 sqe，并等待至少 wait_nr 个完成事件，timeout_ms 不为-1时最多等待这么多毫秒
+    int submit_and_wait(unsigned wait_nr, int timeout_ms = -1);
+
+    // 取得下一个完成事件，没有返回 nullptr
+    io_uring_cqe *peek_cqe();
+
+    // 完成事件处理完毕，归还给内核
+    void cqe_seen();
+
+    // 注册缓存组 bgid，有 entries 块大小为 buf_size 的缓存，entries 必须是2的幂
+    bool setup_buf_ring(unsigned short bgid, unsigned entries, unsigned buf_size);
+
+    // 取得编号为 bid 的缓存
+    char *get_buf(unsigned short bid) { return m_bufs + (size_t)bid * m_buf_size; }
+
+    // 用完的缓存重新放回缓存环中
+    void recycle_buf(unsigned short bid);
+
+private:
+    // 把取出的 sqe 刷新到共享的 SQ 中，返回待提交的数量
+    unsigned flush_sq();
+};
+
+#endif
@@ -0,0 +1,595 @@
+#include "uring_reactor.h"
+#include <errno.h>
+#include <unistd.h>
+#include <cstring>
+#include <fcntl.h>
+
+UringReactor::UringReactor(int id, int port, bool reuseport, int backlog, int idle_timeout,
+                           int request_timeout, Http_Connect *users)
+    : m_timer_wheel(TIMER_TICK_MS)
+{
+    m_id = id;
+    m_idle_timeout = idle_timeout;
+    m_request_timeout = request_timeout;
+    m_now = TimerWheel::now_ms();
+    m_users = users;
+    m_stop = false;
+
+    m_listenfd = open_listenfd(port, reuseport, backlog);
+    if (m_listenfd == -1)
+    {
+        throw std::exception();
+    }
+
+    try
+    {
+        m_ring = new Uring(RING_ENTRIES);
+    }
+    catch (...)
+    {
+        close(m_listenfd);
+        throw;
+    }
+
+    // recv 使用的缓存由内核从缓存环中挑选，每块和读缓存区一样大
+    if (!m_ring->setup_buf_ring(BUF_GROUP, BUF_ENTRIES, Http_Connect::READ_BUFFER_SIZE))
+    {
+        delete m_ring;
+        close(m_listenfd);
+        throw std::exception();
+    }
+    m_idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    m_conns = new conn_state[MAX_FD]();
+    for (int i = 0; i < MAX_FD; i++)
+    {
+        m_conns[i].pipefd[0] = -1;
+        m_conns[i].pipefd[1] = -1;
+    }
+}
+
+UringReactor::~UringReactor()
+{
+    for (int i = 0; i < MAX_FD; i++)
+    {
+        close_pipe(i);
+    }
+    delete[] m_conns;
+    delete m_ring;
+    close(m_idlefd);
+    close(m_listenfd);
+}
+
+void UringReactor::start()
+{
+    if (pthread_create(&m_thread, nullptr, worker, this) != 0)
+    {
+        throw std::exception();
+    }
+    pthread_detach(m_thread);
+}
+
+void *UringReactor::worker(void *arg)
+{
+    UringReactor *reactor = (UringReactor *)arg;
+    reactor->loop();
+    return reactor;
+}
+
+void UringReactor::prep_accept()
+{
+    io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenfd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    // 一次提交，每个新连接都会产生一个完成事件
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = make_data(EVENT_ACCEPT, 0, m_listenfd);
+}
+
+void UringReactor::prep_recv(int fd)
+{
+    io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    // 由内核从缓存组中挑选缓存，一次提交可以一直收数据
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = make_data(EVENT_RECV, m_conns[fd].gen, fd);
+}
+
+void UringReactor::prep_send(int fd)
+{
+    conn_state &conn = m_conns[fd];
+    conn.sending = true;
+    int delay = 0;
+    if (m_users[fd].send_budget(delay) == 0)
+    {
+        // 超过了限速，发送的位置保存在响应队列中，定时器到期之后从那里继续
+        conn.throttled = true;
+        m_timer_wheel.adjust_timer(m_users[fd].get_timer(), delay, m_now);
+        return;
+    }
+
+    int count = 0;
+    struct iovec *iov = m_users[fd].get_iov(count);
+
+    off_t offset, len;
+    bool has_file = m_users[fd].get_file(offset, len) != -1;
+    if (count == 0)
+    {
+        // 响应头已经发送完了，只剩下文件
+        prep_splice(fd);
+        return;
+    }
+
+    memset(&conn.msg, 0, sizeof(conn.msg));
+    conn.msg.msg_iov = iov;
+    conn.msg.msg_iovlen = count;
+
+    // 不保持连接并且没有文件要发送的话，先取消还在进行的 recv，再把发送和关闭链在一起
+    bool link_close = !m_users[fd].is_linger() && !has_file;
+    if (link_close)
+    {
+        prep_cancel(fd, EVENT_RECV);
+    }
+
+    io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)&conn.msg;
+    sqe->len = 1;
+    // MSG_WAITALL 让内核发送完全部数据才返回，没发完时链接中的关闭会被取消
+    // 后面还有文件时带上 MSG_MORE，响应头和文件的开头合并成一个报文
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | (has_file ? MSG_MORE : 0);
+    sqe->user_data = make_data(EVENT_SEND, conn.gen, fd);
+
+    if (link_close)
+    {
+        sqe->flags |= IOSQE_IO_LINK;
+        prep_close(fd);
+    }
+}
+
+void UringReactor::prep_close(int fd)
+{
+    io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = make_data(EVENT_CLOSE, m_conns[fd].gen, fd);
+    m_conns[fd].closing = true;
+}
+
+void UringReactor::prep_cancel(int fd, int type)
+{
+    io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = make_data(type, m_conns[fd].gen, fd);
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = make_data(EVENT_CANCEL, m_conns[fd].gen, fd);
+}
+
+void UringReactor::prep_splice(int fd)
+{
+    conn_state &conn = m_conns[fd];
+    if (conn.pipefd[0] == -1 && pipe2(conn.pipefd, O_CLOEXEC) == -1)
+    {
+        perror("pipe2 failed");
+        conn.sending = false;
+        close_conn(fd);
+        return;
+    }
+
+    off_t offset, len;
+    int file_fd = m_users[fd].get_file(offset, len);
+    unsigned out_len = conn.piped;
+    if (conn.piped == 0)
+    {
+        // 管道空了，先从文件读一段进管道，链在后面的 splice 再把它发送出去
+        out_len = len > PIPE_CHUNK ? PIPE_CHUNK : (unsigned)len;
+        io_uring_sqe *sqe = m_ring->get_sqe();
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->splice_fd_in = file_fd;
+        sqe->splice_off_in = offset;
+        sqe->fd = conn.pipefd[1];
+        sqe->off = (unsigned long long)-1;
+        sqe->len = out_len;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = make_data(EVENT_SPLICE_IN, conn.gen, fd);
+    }
+
+    io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_fd_in = conn.pipefd[0];
+    sqe->splice_off_in = (unsigned long long)-1;
+    sqe->fd = fd;
+    sqe->off = (unsigned long long)-1;
+    sqe->len = out_len;
+    // 文件后面还有内容时告诉协议栈不要急着发送不满的报文
+    sqe->splice_flags = (off_t)out_len < len ? SPLICE_F_MORE : 0;
+    sqe->user_data = make_data(EVENT_SPLICE_OUT, conn.gen, fd);
+}
+
+void UringReactor::close_pipe(int fd)
+{
+    conn_state &conn = m_conns[fd];
+    if (conn.pipefd[0] != -1)
+    {
+        close(conn.pipefd[0]);
+        close(conn.pipefd[1]);
+        conn.pipefd[0] = -1;
+        conn.pipefd[1] = -1;
+    }
+    conn.piped = 0;
+}
+
+void UringReactor::close_conn(int fd)
+{
+    conn_state &conn = m_conns[fd];
+    if (conn.sending && !conn.throttled)
+    {
+        // 内核还在使用写缓存区、响应队列、文件和管道，现在归还的话可能被别的连接拿去，
+        // 取消还在进行的发送，由发送的完成事件关闭连接
+        if (!conn.aborting)
+        {
+            conn.aborting = true;
+            prep_cancel(fd, EVENT_SEND);
+            prep_cancel(fd, EVENT_SPLICE_IN);
+            prep_cancel(fd, EVENT_SPLICE_OUT);
+        }
+        return;
+    }
+
+    m_timer_wheel.del_timer(m_users[fd].get_timer());
+    prep_cancel(fd, EVENT_RECV);
+    m_users[fd].close_connect();
+    // 代数加一，之后这个连接迟到的完成事件都会被丢弃
+    conn.gen++;
+    conn.sending = false;
+    conn.closing = false;
+    conn.aborting = false;
+    conn.throttled = false;
+    // 管道里可能还有没发送的数据，不能留给下一个连接
+    close_pipe(fd);
+}
+
+void UringReactor::deal_accept(io_uring_cqe *cqe)
+{
+    // multishot 请求结束了，需要重新提交
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        prep_accept();
+    }
+
+    int connfd = cqe->res;
+    if (connfd == -EMFILE || connfd == -ENFILE)
+    {
+        // 文件描述符用完了，把队列中的连接都丢弃，否则重新提交的accept会一直失败
+        while (drop_pending_connect(m_listenfd, m_idlefd))
+        {
+        }
+        return;
+    }
+    if (connfd < 0)
+    {
+        printf("accept failed, errno: %d\n", -connfd);
+        return;
+    }
+
+    // 判断服务器服务的用户是否已经爆满
+    if (connfd >= MAX_FD || Http_Connect::m_uesr_count >= MAX_FD)
+    {
+        close(connfd);
+        return;
+    }
+
+    // multishot accept 不返回客户端的地址
+    sockaddr_in client_address;
+    memset(&client_address, 0, sizeof(client_address));
+    m_users[connfd].init(connfd, client_address, -1);
+
+    m_conns[connfd].sending = false;
+    m_conns[connfd].closing = false;
+    m_conns[connfd].aborting = false;
+    m_conns[connfd].throttled = false;
+    m_timer_wheel.add_timer(m_users[connfd].get_timer(), m_idle_timeout, m_now);
+    prep_recv(connfd);
+}
+
+void UringReactor::on_timeout(TimerNode *timer, void *arg)
+{
+    UringReactor *reactor = (UringReactor *)arg;
+    reactor->deal_timeout(timer);
+}
+
+void UringReactor::deal_timeout(TimerNode *timer)
+{
+    Http_Connect *conn = (Http_Connect *)timer->user_data;
+    int fd = conn->get_sockfd();
+    if (fd < 0 || m_conns[fd].closing)
+    {
+        return;
+    }
+    if (m_conns[fd].throttled)
+    {
+        m_conns[fd].throttled = false;
+        m_timer_wheel.add_timer(timer, m_idle_timeout, m_now);
+        prep_send(fd);
+        return;
+    }
+    // 发送已经一个超时时间没有进展了，close_conn 会取消还在进行的发送，由发送的完成事件关闭连接
+    close_conn(fd);
+    if (m_conns[fd].sending)
+    {
+        m_timer_wheel.add_timer(timer, m_idle_timeout, m_now);
+    }
+}
+
+void UringReactor::deal_recv(io_uring_cqe *cqe)
+{
+    int fd = data_fd(cqe->user_data);
+    conn_state &conn = m_conns[fd];
+    bool stale = data_gen(cqe->user_data) != (conn.gen & 0xffffff);
+
+    // 先把数据拷贝到连接的读缓存区，再把缓存还给内核
+    bool ok = true;
+    bool new_request = !stale && !m_users[fd].in_request();
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (!stale && cqe->res > 0)
+        {
+            ok = m_users[fd].feed(m_ring->get_buf(bid), cqe->res);
+        }
+        m_ring->recycle_buf(bid);
+    }
+
+    // 旧连接的事件，或者连接已经在关闭了
+    if (stale || conn.closing)
+    {
+        return;
+    }
+
+    if (cqe->res == -ENOBUFS)
+    {
+        // 缓存暂时用完了，重新提交
+        prep_recv(fd);
+        return;
+    }
+
+    if (cqe->res <= 0 || !ok)
+    {
+        // 对方关闭连接，出错，或者读缓存区满了
+        close_conn(fd);
+        return;
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        prep_recv(fd);
+    }
+    // 收到新请求的第一个字节，之后要在请求超时时间内收完整个请求
+    if (new_request)
+    {
+        m_timer_wheel.adjust_timer(m_users[fd].get_timer(), m_request_timeout, m_now);
+    }
+    else if (m_users[fd].in_body())
+    {
+        // 请求体可能很大，收到数据就按空闲时间重新计算
+        m_timer_wheel.adjust_timer(m_users[fd].get_timer(), m_idle_timeout, m_now);
+    }
+
+    // 上一个响应还在发送中，等发送完再处理
+    if (!conn.sending)
+    {
+        deal_request(fd);
+    }
+}
+
+void UringReactor::deal_request(int fd)
+{
+    Http_Connect::PROCESS_STATE state = m_users[fd].process_request();
+    if (state == Http_Connect::PROCESS_NEED_READ)
+    {
+        // multishot recv 还在，什么都不用做
+        return;
+    }
+
+    if (state == Http_Connect::PROCESS_CLOSE)
+    {
+        close_conn(fd);
+        return;
+    }
+
+    prep_send(fd);
+}
+
+void UringReactor::deal_send(io_uring_cqe *cqe)
+{
+    int fd = data_fd(cqe->user_data);
+    conn_state &conn = m_conns[fd];
+    if (!is_current(cqe->user_data))
+    {
+        return;
+    }
+    m_timer_wheel.adjust_timer(m_users[fd].get_timer(), m_idle_timeout, m_now);
+
+    if (cqe->res < 0 || conn.aborting)
+    {
+        // 发送出错，链接中的关闭会被取消，由 deal_close 关闭
+        conn.sending = false;
+        if (!conn.closing)
+        {
+            close_conn(fd);
+        }
+        return;
+    }
+
+    if (!m_users[fd].update_iov(cqe->res))
+    {
+        // 还没有发送完，继续发送响应头或者文件
+        if (!conn.closing)
+        {
+            prep_send(fd);
+        }
+        return;
+    }
+
+    conn.sending = false;
+    if (!conn.closing)
+    {
+        finish_send(fd);
+    }
+}
+
+void UringReactor::finish_send(int fd)
+{
+    conn_state &conn = m_conns[fd];
+    conn.sending = false;
+    // 发送完毕，长连接会重新初始化等待下一个请求
+    if (!m_users[fd].finish_write())
+    {
+        prep_cancel(fd, EVENT_RECV);
+        prep_close(fd);
+        return;
+    }
+    // 发送期间收到的，或者上一批没有处理的流水线上的请求
+    if (m_users[fd].has_pending())
+    {
+        deal_request(fd);
+    }
+}
+
+void UringReactor::deal_splice_in(io_uring_cqe *cqe)
+{
+    int fd = data_fd(cqe->user_data);
+    conn_state &conn = m_conns[fd];
+    if (!is_current(cqe->user_data))
+    {
+        return;
+    }
+
+    // 出错时链在后面的 splice 会被取消，由它的完成事件关闭连接
+    if (cqe->res > 0)
+    {
+        conn.piped += cqe->res;
+    }
+    else if (cqe->res == 0)
+    {
+        // 文件被截短了，已经不可能发送完
+        conn.aborting = true;
+    }
+}
+
+void UringReactor::deal_splice_out(io_uring_cqe *cqe)
+{
+    int fd = data_fd(cqe->user_data);
+    conn_state &conn = m_conns[fd];
+    if (!is_current(cqe->user_data))
+    {
+        return;
+    }
+    m_timer_wheel.adjust_timer(m_users[fd].get_timer(), m_idle_timeout, m_now);
+
+    if (cqe->res == -ECANCELED && conn.piped > 0 && !conn.aborting)
+    {
+        // 读进管道的比预期的少，链在后面的这个 splice 被取消了，把管道里已有的发出去
+        prep_splice(fd);
+        return;
+    }
+    if (cqe->res <= 0 || conn.aborting)
+    {
+        conn.sending = false;
+        close_conn(fd);
+        return;
+    }
+
+    conn.piped -= cqe->res;
+    if (!m_users[fd].update_iov(cqe->res))
+    {
+        // 文件还没有发送完，或者后面还有流水线上其他请求的响应
+        prep_send(fd);
+        return;
+    }
+    finish_send(fd);
+}
+
+void UringReactor::deal_close(io_uring_cqe *cqe)
+{
+    int fd = data_fd(cqe->user_data);
+    conn_state &conn = m_conns[fd];
+    if (!is_current(cqe->user_data))
+    {
+        return;
+    }
+
+    if (cqe->res == -ECANCELED)
+    {
+        // 前面的发送失败了，关闭没有执行，自己关闭
+        m_users[fd].close_connect();
+    }
+    else
+    {
+        m_users[fd].close_connect(false);
+    }
+    m_timer_wheel.del_timer(m_users[fd].get_timer());
+    conn.gen++;
+    conn.sending = false;
+    conn.closing = false;
+    conn.aborting = false;
+    conn.throttled = false;
+    close_pipe(fd);
+}
+
+void UringReactor::loop()
+{
+    // 每个reactor绑定到一个CPU上，减少线程在核之间的迁移
+    bind_cpu(m_id);
+
+    prep_accept();
+    while (!m_stop)
+    {
+        // 提交所有请求并等待至少一个完成事件，最多等到下一个定时器到期，一次系统调用
+        int timeout = m_timer_wheel.next_timeout(m_now);
+        int ret = m_ring->submit_and_wait(1, timeout);
+        // 这一轮事件处理都使用同一个时间
+        m_now = TimerWheel::now_ms();
+        if (ret < 0 && errno != EBUSY && errno != ETIME)
+        {
+            perror("io_uring_enter failed");
+            break;
+        }
+
+        io_uring_cqe *cqe;
+        while ((cqe = m_ring->peek_cqe()) != nullptr)
+        {
+            switch (data_type(cqe->user_data))
+            {
+                case EVENT_ACCEPT:
+                    deal_accept(cqe);
+                    break;
+                case EVENT_RECV:
+                    deal_recv(cqe);
+                    break;
+                case EVENT_SEND:
+                    deal_send(cqe);
+                    break;
+                case EVENT_CLOSE:
+                    deal_close(cqe);
+                    break;
+                case EVENT_SPLICE_IN:
+                    deal_splice_in(cqe);
+                    break;
+                case EVENT_SPLICE_OUT:
+                    deal_splice_out(cqe);
+                    break;
+                default:
+                    break;
+            }
+            m_ring->cqe_seen();
+        }
+
+        m_timer_wheel.tick(m_now, on_timeout, this);
+    }
+}
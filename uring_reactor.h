@@ -0,0 +1,128 @@
+#ifndef URING_REACTOR_H
+#define URING_REACTOR_H
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include "http_connect.h"
+#include "reactor.h"
+#include "uring.h"
+
+/*
+    io_uring 后端的事件循环，可以替代 epoll 的 Reactor
+    multishot accept 接受新连接，multishot recv 从提供的缓存环中读数据，
+    收到完整请求后直接在本线程驱动 Http_Connect 的状态机，再提交发送，
+    不需要保持连接时发送和关闭通过 IOSQE_IO_LINK 链在一起。
+    文件内容通过连接自己的管道用两个链在一起的 splice 发送(文件->管道->socket)，不经过用户态。
+    所有请求都在一次 io_uring_enter 中批量提交，一个长连接请求大约只需要一次系统调用。
+    定时器到期的时刻作为 io_uring_enter 的等待超时，不需要额外的timerfd。
+*/
+class UringReactor
+{
+private:
+    static const unsigned RING_ENTRIES = 4096;     // 提交队列的长度
+    static const unsigned BUF_ENTRIES = 1024;      // 提供给 recv 的缓存个数，必须是2的幂
+    static const unsigned short BUF_GROUP = 0;     // 缓存组的编号
+    static const unsigned PIPE_CHUNK = 65536;      // 每次 splice 的最大长度，和管道默认的容量一样
+
+    // 完成事件的类型，和文件描述符、代数一起编码在 user_data 中
+    enum EVENT_TYPE
+    {
+        EVENT_ACCEPT = 1,
+        EVENT_RECV,
+        EVENT_SEND,
+        EVENT_CLOSE,
+        EVENT_CANCEL,
+        EVENT_SPLICE_IN,  // 文件到管道
+        EVENT_SPLICE_OUT  // 管道到socket
+    };
+
+    // 每个连接在 reactor 中的状态
+    struct conn_state
+    {
+        unsigned gen;  // 连接的代数，文件描述符被复用之后用来丢弃旧连接迟到的完成事件
+        bool sending;  // 是否有发送请求还没有完成
+        bool closing;  // 已经提交了关闭请求
+        bool aborting; // 发送超时，已经取消了还在进行的发送
+        bool throttled; // 超过了限速，定时器到期之后再继续发送
+        int pipefd[2]; // 发送文件用的管道，第一次发送文件时创建，连接关闭时关闭
+        int piped;     // 已经读进管道还没有发送到socket的字节数
+        msghdr msg;    // 发送用的消息头，要一直有效到请求提交给内核
+    };
+
+    int m_id;                // reactor的编号，也用来绑定CPU
+    int m_listenfd;          // 自己的监听socket
+    int m_idlefd;            // 预留的空闲文件描述符，文件描述符用完时使用
+    Uring *m_ring;           // 自己的 io_uring
+    Http_Connect *m_users;   // 所有连接的数组，按文件描述符索引
+    conn_state *m_conns;     // 连接在本 reactor 中的状态，按文件描述符索引
+    pthread_t m_thread;      // 事件循环所在的线程
+    bool m_stop;             // 是否结束事件循环
+    TimerWheel m_timer_wheel; // 连接的超时定时器
+    unsigned long long m_now; // 每轮事件循环缓存一次的单调时钟，单位毫秒
+    int m_idle_timeout;      // 连接空闲多少毫秒之后关闭
+    int m_request_timeout;   // 收到请求的第一个字节之后，多少毫秒内必须收完整个请求
+
+public:
+    // 创建失败(例如内核不支持 io_uring)抛出异常
+    UringReactor(int id, int port, bool reuseport, int backlog, int idle_timeout, int request_timeout,
+                 Http_Connect *users);
+    ~UringReactor();
+
+    // 创建新线程运行事件循环
+    void start();
+
+    // 在当前线程运行事件循环
+    void loop();
+
+private:
+    // 创建线程之后的运行函数
+    static void *worker(void *arg);
+
+    // 编码和解码 user_data
+    static unsigned long long make_data(int type, unsigned gen, int fd)
+    {
+        return ((unsigned long long)type << 56) | ((unsigned long long)(gen & 0xffffff) << 32) | (unsigned)fd;
+    }
+    static int data_type(unsigned long long data) { return (int)(data >> 56); }
+    static unsigned data_gen(unsigned long long data) { return (unsigned)(data >> 32) & 0xffffff; }
+    static int data_fd(unsigned long long data) { return (int)(data & 0xffffffff); }
+
+    // 提交各种请求
+    void prep_accept();
+    void prep_recv(int fd);
+    void prep_send(int fd);
+    void prep_close(int fd);
+    void prep_cancel(int fd, int type);
+    void prep_splice(int fd);
+
+    // 处理各种完成事件
+    void deal_accept(io_uring_cqe *cqe);
+    void deal_recv(io_uring_cqe *cqe);
+    void deal_send(io_uring_cqe *cqe);
+    void deal_close(io_uring_cqe *cqe);
+    void deal_splice_in(io_uring_cqe *cqe);
+    void deal_splice_out(io_uring_cqe *cqe);
+
+    // 响应全部发送完毕，长连接等待下一个请求，否则关闭
+    void finish_send(int fd);
+
+    // 驱动状态机，有完整请求就提交发送
+    void deal_request(int fd);
+
+    // 出错或者对方关闭时关闭连接，还有发送在进行时先取消，等发送的完成事件再关闭
+    void close_conn(int fd);
+
+    // 关闭发送文件用的管道
+    void close_pipe(int fd);
+
+    // 完成事件是不是这个连接当前这一代的
+    bool is_current(unsigned long long data) { return data_gen(data) == (m_conns[data_fd(data)].gen & 0xffffff); }
+
+    // 定时器到期的回调函数，arg为reactor
+    static void on_timeout(TimerNode *timer, void *arg);
+
+    // 关闭超时的连接
+    void deal_timeout(TimerNode *timer);
+};
+
+#endif
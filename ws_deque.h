@@ -0,0 +1,114 @@
+#ifndef WS_DEQUE_H
+#define WS_DEQUE_H
+
+#include <atomic>
+
+/*
+    Chase-Lev 工作窃取双端队列，固定容量，不扩容
+    只有所属的线程在底部放入和取出任务，取出的是最新的任务，缓存还是热的；
+    其他线程从顶部偷走最旧的任务，只有偷的线程之间、以及和所属线程抢最后一个任务时才需要CAS。
+    内存序按 Lê 等人的 C11 版本 (Correct and Efficient Work-Stealing for Weak Memory Models)
+*/
+template <class T>
+class WorkStealingDeque
+{
+public:
+    static const long CAPACITY = 256; // 必须是2的幂
+    static const long MASK = CAPACITY - 1;
+
+    WorkStealingDeque() : m_top(0), m_bottom(0)
+    {
+        for (long i = 0; i < CAPACITY; i++)
+        {
+            m_items[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    // 只能由所属的线程调用，满了返回false
+    bool push(T *item);
+
+    // 只能由所属的线程调用，没有任务返回nullptr
+    T *pop();
+
+    // 任何线程都可以调用，没有任务或者被别的线程抢先时返回nullptr
+    T *steal();
+
+    // 大概的任务数，只用来判断有没有任务可偷
+    long size() const
+    {
+        long size = m_bottom.load(std::memory_order_relaxed) - m_top.load(std::memory_order_relaxed);
+        return size > 0 ? size : 0;
+    }
+
+private:
+    // 所属线程和偷的线程分别修改，放在不同的缓存行
+    alignas(64) std::atomic<long> m_top;
+    alignas(64) std::atomic<long> m_bottom;
+    alignas(64) std::atomic<T *> m_items[CAPACITY];
+};
+
+template <class T>
+bool WorkStealingDeque<T>::push(T *item)
+{
+    long b = m_bottom.load(std::memory_order_relaxed);
+    long t = m_top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY)
+    {
+        return false;
+    }
+    m_items[b & MASK].store(item, std::memory_order_relaxed);
+    // 任务先写好，偷的线程看到新的 bottom 时一定能看到任务
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+template <class T>
+T *WorkStealingDeque<T>::pop()
+{
+    // 先占住底部的位置，再看有没有被偷走
+    long b = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long t = m_top.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        // 队列是空的
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    T *item = m_items[b & MASK].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        // 最后一个任务，和偷的线程抢
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            item = nullptr;
+        }
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+}
+
+template <class T>
+T *WorkStealingDeque<T>::steal()
+{
+    long t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b)
+    {
+        return nullptr;
+    }
+
+    T *item = m_items[t & MASK].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+    return item;
+}
+
+#endif